@@ -0,0 +1,594 @@
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include "lcvt_mmap.h"
+#include "vtage.h"
+#include "hybrid_vp.h"
+#include "hogwild_warmup.h"
+#include "vp_ablation.h"
+#include "shm_ring.h"
+#include "latency_histogram.h"
+#include "lcvt_hierarchy.h"
+#include "lcvt_admission.h"
+#include "kernel_cache.h"
+#include "rv64_emulator.h"
+#include "live_stats.h"
+#include "sweep_queue.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Synthetic value trace with a large static footprint: num_pcs value
+// producing PCs visited in a pseudo-random order, one branch every few
+// values.
+std::vector<ValueTraceRecord> makeLargeFootprintTrace(size_t num_records, size_t num_pcs) {
+    std::vector<ValueTraceRecord> trace;
+    trace.reserve(num_records);
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < num_records; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if (i % 5 == 4) {
+            trace.push_back({branch_record, (x & 1) != 0, 0x400000 + (x % 512) * 4, 0});
+        } else {
+            PC pc = 0x10000000 + (x % num_pcs) * 4;
+            trace.push_back({value_record, false, pc, (x >> 40) & 3});
+        }
+    }
+    return trace;
+}
+
+template <class F>
+double nsPerRecord(size_t records, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / records;
+}
+
+// Over the mapped LCVT, whose prefetch() issues the bucket address directly;
+// the default LCVT has nothing to prefetch.
+void bench_interleaved_replay() {
+    const size_t num_records = 4000000;
+    const size_t num_pcs = 4000000;
+    auto trace = makeLargeFootprintTrace(num_records, num_pcs);
+    std::string path = "/tmp/bench_amac_" + std::to_string(getpid()) + ".bin";
+
+    std::cout << "Mapped LCVT replay, " << num_records << " records, " << num_pcs << " static PCs\n";
+
+    ReplayStats reference;
+    {
+        unlink(path.c_str());
+        BasicValuePredictor<MappedLastCommittedValueTable> vp({}, path, 1 << 23, 0);
+        replayValueTrace(vp, trace);  // warm the LCVT to its full size
+        double ns = nsPerRecord(num_records, [&] { reference = replayValueTrace(vp, trace); });
+        std::cout << "  sequential:           " << ns << " ns/record\n";
+    }
+
+    for (size_t group : {2, 4, 8, 16}) {
+        unlink(path.c_str());
+        BasicValuePredictor<MappedLastCommittedValueTable> vp({}, path, 1 << 23, 0);
+        replayValueTraceInterleaved(vp, trace, group);
+        ReplayStats stats;
+        double ns = nsPerRecord(num_records, [&] { stats = replayValueTraceInterleaved(vp, trace, group); });
+        std::cout << "  interleaved, group " << group << ": " << ns << " ns/record"
+                  << (stats == reference ? "" : "  (MISMATCH)") << "\n";
+    }
+    unlink(path.c_str());
+}
+
+void bench_mapped_lcvt() {
+    const size_t num_records = 4000000;
+    const size_t num_pcs = 4000000;
+    auto trace = makeLargeFootprintTrace(num_records, num_pcs);
+    std::string path = "/tmp/bench_lcvt_" + std::to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+
+    std::cout << "Mapped LCVT replay, " << num_records << " records, " << num_pcs << " static PCs\n";
+    {
+        BasicValuePredictor<MappedLastCommittedValueTable> vp({}, path, 1 << 20, 1 << 14);
+        double cold = nsPerRecord(num_records, [&] { replayValueTrace(vp, trace); });
+        double warm = nsPerRecord(num_records, [&] { replayValueTrace(vp, trace); });
+        double amac = nsPerRecord(num_records, [&] { replayValueTraceInterleaved(vp, trace, 8); });
+        std::cout << "  sequential (cold):    " << cold << " ns/record\n";
+        std::cout << "  sequential (warm):    " << warm << " ns/record\n";
+        std::cout << "  interleaved, group 8: " << amac << " ns/record\n";
+    }
+    unlink(path.c_str());
+}
+
+void bench_vtage() {
+    auto gcc_trace = makeValueTraceFromBranches("trace_gcc.txt");
+    auto large_trace = makeLargeFootprintTrace(4000000, 4000000);
+
+    for (auto* trace : {&gcc_trace, &large_trace}) {
+        const char* name = (trace == &gcc_trace) ? "gcc-derived" : "large footprint";
+        ValuePredictor lcvt_vp({});
+        VTagePredictor vtage;
+        ReplayStats lcvt_stats, vtage_stats;
+        double lcvt_ns = nsPerRecord(trace->size(), [&] { lcvt_stats = replayValueTrace(lcvt_vp, *trace); });
+        double vtage_ns = nsPerRecord(trace->size(), [&] { vtage_stats = replayValueTrace(vtage, *trace); });
+        std::cout << "VTAGE vs LCVT, " << name << " trace (" << trace->size() << " records)\n";
+        std::cout << "  LCVT:  " << lcvt_ns << " ns/record, high-confidence correct "
+                  << lcvt_stats.correct[high] << ", wrong " << lcvt_stats.incorrect[high] << "\n";
+        std::cout << "  VTAGE: " << vtage_ns << " ns/record, high-confidence correct "
+                  << vtage_stats.correct[high] << ", wrong " << vtage_stats.incorrect[high] << "\n";
+    }
+}
+
+void bench_hybrid() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt");
+    std::cout << "Hybrid predictor, gcc-derived trace (" << trace.size() << " records)\n";
+
+    auto report = [&](const char* name, auto& vp) {
+        ReplayStats stats;
+        double ns = nsPerRecord(trace.size(), [&] { stats = replayValueTrace(vp, trace); });
+        std::cout << "  " << name << ns << " ns/record, high-confidence correct "
+                  << stats.correct[high] << ", wrong " << stats.incorrect[high] << "\n";
+    };
+    ValuePredictor lcvt_vp({});
+    HybridValuePredictor hybrid;
+    HybridValuePredictor full({.use_context_engine = true});
+    report("LCVT:                 ", lcvt_vp);
+    report("last value + stride:  ", hybrid);
+    report("+ VTAGE:              ", full);
+}
+
+void bench_banked_groups() {
+    auto trace = makeLargeFootprintTrace(4000000, 4096);
+    std::cout << "Banked fetch groups, " << trace.size() << " records\n";
+
+    ValuePredictor seq_vp({});
+    double seq_ns = nsPerRecord(trace.size(), [&] { replayValueTrace(seq_vp, trace); });
+    std::cout << "  sequential, unbanked:   " << seq_ns << " ns/record\n";
+    for (size_t banks : {1, 4}) {
+        ValuePredictor vp({});
+        BankConflictStats bank_stats;
+        double ns = nsPerRecord(trace.size(), [&] {
+            replayValueTraceGrouped(vp, trace, 8, {.banks = banks, .read_ports = 1, .drop_losers = true}, bank_stats);
+        });
+        std::cout << "  8-wide groups, " << banks << " bank(s): " << ns << " ns/record, "
+                  << 100.0 * bank_stats.predictions_with_conflict / bank_stats.predictions << "% lose a port\n";
+    }
+}
+
+void bench_hogwild_warmup() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt");
+    size_t split = trace.size() * 3 / 4;
+    std::vector<ValueTraceRecord> warm(trace.begin(), trace.begin() + split);
+    std::vector<ValueTraceRecord> measure(trace.begin() + split, trace.end());
+    std::cout << "Hogwild warmup, " << warm.size() << " warmup and " << measure.size() << " measured records, "
+              << std::thread::hardware_concurrency() << " CPUs\n";
+
+    for (size_t threads : {1, 2, 4, 8}) {
+        HogwildReport r = compareHogwildWarmup(defaultValuePredictorConfig(), warm, measure, threads);
+        std::cout << "  " << threads << " thread(s): speedup " << r.speedup << ", accuracy drift " << r.drift << "\n";
+    }
+}
+
+void bench_ablation() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt");
+    auto configs = defaultValuePredictorConfig();
+    std::cout << "Leave-one-out ablation of " << configs.size() - 1 << " tagged components, " << trace.size() << " records\n";
+
+    double separate_ns = nsPerRecord(trace.size(), [&] {
+        for (size_t k = 0; k < configs.size(); k++) {
+            ValuePredictorParams params;
+            if (k > 0)
+                params.components.erase(params.components.begin() + k);
+            ValuePredictor vp(params);
+            replayValueTrace(vp, trace);
+        }
+    });
+    double single_ns = nsPerRecord(trace.size(), [&] { runAblation(trace, configs); });
+    std::cout << "  " << configs.size() << " separate runs: " << separate_ns << " ns/record\n"
+              << "  single pass:     " << single_ns << " ns/record\n";
+}
+
+void bench_shm_ring() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 500000);
+    std::cout << "Shared-memory ring transport, " << trace.size() << " records, "
+              << std::thread::hardware_concurrency() << " CPUs\n";
+
+    ValuePredictor in_process({});
+    double local_ns = nsPerRecord(trace.size(), [&] { replayValueTrace(in_process, trace); });
+
+    std::string name = "/bench_vp_ring_" + std::to_string(getpid());
+    ValuePredictor served({});
+    ShmPredictorServer<ValuePredictor> server(served, name);
+    double shm_ns = nsPerRecord(trace.size(), [&] {
+        pid_t pid = fork();
+        if (pid == 0) {
+            ShmPredictorClient client(name);
+            for (size_t i = 0; i < trace.size(); i++)
+                stepRecord(client, trace[i], i);
+            client.shutdown();
+            _exit(0);
+        }
+        server.serve();
+        waitpid(pid, nullptr, 0);
+    });
+    std::cout << "  in-process:           " << local_ns << " ns/record\n"
+              << "  client in a process:  " << shm_ns << " ns/record\n";
+}
+
+// Per-call cycle counts of the operations with rare expensive cases: LCVT
+// rehashes, deep squashes, branch_queue block allocations and allocation
+// loops in onValueCommit.
+void bench_tail_latency() {
+    auto trace = makeLargeFootprintTrace(4000000, 1000000);
+    std::cout << "Per-call latency in " << cyclesUnit() << ", " << trace.size() << " records\n";
+
+    LastCommittedValueTable lcvt;
+    EqualityPredictor ep(defaultValuePredictorConfig());
+    LatencyHistogram predict_h, commit_h, lcvt_h, branch_h, branch_commit_h, squash_h;
+    uint64_t x = 0x2545F4914F6CDD1Dull;
+    InstSeqNum seq = 0;
+    InstSeqNum oldest = 0;
+    size_t depth = 8;
+
+    for (const auto& rec : trace) {
+        if (rec.kind == value_record) {
+            bool equal = lcvt.lookup(rec.pc) == rec.value;
+            uint64_t t0 = readCycles();
+            ep.predict(rec.pc);
+            uint64_t t1 = readCycles();
+            ep.onValueCommit(rec.pc, equal);
+            uint64_t t2 = readCycles();
+            lcvt.update(rec.pc, rec.value);
+            uint64_t t3 = readCycles();
+            predict_h.record(t1 - t0);
+            commit_h.record(t2 - t1);
+            lcvt_h.record(t3 - t2);
+            continue;
+        }
+
+        uint64_t t0 = readCycles();
+        ep.updateOnBranch(seq++, rec.taken);
+        branch_h.record(readCycles() - t0);
+        if (seq - oldest < depth)
+            continue;
+
+        // Resolve the window: usually commit it, sometimes squash all of it
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if ((x & 3) == 0) {
+            t0 = readCycles();
+            ep.squash(oldest);
+            squash_h.record(readCycles() - t0);
+            seq = oldest;
+        } else {
+            for (; oldest < seq; oldest++) {
+                t0 = readCycles();
+                ep.onBranchCommit(oldest);
+                branch_commit_h.record(readCycles() - t0);
+            }
+        }
+        depth = 1 + (x >> 8) % (MAX_BRANCH_SPEC_DISTANCE - 1);
+    }
+
+    printLatencyHeader(std::cout);
+    printLatencyRow(std::cout, "predict", predict_h);
+    printLatencyRow(std::cout, "onValueCommit", commit_h);
+    printLatencyRow(std::cout, "lcvt update", lcvt_h);
+    printLatencyRow(std::cout, "updateOnBranch", branch_h);
+    printLatencyRow(std::cout, "onBranchCommit", branch_commit_h);
+    printLatencyRow(std::cout, "squash", squash_h);
+}
+
+// Peak RSS in bytes of a child that runs f, minus that of a child doing
+// nothing, so the forked copy of the parent's heap cancels out.
+template <class F>
+long childPeakRss(F&& f) {
+    auto run = [](auto&& body) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            body();
+            std::cout.flush();
+            _exit(0);
+        }
+        int status;
+        struct rusage usage;
+        wait4(pid, &status, 0, &usage);
+        return usage.ru_maxrss * 1024L;
+    };
+    long baseline = run([] {});
+    return run(f) - baseline;
+}
+
+// Measured peak RSS against the accounted footprint, per static PC for the
+// LCVT backends and per entry for the entry layouts. The children hand the
+// accounted total back through a shared page.
+void bench_memory_footprint() {
+    const size_t num_pcs = 2000000;
+    std::cout << "Memory footprint, " << num_pcs << " static PCs\n";
+
+    auto* accounted = static_cast<size_t*>(
+        mmap(nullptr, sizeof(size_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    auto fill = [&](auto& vp) {
+        for (size_t i = 0; i < num_pcs; i++) {
+            vp.onValueCommit(0x10000000 + i * 4, i);
+        }
+        MemoryFootprint fp;
+        vp.accountMemory(fp);
+        *accounted = fp.total();
+    };
+    auto report = [&](const char* name, long rss) {
+        std::cout << "  " << name << (rss / double(num_pcs)) << " B/PC peak RSS, "
+                  << (*accounted / double(num_pcs)) << " B/PC accounted\n";
+    };
+
+    report("unordered_map LCVT:   ", childPeakRss([&] {
+        ValuePredictor vp({});
+        fill(vp);
+    }));
+
+    std::string path = "/tmp/bench_footprint_" + std::to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+    report("mapped LCVT:          ", childPeakRss([&] {
+        BasicValuePredictor<MappedLastCommittedValueTable> vp({}, path, 1 << 20, 1 << 14);
+        fill(vp);
+    }));
+    unlink(path.c_str());
+    munmap(accounted, sizeof(size_t));
+
+    const size_t num_entries = 1 << 22;
+    auto layout = [&](const char* name, auto entry) {
+        long rss = childPeakRss([&] {
+            std::vector<decltype(entry)> entries(num_entries, entry);
+        });
+        std::cout << "  " << name << sizeof(entry) << " B/entry, "
+                  << (rss / double(num_entries)) << " B/entry peak RSS\n";
+    };
+    layout("EqualityPredictorEntry: ", EqualityPredictorEntry());
+    layout("packed hogwild entry:   ", uint64_t(1));
+    layout("VTageEntry:             ", VTageEntry());
+}
+
+// Two-level LCVT against the unbounded table: simulation speed, and the
+// latency at which predictions are delivered.
+void bench_lcvt_hierarchy() {
+    auto gcc_trace = makeValueTraceFromBranches("trace_gcc.txt");
+    auto large_trace = makeLargeFootprintTrace(4000000, 200000);
+
+    for (auto* trace : {&gcc_trace, &large_trace}) {
+        const char* name = (trace == &gcc_trace) ? "gcc-derived" : "large footprint";
+        std::cout << "Two-level LCVT, " << name << " trace (" << trace->size() << " records)\n";
+        ValuePredictor flat({});
+        ReplayStats flat_stats;
+        double flat_ns = nsPerRecord(trace->size(), [&] { flat_stats = replayValueTrace(flat, *trace); });
+        std::cout << "  unordered_map: " << flat_ns << " ns/record, high-confidence correct "
+                  << flat_stats.correct[high] << "\n";
+
+        // The tables alone, without the equality predictor
+        auto tableOnly = [&](auto& table) {
+            uint64_t hits = 0;
+            double ns = nsPerRecord(trace->size(), [&] {
+                for (const auto& rec : *trace) {
+                    if (rec.kind != value_record)
+                        continue;
+                    hits += table.hasValue(rec.pc) && lcvtPredictLookup(table, rec.pc) == rec.value;
+                    table.update(rec.pc, rec.value);
+                }
+            });
+            return std::make_pair(ns, hits);
+        };
+        LastCommittedValueTable flat_table;
+        TwoLevelLastCommittedValueTable two_level_table(TwoLevelLcvtConfig{{256, 4, 1}, {8192, 8, 4}});
+        auto [flat_table_ns, flat_hits] = tableOnly(flat_table);
+        auto [two_level_ns, two_level_hits] = tableOnly(two_level_table);
+        std::cout << "  table only: unordered_map " << flat_table_ns << " ns/record (" << flat_hits
+                  << " equal), two-level " << two_level_ns << " ns/record (" << two_level_hits << " equal)\n";
+
+        for (auto policy : {lcvt_inclusive, lcvt_exclusive}) {
+            TwoLevelLcvtConfig config;
+            config.l1 = {256, 4, 1};
+            config.l2 = {8192, 8, 4};
+            config.policy = policy;
+            BasicValuePredictor<TwoLevelLastCommittedValueTable> vp({}, config);
+            ReplayStats stats;
+            double ns = nsPerRecord(trace->size(), [&] { stats = replayValueTrace(vp, *trace); });
+            std::cout << "  " << (policy == lcvt_inclusive ? "inclusive" : "exclusive") << ":     "
+                      << ns << " ns/record, high-confidence correct " << stats.correct[high] << "\n";
+            printLcvtHierarchyStats(std::cout, vp.lcvtTable().hierarchyStats(), config);
+        }
+    }
+}
+
+void bench_lcvt_admission() {
+    auto gcc_trace = makeValueTraceFromBranches("trace_gcc.txt");
+    auto large_trace = makeLargeFootprintTrace(4000000, 1000000);
+
+    for (auto* trace : {&gcc_trace, &large_trace}) {
+        const char* name = (trace == &gcc_trace) ? "gcc-derived" : "large footprint";
+        for (unsigned threshold : {1u, 2u}) {
+            std::cout << "LCVT admission filter, " << name << " trace (" << trace->size()
+                      << " records), threshold " << threshold << "\n";
+            AdmissionFilterConfig config;
+            config.threshold = threshold;
+            printAdmissionReport(std::cout, compareAdmission(*trace, config));
+        }
+    }
+}
+
+// Replay with the generic ValuePredictor against a kernel compiled for the
+// geometry, for a few sweep points. Build time is that of the first create().
+void bench_kernel_cache() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt");
+    KernelCacheOptions options;
+    options.cache_dir = "/tmp/bench_kernels_" + std::to_string(getpid());
+    KernelCache cache(options);
+    std::cout << "Config-specialized kernels, gcc-derived trace (" << trace.size() << " records)\n";
+
+    for (size_t tagged : {2, 6, 10}) {
+        std::vector<ComponentConfig> configs = {{.size = 4096, .ghist_bits = 0, .index_bits = 12, .tag_bits = 0}};
+        for (size_t i = 0; i < tagged; i++) {
+            configs.push_back({.size = 1024, .ghist_bits = 2 * (i + 1) * (i + 1), .index_bits = 9, .tag_bits = 12});
+        }
+        ValuePredictorParams params;
+        params.components = configs;
+        ValuePredictor generic(params);
+        ReplayStats generic_stats, kernel_stats;
+        double generic_ns = nsPerRecord(trace.size(), [&] { generic_stats = replayValueTrace(generic, trace); });
+
+        auto start = std::chrono::steady_clock::now();
+        auto kernel = cache.create(configs);
+        double build_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double kernel_ns = nsPerRecord(trace.size(), [&] { kernel_stats = kernel->replay(trace); });
+
+        std::cout << "  " << configs.size() << " components: generic " << generic_ns << " ns/record, "
+                  << (kernel->specialized() ? "specialized " : "fallback ") << kernel_ns << " ns/record"
+                  << (kernel_stats == generic_stats ? "" : "  (MISMATCH)") << ", build " << build_s << " s\n";
+    }
+    std::system(("rm -rf '" + options.cache_dir + "'").c_str());
+}
+
+struct NullTraceSink {
+    void onValue(PC, Value) {}
+    void onBranch(PC, bool) {}
+};
+
+void bench_rv64_emulator() {
+    // Accumulates into a 1024-entry array and, every fourth iteration, into
+    // a running sum: 11 or 12 instructions per iteration.
+    using namespace rv64asm;
+    const uint32_t iterations = 1 << 21;
+    std::vector<uint32_t> code = {
+        addi(5, 0, 0),            // t0 = i
+        addi(6, 0, 0),            // t1 = sum
+        lui(7, iterations >> 12), // t2 = iterations
+        lui(28, 0x20),            // t3 = array
+        andi(29, 5, 1023),        // loop: t4 = &array[i % 1024]
+        slli(29, 29, 3),
+        add(29, 29, 28),
+        ld(30, 29, 0),
+        add(30, 30, 5),
+        sd(30, 29, 0),
+        andi(31, 5, 3),
+        bne(31, 0, 8),
+        add(6, 6, 30),
+        addi(5, 5, 1),
+        blt(5, 7, -40),
+        addi(10, 0, 0),
+        addi(17, 0, 93),
+        ecall(),
+    };
+    auto machine = [&] {
+        Rv64Machine m;
+        m.loadProgram(code);
+        m.mapZeroed(0x20000, 8 * 1024);
+        return m;
+    };
+    std::cout << "RV64IM interpreter as a trace source\n";
+
+    auto mips = [](uint64_t instructions, double seconds) { return instructions / seconds / 1e6; };
+    auto timed = [](auto&& f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    Rv64Machine m = machine();
+    NullTraceSink null_sink;
+    double s = timed([&] { m.run(null_sink); });
+    std::cout << "  no sink:          " << mips(m.instructionsRetired(), s) << " MIPS ("
+              << m.instructionsRetired() << " instructions)\n";
+
+    m = machine();
+    ValueTraceRecorder recorder;
+    s = timed([&] { m.run(recorder); });
+    std::cout << "  recording:        " << mips(m.instructionsRetired(), s) << " MIPS, "
+              << recorder.trace.size() << " records\n";
+
+    m = machine();
+    ValuePredictor streamed({});
+    PredictorTraceSink<ValuePredictor> sink(streamed);
+    s = timed([&] { m.run(sink); });
+    std::cout << "  into predictor:   " << mips(m.instructionsRetired(), s) << " MIPS\n";
+
+    ValuePredictor replayed({});
+    ReplayStats stats;
+    double ns = nsPerRecord(recorder.trace.size(), [&] { stats = replayValueTrace(replayed, recorder.trace); });
+    std::cout << "  recorded replay:  " << ns << " ns/record"
+              << (stats == sink.replayStats() ? "" : "  (MISMATCH)") << "\n";
+}
+
+void bench_live_stats() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt");
+    std::string name = "/bench_vp_stats_" + std::to_string(getpid());
+    LiveStatsWriter live(name, "bench_live_stats", {{"value", 8}});
+    std::cout << "Live stats page, gcc-derived trace (" << trace.size() << " records)\n";
+
+    ValuePredictor plain({});
+    ReplayStats plain_stats, live_stats;
+    double plain_ns = nsPerRecord(trace.size(), [&] { plain_stats = replayValueTrace(plain, trace); });
+    ValuePredictor published({});
+    double live_ns = nsPerRecord(trace.size(), [&] { live_stats = replayValueTraceLive(published, trace, live, 0); });
+    std::cout << "  replay " << plain_ns << " ns/record, publishing every 4096 records " << live_ns
+              << " ns/record" << (plain_stats == live_stats ? "" : "  (MISMATCH)") << "\n";
+
+    // Per-record counters, as in test_accuracy_on_trace
+    const size_t n = 10000000;
+    double per_record_ns = nsPerRecord(n, [&] {
+        for (size_t i = 0; i < n; i++) {
+            live.addRecords();
+            live.recordPrediction(0, i % 7 != 0, i % 3 ? high : low);
+            live.recordProviderHit(0, i & 7);
+        }
+    });
+    std::cout << "  per-record addRecords + recordPrediction + recordProviderHit: " << per_record_ns << " ns\n";
+}
+
+void bench_sweep_checkpoints() {
+    std::string dir = "/tmp/bench_sweep_" + std::to_string(getpid());
+    SweepJob job{"trace_gcc.txt"};
+    std::cout << "Sweep queue checkpoints, gcc-derived trace\n";
+    for (uint64_t interval : {uint64_t(1) << 40, uint64_t(1) << 20, uint64_t(1) << 16}) {
+        std::filesystem::remove_all(dir);
+        SweepQueue queue(dir);
+        queue.submit(job);
+        SweepRunOptions options;
+        options.checkpoint_interval = interval;
+        SweepRunReport report;
+        double ns = nsPerRecord(1, [&] { report = queue.run(options); });
+        std::cout << "  checkpoint every " << std::setw(13) << interval << " records: " << report.checkpoints
+                  << " checkpoints, " << ns / report.records << " ns/record overall\n";
+    }
+    // Size of one checkpoint of the default predictor after the whole trace
+    std::filesystem::remove_all(dir);
+    SweepQueue queue(dir);
+    std::string id = queue.submit(job);
+    SweepRunOptions options;
+    options.record_budget = makeValueTraceFromBranches(job.trace_path).size() - 1;
+    queue.run(options);
+    std::cout << "  checkpoint size " << std::filesystem::file_size(dir + "/checkpoints/" + id + ".ckpt")
+              << " bytes\n";
+    std::filesystem::remove_all(dir);
+}
+
+int main() {
+    bench_interleaved_replay();
+    bench_mapped_lcvt();
+    bench_vtage();
+    bench_hybrid();
+    bench_banked_groups();
+    bench_hogwild_warmup();
+    bench_ablation();
+    bench_shm_ring();
+    bench_tail_latency();
+    bench_memory_footprint();
+    bench_lcvt_hierarchy();
+    bench_lcvt_admission();
+    bench_kernel_cache();
+    bench_rv64_emulator();
+    bench_live_stats();
+    bench_sweep_checkpoints();
+    return 0;
+}
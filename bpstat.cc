@@ -0,0 +1,66 @@
+#include "live_stats.h"
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+// Shows the live stats page of a running simulation, see live_stats.h.
+//
+//   bpstat PAGE [--interval SECONDS] [--count N] [--raw]
+//
+// Without --interval one snapshot is printed. With it, a snapshot is printed
+// every SECONDS (N times, or until the run finishes or dies) and throughput
+// is measured over each interval. --raw prints key=value lines for scraping
+// instead of the report.
+
+static void usage() {
+    std::cerr << "usage: bpstat PAGE [--interval SECONDS] [--count N] [--raw]\n";
+    std::exit(2);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2)
+        usage();
+    std::string name = argv[1];
+    double interval = 0;
+    uint64_t count = UINT64_MAX;
+    bool raw = false;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--interval" && i + 1 < argc) {
+            interval = std::stod(argv[++i]);
+        } else if (arg == "--count" && i + 1 < argc) {
+            count = std::stoull(argv[++i]);
+        } else if (arg == "--raw") {
+            raw = true;
+        } else {
+            usage();
+        }
+    }
+
+    try {
+        LiveStatsReader reader(name);
+        LiveStatsSnapshot prev = reader.snapshot();
+        if (interval <= 0)
+            count = 1;
+        for (uint64_t n = 0; n < count; n++) {
+            if (n > 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+            }
+            LiveStatsSnapshot s = reader.snapshot();
+            if (raw) {
+                printLiveStatsRaw(std::cout, s);
+            } else {
+                printLiveStats(std::cout, s, n > 0 ? &prev : nullptr);
+            }
+            std::cout << std::endl;
+            if (s.finished || !s.alive)
+                break;
+            prev = s;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "bpstat: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+#ifndef ENERGY_MODEL_HH
+#define ENERGY_MODEL_HH
+
+#include "vp.h"
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+// Per-access energy of an SRAM array, as produced by CACTI or a similar tool
+// for one array size.
+struct SramEnergyPoint {
+    size_t bytes;
+    double read_pj;
+    double write_pj;
+};
+
+// Energy costs for the activity counters. Arrays between two points are
+// interpolated on log2(bytes); outside the table the nearest point is used.
+struct EnergyModel {
+    std::vector<SramEnergyPoint> points;  // sorted by bytes
+    double tag_compare_pj_per_bit = 0.002;
+
+    SramEnergyPoint at(size_t bytes) const {
+        if (points.empty()) {
+            throw std::invalid_argument("energy model has no points");
+        }
+        if (bytes <= points.front().bytes)
+            return {bytes, points.front().read_pj, points.front().write_pj};
+        for (size_t i = 1; i < points.size(); i++) {
+            const SramEnergyPoint& lo = points[i - 1];
+            const SramEnergyPoint& hi = points[i];
+            if (bytes <= hi.bytes) {
+                double f = std::log2(double(bytes) / lo.bytes) / std::log2(double(hi.bytes) / lo.bytes);
+                return {bytes, lo.read_pj + f * (hi.read_pj - lo.read_pj),
+                        lo.write_pj + f * (hi.write_pj - lo.write_pj)};
+            }
+        }
+        return {bytes, points.back().read_pj, points.back().write_pj};
+    }
+};
+
+// Rough single-port SRAM figures for a recent process node. Replace them
+// with CACTI output for the technology being studied.
+inline EnergyModel defaultEnergyModel() {
+    EnergyModel model;
+    model.points = {
+        {256, 0.25, 0.30},
+        {1024, 0.45, 0.55},
+        {4096, 0.90, 1.10},
+        {16384, 1.90, 2.30},
+        {65536, 4.20, 5.00},
+        {262144, 9.00, 10.50},
+    };
+    return model;
+}
+
+// A table as seen by the energy model. Allocations are charged as writes.
+struct TableGeometry {
+    std::string name;
+    size_t bytes;
+    size_t tag_bits;
+};
+
+struct TableEnergy {
+    TableGeometry geometry;
+    TableActivity activity;
+    double read_pj = 0;
+    double write_pj = 0;
+    double compare_pj = 0;
+
+    double totalPj() const { return read_pj + write_pj + compare_pj; }
+};
+
+struct EnergyReport {
+    std::vector<TableEnergy> tables;
+
+    double totalPj() const {
+        double sum = 0;
+        for (const auto& t : tables)
+            sum += t.totalPj();
+        return sum;
+    }
+};
+
+inline void addTableEnergy(EnergyReport& report, const TableGeometry& geometry,
+                           const TableActivity& activity, const EnergyModel& model) {
+    SramEnergyPoint cost = model.at(geometry.bytes);
+    TableEnergy t{geometry, activity};
+    t.read_pj = activity.reads * cost.read_pj;
+    t.write_pj = (activity.writes + activity.allocations) * cost.write_pj;
+    t.compare_pj = activity.tag_compares * geometry.tag_bits * model.tag_compare_pj_per_bit;
+    report.tables.push_back(t);
+}
+
+// Each entry holds a tag and two 3-bit counters.
+inline std::vector<TableGeometry> equalityPredictorGeometry(const std::vector<ComponentConfig>& configs,
+                                                            const std::string& prefix = "ep") {
+    std::vector<TableGeometry> geometry;
+    for (size_t i = 0; i < configs.size(); i++) {
+        size_t bits = configs[i].size * (configs[i].tag_bits + 6);
+        geometry.push_back({prefix + std::to_string(i), (bits + 7) / 8, configs[i].tag_bits});
+    }
+    return geometry;
+}
+
+// An LCVT of `entries` entries, each a full value tagged with the PC bits
+// above the index.
+inline TableGeometry lcvtGeometry(size_t entries, size_t tag_bits = 32) {
+    return {"lcvt", entries * (sizeof(Value) * 8 + tag_bits) / 8, tag_bits};
+}
+
+inline EnergyReport estimateValuePredictorEnergy(const std::vector<ComponentConfig>& configs,
+                                                 const std::vector<TableActivity>& ep_activity,
+                                                 size_t lcvt_entries, const TableActivity& lcvt_activity,
+                                                 const EnergyModel& model = defaultEnergyModel()) {
+    EnergyReport report;
+    std::vector<TableGeometry> geometry = equalityPredictorGeometry(configs);
+    for (size_t i = 0; i < geometry.size() && i < ep_activity.size(); i++) {
+        addTableEnergy(report, geometry[i], ep_activity[i], model);
+    }
+    addTableEnergy(report, lcvtGeometry(lcvt_entries), lcvt_activity, model);
+    return report;
+}
+
+// Activity per kilo-instruction for each table, then energy per prediction
+// next to the predictor's MPKI.
+inline void printEnergyReport(std::ostream& os, const EnergyReport& report, uint64_t instructions,
+                              uint64_t predictions, double mpki) {
+    double kilo = instructions / 1000.0;
+    os << "  table    bytes   reads/ki  cmps/ki  writes/ki  allocs/ki   pJ/ki\n";
+    for (const auto& t : report.tables) {
+        os << "  " << std::left << std::setw(7) << t.geometry.name << std::right
+           << std::setw(7) << t.geometry.bytes
+           << std::setw(11) << t.activity.reads / kilo
+           << std::setw(9) << t.activity.tag_compares / kilo
+           << std::setw(11) << t.activity.writes / kilo
+           << std::setw(11) << t.activity.allocations / kilo
+           << std::setw(8) << t.totalPj() / kilo << "\n";
+    }
+    os << "  energy per prediction: " << (predictions ? report.totalPj() / predictions : 0.0)
+       << " pJ, MPKI: " << mpki << "\n";
+}
+
+#endif // ENERGY_MODEL_HH
@@ -0,0 +1,212 @@
+#ifndef HOGWILD_WARMUP_HH
+#define HOGWILD_WARMUP_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+// Approximate fast warmup of an EqualityPredictor used as a branch
+// predictor. The branch records of a trace are split into contiguous shards,
+// one per thread. Every thread keeps its own path history but updates one
+// shared table arena with relaxed atomic loads and stores and no locks
+// (Hogwild, Recht et al. 2011): concurrent updates to the same entry may be
+// lost, which only perturbs the counters. The arena is then copied into an
+// EqualityPredictor for exact serial measurement.
+class HogwildArena {
+public:
+    explicit HogwildArena(const std::vector<ComponentConfig>& configs)
+        : configs(configs)
+    {
+        for (const auto& config : configs) {
+            tables.emplace_back(new std::atomic<uint64_t>[config.size]);
+            for (size_t i = 0; i < config.size; i++) {
+                tables.back()[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Replays the branch records in [begin, end). Safe to call from several
+    // threads at once.
+    void warm(const ValueTraceRecord* begin, const ValueTraceRecord* end, uint64_t seed) {
+        Worker worker(*this, seed);
+        for (const ValueTraceRecord* rec = begin; rec != end; rec++) {
+            if (rec->kind == branch_record)
+                worker.step(rec->pc, rec->taken);
+        }
+    }
+
+    // Copies the tables into `ep`, which must have the same configuration.
+    void snapshotInto(EqualityPredictor& ep) const {
+        for (size_t c = 0; c < configs.size(); c++) {
+            for (size_t i = 0; i < configs[c].size; i++) {
+                ep.entryAt(c, i) = unpack(tables[c][i].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+private:
+    // An entry packed into one word: tag in bits 0-31, taken counter in
+    // 32-39, not-taken counter in 40-47.
+    static uint64_t pack(const EqualityPredictorEntry& e) {
+        return (e.tag & 0xffffffffull) | (uint64_t(e.taken_counter) << 32) | (uint64_t(e.not_taken_counter) << 40);
+    }
+    static EqualityPredictorEntry unpack(uint64_t word) {
+        EqualityPredictorEntry e(word & 0xffffffffull);
+        e.taken_counter = (word >> 32) & 0xff;
+        e.not_taken_counter = (word >> 40) & 0xff;
+        return e;
+    }
+
+    // Per-thread history and a local copy of the entries one branch touches.
+    class Worker {
+    public:
+        Worker(HogwildArena& arena, uint64_t seed) : arena(arena), rng_state(seed ? seed : 1) {
+            for (const auto& config : arena.configs) {
+                paths.emplace_back(config.ghist_bits, config.index_bits, config.tag_bits,
+                                   config.ahead, config.select_bits);
+            }
+            index.resize(paths.size());
+            tags.resize(paths.size());
+            loaded.resize(paths.size());
+            entries.resize(paths.size());
+            hit.reset(new bool[paths.size()]);
+        }
+
+        void step(PC pc, bool outcome) {
+            size_t n = paths.size();
+            for (size_t i = 0; i < n; i++) {
+                index[i] = paths[i].getIndex(pc);
+                tags[i] = paths[i].getTag(pc);
+                loaded[i] = arena.tables[i][index[i]].load(std::memory_order_relaxed);
+                entries[i] = unpack(loaded[i]);
+                hit[i] = (entries[i].tag == tags[i]);
+            }
+
+            EqualityLookup l = findEqualityProviders(entries.data(), hit.get(), n);
+            commitEqualityEntries(entries.data(), hit.get(), tags.data(), n, l, outcome,
+                                  [this] { return nextRandom(); });
+
+            for (size_t i = 0; i < n; i++) {
+                uint64_t word = pack(entries[i]);
+                if (word != loaded[i])
+                    arena.tables[i][index[i]].store(word, std::memory_order_relaxed);
+                paths[i].addBranch(outcome);
+            }
+        }
+
+    private:
+        uint64_t nextRandom() {
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 7;
+            rng_state ^= rng_state << 17;
+            return rng_state;
+        }
+
+        HogwildArena& arena;
+        uint64_t rng_state;
+        std::vector<PathTracker> paths;
+        std::vector<unsigned> index;
+        std::vector<unsigned> tags;
+        std::vector<uint64_t> loaded;
+        std::vector<EqualityPredictorEntry> entries;
+        std::unique_ptr<bool[]> hit;
+    };
+
+    std::vector<ComponentConfig> configs;
+    std::vector<std::unique_ptr<std::atomic<uint64_t>[]>> tables;
+};
+
+// Warms a freshly constructed `ep` on `warm` with `threads` threads; thread
+// t draws its allocation decays from seed + t, so one thread reproduces a
+// serial warmup of a predictor seeded with `seed`. Afterwards the last
+// branches of `warm` are replayed into the history only, so ep's path
+// history matches a serial warmup too.
+inline void hogwildWarmup(EqualityPredictor& ep, const std::vector<ValueTraceRecord>& warm, size_t threads,
+                          uint64_t seed = 1) {
+    if (threads == 0) {
+        throw std::invalid_argument("hogwild warmup needs at least one thread");
+    }
+    HogwildArena arena(ep.configs());
+    std::vector<std::thread> workers;
+    size_t shard = (warm.size() + threads - 1) / threads;
+    for (size_t t = 0; t < threads; t++) {
+        size_t begin = std::min(warm.size(), t * shard);
+        size_t end = std::min(warm.size(), begin + shard);
+        workers.emplace_back([&arena, &warm, begin, end, seed, t] {
+            arena.warm(warm.data() + begin, warm.data() + end, seed + t);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    arena.snapshotInto(ep);
+
+    size_t tail = 0;
+    size_t start = warm.size();
+    while (start > 0 && tail < MAX_HIST) {
+        start--;
+        tail += warm[start].kind == branch_record;
+    }
+    for (size_t i = start; i < warm.size(); i++) {
+        if (warm[i].kind == branch_record) {
+            ep.updateOnBranch(i, warm[i].taken);
+            ep.onBranchCommit(i);
+        }
+    }
+}
+
+struct HogwildReport {
+    size_t threads = 0;
+    double serial_seconds = 0;
+    double hogwild_seconds = 0;
+    double speedup = 0;
+    double serial_accuracy = 0;   // on the measured trace, after serial warmup
+    double hogwild_accuracy = 0;  // on the measured trace, after hogwild warmup
+    double drift = 0;             // hogwild_accuracy - serial_accuracy
+};
+
+// Warms one predictor serially and one with hogwildWarmup, then measures
+// both serially on `measure`.
+inline HogwildReport compareHogwildWarmup(const std::vector<ComponentConfig>& configs,
+                                          const std::vector<ValueTraceRecord>& warm,
+                                          const std::vector<ValueTraceRecord>& measure, size_t threads) {
+    using clock = std::chrono::steady_clock;
+    HogwildReport report;
+    report.threads = threads;
+
+    EqualityPredictor serial(configs);
+    auto t0 = clock::now();
+    for (size_t i = 0; i < warm.size(); i++) {
+        stepRecord(serial, warm[i], i);
+    }
+    auto t1 = clock::now();
+    EqualityPredictor hogwild(configs);
+    hogwildWarmup(hogwild, warm, threads);
+    auto t2 = clock::now();
+
+    report.serial_seconds = std::chrono::duration<double>(t1 - t0).count();
+    report.hogwild_seconds = std::chrono::duration<double>(t2 - t1).count();
+    report.speedup = report.hogwild_seconds > 0 ? report.serial_seconds / report.hogwild_seconds : 0;
+
+    auto accuracy = [&](EqualityPredictor& ep) {
+        uint64_t branches = 0, correct = 0;
+        for (size_t i = 0; i < measure.size(); i++) {
+            RecordPrediction pred = stepRecord(ep, measure[i], warm.size() + i);
+            if (!pred.valid)
+                continue;
+            branches++;
+            correct += (pred.value != 0) == measure[i].taken;
+        }
+        return branches ? double(correct) / branches : 0.0;
+    };
+    report.serial_accuracy = accuracy(serial);
+    report.hogwild_accuracy = accuracy(hogwild);
+    report.drift = report.hogwild_accuracy - report.serial_accuracy;
+    return report;
+}
+
+#endif // HOGWILD_WARMUP_HH
@@ -0,0 +1,203 @@
+#ifndef HYBRID_VP_HH
+#define HYBRID_VP_HH
+
+#include "vp.h"
+#include "vtage.h"
+#include <memory>
+#include <ostream>
+
+enum VpEngine { last_value_engine = 0, stride_engine = 1, context_engine = 2, NUM_VP_ENGINES = 3 };
+
+// Everything the PC-indexed engines know about one static instruction, so a
+// single hash lookup per record serves last value, stride and the chooser.
+struct HybridPcEntry {
+    Value last_value = 0;
+    int64_t stride = 0;
+    uint8_t stride_confidence = 0;
+    // Per engine, a saturating count of how often its value was right
+    uint8_t chooser[NUM_VP_ENGINES] = {0, 0, 0};
+
+    static constexpr uint8_t MAX_STRIDE_CONFIDENCE = 7;
+    static constexpr uint8_t MAX_CHOOSER = 3;
+
+    Confidence strideConfidence() const {
+        if (stride_confidence >= MAX_STRIDE_CONFIDENCE)
+            return Confidence::high;
+        if (stride_confidence >= MAX_STRIDE_CONFIDENCE / 2)
+            return Confidence::medium;
+        return Confidence::low;
+    }
+};
+
+struct HybridValuePredictorParams {
+    bool use_context_engine = false;  // add a VTagePredictor as a third engine
+};
+
+struct HybridPrediction {
+    Confidence confidence;
+    Value value;
+    VpEngine engine;
+};
+
+// Chooses per PC between last value (confidence from the EqualityPredictor),
+// stride, and optionally VTAGE. Each engine predicts; among the engines that
+// are at least medium confident, the one with the highest chooser count wins
+// (ties go to the lower-numbered engine).
+class HybridValuePredictor {
+public:
+    HybridValuePredictor(const HybridValuePredictorParams& params = {})
+        : ep(defaultValuePredictorConfig())
+        , vtage(params.use_context_engine ? std::make_unique<VTagePredictor>() : nullptr)
+    {}
+
+    // Deleted copy/move operations to prevent accidental copies
+    HybridValuePredictor(const HybridValuePredictor&) = delete;
+    HybridValuePredictor& operator=(const HybridValuePredictor&) = delete;
+
+    HybridPrediction predictWithEngine(PC pc) {
+        auto it = table.find(pc);
+        if (it == table.end()) {
+            return {Confidence::low, 0, last_value_engine};
+        }
+
+        EnginePredictions preds = enginePredictions(pc, it->second);
+        HybridPrediction best{Confidence::low, it->second.last_value, last_value_engine};
+        int best_score = -1;
+        for (int e = 0; e < NUM_VP_ENGINES; e++) {
+            if (!preds.valid[e] || preds.confidence[e] == Confidence::low)
+                continue;
+            if (it->second.chooser[e] > best_score) {
+                best_score = it->second.chooser[e];
+                best = {preds.confidence[e], preds.value[e], VpEngine(e)};
+            }
+        }
+        return best;
+    }
+
+    std::pair<Confidence, Value> predict(PC pc) {
+        HybridPrediction pred = predictWithEngine(pc);
+        return {pred.confidence, pred.value};
+    }
+
+    void updateOnBranch(InstSeqNum seqNum, bool taken) {
+        ep.updateOnBranch(seqNum, taken);
+        if (vtage)
+            vtage->updateOnBranch(seqNum, taken);
+    }
+
+    void onValueCommit(PC pc, Value val) {
+        auto [it, inserted] = table.try_emplace(pc);
+        HybridPcEntry& entry = it->second;
+
+        if (inserted) {
+            ep.onValueCommit(pc, false);
+            entry.last_value = val;
+        } else {
+            EnginePredictions preds = enginePredictions(pc, entry);
+            for (int e = 0; e < NUM_VP_ENGINES; e++) {
+                if (!preds.valid[e])
+                    continue;
+                if (preds.value[e] == val) {
+                    if (entry.chooser[e] < HybridPcEntry::MAX_CHOOSER)
+                        entry.chooser[e]++;
+                } else if (entry.chooser[e] > 0) {
+                    entry.chooser[e]--;
+                }
+            }
+
+            ep.onValueCommit(pc, val == entry.last_value);
+
+            int64_t stride = int64_t(val - entry.last_value);
+            if (stride == entry.stride) {
+                if (entry.stride_confidence < HybridPcEntry::MAX_STRIDE_CONFIDENCE)
+                    entry.stride_confidence++;
+            } else {
+                entry.stride = stride;
+                entry.stride_confidence = 0;
+            }
+            entry.last_value = val;
+        }
+
+        if (vtage)
+            vtage->onValueCommit(pc, val);
+    }
+
+    bool isOldestBranch(InstSeqNum seqNum) const {
+        return ep.isOldestBranch(seqNum);
+    }
+
+    void onBranchCommit(InstSeqNum seqNum) {
+        ep.onBranchCommit(seqNum);
+        if (vtage)
+            vtage->onBranchCommit(seqNum);
+    }
+
+    void squash(InstSeqNum seqNum) {
+        ep.squash(seqNum);
+        if (vtage)
+            vtage->squash(seqNum);
+    }
+
+    void seed(uint64_t s) {
+        ep.seed(s);
+    }
+
+    uint64_t stateHash() const {
+        uint64_t h = 0;
+        for (const auto& [pc, e] : table) {
+            uint64_t eh = mixHash(pc, e.last_value);
+            eh = mixHash(eh, uint64_t(e.stride));
+            eh = mixHash(eh, e.stride_confidence | (e.chooser[0] << 8) | (e.chooser[1] << 16) | (e.chooser[2] << 24));
+            h += eh;
+        }
+        h = mixHash(h, ep.stateHash());
+        return vtage ? mixHash(h, vtage->stateHash()) : h;
+    }
+
+    void dumpState(std::ostream& os) const {
+        ep.dumpState(os);
+        std::map<PC, HybridPcEntry> sorted(table.begin(), table.end());
+        os << "pc table entries=" << sorted.size() << "\n";
+        for (const auto& [pc, e] : sorted) {
+            os << "  " << std::hex << pc << " last=" << e.last_value << std::dec << " stride=" << e.stride
+               << " sc=" << int(e.stride_confidence) << " chooser=" << int(e.chooser[0]) << ","
+               << int(e.chooser[1]) << "," << int(e.chooser[2]) << "\n";
+        }
+        if (vtage)
+            vtage->dumpState(os);
+    }
+
+private:
+    struct EnginePredictions {
+        bool valid[NUM_VP_ENGINES];
+        Confidence confidence[NUM_VP_ENGINES];
+        Value value[NUM_VP_ENGINES];
+    };
+
+    EnginePredictions enginePredictions(PC pc, const HybridPcEntry& entry) {
+        EnginePredictions preds{};
+
+        auto [ep_conf, equal] = ep.predict(pc);
+        preds.valid[last_value_engine] = true;
+        preds.confidence[last_value_engine] = equal ? ep_conf : Confidence::low;
+        preds.value[last_value_engine] = entry.last_value;
+
+        preds.valid[stride_engine] = true;
+        preds.confidence[stride_engine] = entry.strideConfidence();
+        preds.value[stride_engine] = entry.last_value + entry.stride;
+
+        if (vtage) {
+            auto [vt_conf, vt_value] = vtage->predict(pc);
+            preds.valid[context_engine] = true;
+            preds.confidence[context_engine] = vt_conf;
+            preds.value[context_engine] = vt_value;
+        }
+        return preds;
+    }
+
+    std::unordered_map<PC, HybridPcEntry> table;
+    EqualityPredictor ep;
+    std::unique_ptr<VTagePredictor> vtage;
+};
+
+#endif // HYBRID_VP_HH
@@ -0,0 +1,92 @@
+#ifndef IPC_MODEL_HH
+#define IPC_MODEL_HH
+
+#include "vp.h"
+#include "vp_replay.h"
+#include <algorithm>
+#include <ostream>
+
+// Analytic latency model for value prediction. Without a prediction, the
+// first consumer of a value waits load_latency cycles after the producer
+// issues, minus the dependency_distance cycles it would have needed to reach
+// issue anyway. A correct prediction removes that wait; a wrong one that is
+// used costs a pipeline flush.
+struct LatencyModelParams {
+    double load_latency = 4.0;
+    double flush_penalty = 20.0;
+    double dependency_distance = 1.0;
+    double base_cpi = 1.0;  // cycles per instruction of the unpredicted baseline
+};
+
+struct IpcEstimate {
+    // Indexed by threshold: predictions with confidence >= threshold are used.
+    double cycles_saved[3] = {0, 0, 0};
+    double cycles_lost[3] = {0, 0, 0};
+    double net_gain[3] = {0, 0, 0};
+
+    // use_predictions is false when no threshold has a positive net gain.
+    bool use_predictions = false;
+    Confidence best_threshold = Confidence::high;
+    double best_net_gain = 0;
+    double speedup = 1.0;  // baseline cycles / cycles at best_threshold
+    // False when the net gain is not below the baseline cycles, i.e. the
+    // latency model does not fit the run; speedup is then left at 1.0.
+    bool valid = true;
+};
+
+// Converts per-confidence correct/incorrect counts into estimated cycles
+// saved or lost, over a run of `instructions` instructions. Records with no
+// prediction (stats.unpredicted_*) are left out: nothing is used for them.
+inline IpcEstimate estimateIpcImpact(const ReplayStats& stats, uint64_t instructions,
+                                     const LatencyModelParams& params = {}) {
+    IpcEstimate est;
+    double saved_per_hit = std::max(0.0, params.load_latency - params.dependency_distance);
+
+    for (int t = Confidence::low; t <= Confidence::high; t++) {
+        for (int c = t; c <= Confidence::high; c++) {
+            uint64_t correct = stats.correct[c] - (c == Confidence::low ? stats.unpredicted_correct : 0);
+            uint64_t incorrect = stats.incorrect[c] - (c == Confidence::low ? stats.unpredicted_incorrect : 0);
+            est.cycles_saved[t] += correct * saved_per_hit;
+            est.cycles_lost[t] += incorrect * params.flush_penalty;
+        }
+        est.net_gain[t] = est.cycles_saved[t] - est.cycles_lost[t];
+    }
+
+    // On a tie the stricter threshold wins: same gain, fewer flushes at risk
+    for (int t = Confidence::high; t >= Confidence::low; t--) {
+        if (est.net_gain[t] > est.best_net_gain) {
+            est.use_predictions = true;
+            est.best_threshold = Confidence(t);
+            est.best_net_gain = est.net_gain[t];
+        }
+    }
+
+    double base_cycles = instructions * params.base_cpi;
+    if (base_cycles > est.best_net_gain) {
+        est.speedup = base_cycles / (base_cycles - est.best_net_gain);
+    } else {
+        est.valid = false;
+    }
+    return est;
+}
+
+inline void printIpcEstimate(std::ostream& os, const IpcEstimate& est, uint64_t instructions) {
+    static const char* names[] = {"low", "medium", "high"};
+    double kilo = instructions / 1000.0;
+    for (int t = Confidence::low; t <= Confidence::high; t++) {
+        os << "  threshold " << names[t] << ": saved " << est.cycles_saved[t] / kilo
+           << ", lost " << est.cycles_lost[t] / kilo
+           << ", net " << est.net_gain[t] / kilo << " cycles/kinst\n";
+    }
+    if (!est.valid) {
+        os << "  best threshold: " << names[est.best_threshold]
+           << ", no speedup estimate: the net gain exceeds the baseline cycles\n";
+    } else if (est.use_predictions) {
+        os << "  best threshold: " << names[est.best_threshold]
+           << ", estimated speedup: " << est.speedup << "\n";
+    } else {
+        os << "  best threshold: none (every threshold loses cycles)\n";
+    }
+}
+
+#endif // IPC_MODEL_HH
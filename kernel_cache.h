@@ -0,0 +1,313 @@
+#ifndef KERNEL_CACHE_HH
+#define KERNEL_CACHE_HH
+
+#include "vp.h"
+#include "vp_kernel.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Builds value predictor kernels specialized to a ComponentConfig vector at
+// run time: a translation unit instantiating SpecializedValuePredictor for
+// the geometry is written to the cache directory, compiled into a shared
+// object and loaded with dlopen. Objects are named by a hash of everything
+// that goes into them (the generated source, the contents of every header it
+// includes, the compiler's version and the command line), so editing the
+// predictor code or changing the toolchain builds a new object instead of
+// loading a stale one; objects are reused across runs otherwise. When the
+// geometry cannot be specialized, or no compiler is available, create()
+// returns the generic ValuePredictor.
+//
+// Loading a shared object runs its code, so the cache directory and every
+// object in it must belong to the current user and must not be group- or
+// world-writable; anything else is refused.
+struct KernelCacheOptions {
+    // Empty = $XDG_CACHE_HOME/bvp_kernels, else ~/.cache/bvp_kernels.
+    std::string cache_dir;
+    std::string compiler = std::getenv("CXX") ? std::getenv("CXX") : "c++";
+    std::string flags = "-O2 -std=c++20 -fPIC -shared";
+    // Directory holding vp_kernel.h; empty = the directory of this header.
+    std::string include_dir;
+};
+
+struct KernelCacheStats {
+    uint64_t compiled = 0;     // shared objects built by this cache
+    uint64_t loaded = 0;       // shared objects loaded (built or found)
+    uint64_t generic = 0;      // fallbacks to the generic engine
+};
+
+// Kernels returned by create() run code from the loaded shared objects, so
+// they must be destroyed before the cache.
+class KernelCache {
+public:
+    explicit KernelCache(const KernelCacheOptions& options = KernelCacheOptions()) : options(options) {
+        if (this->options.include_dir.empty()) {
+            std::string here = __FILE__;
+            size_t slash = here.rfind('/');
+            this->options.include_dir = (slash == std::string::npos) ? "." : here.substr(0, slash);
+        }
+        char* resolved = realpath(this->options.include_dir.c_str(), nullptr);
+        if (resolved) {
+            this->options.include_dir = resolved;
+            free(resolved);
+        }
+        if (this->options.cache_dir.empty()) {
+            this->options.cache_dir = defaultCacheDir();
+        }
+    }
+
+    static std::string defaultCacheDir() {
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        if (xdg && xdg[0] == '/')
+            return std::string(xdg) + "/bvp_kernels";
+        const char* home = std::getenv("HOME");
+        if (home && home[0] == '/')
+            return std::string(home) + "/.cache/bvp_kernels";
+        return "";
+    }
+
+    ~KernelCache() {
+        for (auto& [hash, handle] : handles) {
+            dlclose(handle);
+        }
+    }
+
+    KernelCache(const KernelCache&) = delete;
+    KernelCache& operator=(const KernelCache&) = delete;
+
+    static bool specializable(const std::vector<ComponentConfig>& configs) {
+        if (configs.empty() || configs.size() > 64 || configs[0].tag_bits != 0)
+            return false;
+        for (const auto& c : configs) {
+            if (c.ahead != 0 || c.select_bits != 0 || c.index_bits + c.tag_bits > 31
+                || c.ghist_bits > MAX_HIST || (size_t(1) << c.index_bits) > c.size)
+                return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<ValueKernel> create(const std::vector<ComponentConfig>& configs) {
+        using Factory = ValueKernel* (*)();
+        last_error.clear();
+        void* handle = nullptr;
+        if (!specializable(configs)) {
+            last_error = "the geometry cannot be specialized";
+        } else {
+            handle = load(configs);
+        }
+        if (handle) {
+            auto factory = reinterpret_cast<Factory>(dlsym(handle, "vp_kernel_create"));
+            if (factory)
+                return std::unique_ptr<ValueKernel>(factory());
+            last_error = "kernel object has no vp_kernel_create";
+        }
+        stats.generic++;
+        ValuePredictorParams params;
+        params.components = configs;
+        return std::make_unique<GenericValueKernel>(params);
+    }
+
+    // Why the last create() fell back to the generic engine; empty if it
+    // did not.
+    const std::string& lastError() const { return last_error; }
+    const KernelCacheStats& cacheStats() const { return stats; }
+
+    static std::string generateSource(const std::vector<ComponentConfig>& configs) {
+        std::ostringstream src;
+        src << "// Generated by KernelCache for config hash " << std::hex << componentConfigHash(configs)
+            << std::dec << "\n#include \"vp_kernel.h\"\n\nnamespace {\nstruct Geometry {\n"
+            << "    static constexpr ComponentConfig configs[] = {\n";
+        for (const auto& c : configs) {
+            src << "        {" << c.size << ", " << c.ghist_bits << ", " << c.index_bits << ", "
+                << c.tag_bits << ", 0, 0},\n";
+        }
+        src << "    };\n};\n}\n\n"
+            << "extern \"C\" uint64_t vp_kernel_abi() { return VP_KERNEL_ABI; }\n"
+            << "extern \"C\" ValueKernel* vp_kernel_create() {\n"
+            << "    return new ValueKernelAdapter<SpecializedValuePredictor<Geometry>, true>();\n}\n";
+        return src.str();
+    }
+
+private:
+    // Loads the shared object for configs, building it first if the cache
+    // has none. Returns nullptr (and sets last_error) on failure.
+    void* load(const std::vector<ComponentConfig>& configs) {
+        uint64_t hash = kernelKey(configs);
+        auto it = handles.find(hash);
+        if (it != handles.end())
+            return it->second;
+
+        if (!prepareCacheDir())
+            return nullptr;
+        std::ostringstream name;
+        name << options.cache_dir << "/vp_kernel_" << std::hex << hash;
+        std::string so_path = name.str() + ".so";
+        if (access(so_path.c_str(), F_OK) != 0 && !build(configs, name.str())) {
+            return nullptr;
+        }
+        if (!trusted(so_path, S_IFREG))
+            return nullptr;
+        void* handle = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            last_error = dlerror();
+            return nullptr;
+        }
+        auto abi = reinterpret_cast<uint64_t (*)()>(dlsym(handle, "vp_kernel_abi"));
+        if (!abi || abi() != VP_KERNEL_ABI) {
+            last_error = so_path + " was built for another kernel ABI";
+            dlclose(handle);
+            return nullptr;
+        }
+        stats.loaded++;
+        handles[hash] = handle;
+        return handle;
+    }
+
+    // Compiles into a temporary name and renames, so concurrent sweeps
+    // never load a half-written object.
+    bool build(const std::vector<ComponentConfig>& configs, const std::string& base) {
+        std::string tmp = base + "." + std::to_string(getpid());
+        {
+            std::ofstream out(tmp + ".cc");
+            out << generateSource(configs);
+            if (!out.flush()) {
+                last_error = "cannot write " + tmp + ".cc";
+                return false;
+            }
+        }
+        std::string command = compileCommand() + " -o '" + tmp + ".so' '" + tmp + ".cc' 2>'" + tmp + ".log'";
+        int status = std::system(command.c_str());
+        // Independent of the umask, so the object passes trusted()
+        bool ok = (status == 0) && chmod((tmp + ".so").c_str(), 0644) == 0 && std::rename((tmp + ".so").c_str(), (base + ".so").c_str()) == 0;
+        if (ok) {
+            stats.compiled++;
+            std::rename((tmp + ".cc").c_str(), (base + ".cc").c_str());
+            unlink((tmp + ".log").c_str());
+        } else {
+            last_error = "compiling " + tmp + ".cc failed, see " + tmp + ".log";
+            unlink((tmp + ".so").c_str());
+        }
+        return ok;
+    }
+
+    std::string compileCommand() const {
+        return options.compiler + " " + options.flags + " -I'" + options.include_dir + "'";
+    }
+
+    static uint64_t hashBytes(uint64_t h, const std::string& bytes) {
+        h = mixHash(h, bytes.size());
+        for (size_t i = 0; i < bytes.size(); i += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes.data() + i, std::min<size_t>(8, bytes.size() - i));
+            h = mixHash(h, word);
+        }
+        return h;
+    }
+
+    // Cache key of the object for configs. The toolchain part (headers,
+    // compiler version, command line) is computed once per cache.
+    uint64_t kernelKey(const std::vector<ComponentConfig>& configs) {
+        if (!toolchain_hash) {
+            uint64_t h = mixHash(VP_KERNEL_ABI, 0);
+            h = hashBytes(h, compileCommand());
+            h = hashBytes(h, compilerVersion());
+            for (const auto& [file, contents] : includedHeaders("vp_kernel.h")) {
+                h = hashBytes(hashBytes(h, file), contents);
+            }
+            toolchain_hash = h ? h : 1;
+        }
+        return hashBytes(toolchain_hash, generateSource(configs));
+    }
+
+    std::string compilerVersion() const {
+        std::string out;
+        FILE* pipe = popen((options.compiler + " --version 2>&1").c_str(), "r");
+        if (!pipe)
+            return out;
+        char buf[256];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0) {
+            out.append(buf, n);
+        }
+        pclose(pipe);
+        return out;
+    }
+
+    // Contents of root and of every header it includes with #include "...",
+    // transitively, from the include directory, by file name.
+    std::map<std::string, std::string> includedHeaders(const std::string& root) const {
+        std::map<std::string, std::string> headers;
+        std::vector<std::string> pending = {root};
+        while (!pending.empty()) {
+            std::string file = pending.back();
+            pending.pop_back();
+            if (headers.count(file))
+                continue;
+            std::ifstream in(options.include_dir + "/" + file, std::ios::binary);
+            std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            headers[file] = contents;
+            std::istringstream lines(contents);
+            std::string line;
+            while (std::getline(lines, line)) {
+                size_t open = line.find("#include \"");
+                if (open == std::string::npos)
+                    continue;
+                size_t start = open + 10;
+                size_t close = line.find('"', start);
+                if (close != std::string::npos)
+                    pending.push_back(line.substr(start, close - start));
+            }
+        }
+        return headers;
+    }
+
+    // Creates the cache directory (mode 0700) if needed and checks it.
+    bool prepareCacheDir() {
+        if (options.cache_dir.empty()) {
+            last_error = "no cache directory: set XDG_CACHE_HOME or HOME, or KernelCacheOptions::cache_dir";
+            return false;
+        }
+        size_t slash = options.cache_dir.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            std::error_code ec;
+            std::filesystem::create_directories(options.cache_dir.substr(0, slash), ec);
+        }
+        if (mkdir(options.cache_dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            last_error = "cannot create " + options.cache_dir + ": " + std::strerror(errno);
+            return false;
+        }
+        return trusted(options.cache_dir, S_IFDIR);
+    }
+
+    // path must be of the given type (not a symlink), owned by this user and
+    // not writable by group or others.
+    bool trusted(const std::string& path, mode_t type) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+            last_error = "cannot stat " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        if ((st.st_mode & S_IFMT) != type || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+            last_error = "refusing " + path + ": not owned by this user, of the wrong type, or writable by others";
+            return false;
+        }
+        return true;
+    }
+
+    KernelCacheOptions options;
+    std::map<uint64_t, void*> handles;
+    KernelCacheStats stats;
+    std::string last_error;
+    uint64_t toolchain_hash = 0;
+};
+
+#endif // KERNEL_CACHE_HH
@@ -0,0 +1,110 @@
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamp for per-call latency measurements: the TSC on x86, nanoseconds
+// elsewhere.
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline const char* cyclesUnit() {
+#if defined(__x86_64__) || defined(__i386__)
+    return "TSC cycles";
+#else
+    return "ns";
+#endif
+}
+
+// Log-linear histogram in the style of HdrHistogram: values below 2^SUB_BITS
+// are counted exactly, larger ones in 2^SUB_BITS sub-buckets per power of
+// two, so any recorded value is reported within 1/2^SUB_BITS (about 3%).
+// Recording is a couple of shifts and an increment.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+
+    LatencyHistogram() : counts((64 - SUB_BITS + 1) * SUB_BUCKETS, 0) {}
+
+    void record(uint64_t v) {
+        counts[bucketOf(v)]++;
+        total++;
+        max_value = std::max(max_value, v);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+
+    // Smallest value v such that at least fraction p of the recorded values
+    // are <= v, rounded up to the end of its bucket (but never above max()).
+    uint64_t percentile(double p) const {
+        if (total == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(p * total + 0.999999));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(bucketHigh(i), max_value);
+        }
+        return max_value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < SUB_BUCKETS)
+            return v;
+        unsigned shift = (63 - __builtin_clzll(v)) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((v >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t bucketHigh(size_t index) {
+        if (index < SUB_BUCKETS)
+            return index;
+        unsigned shift = index / SUB_BUCKETS - 1;
+        uint64_t sub = SUB_BUCKETS + index % SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+};
+
+inline void printLatencyHeader(std::ostream& os) {
+    os << "  operation               calls       p50       p99     p99.9         max\n";
+}
+
+inline void printLatencyRow(std::ostream& os, const char* name, const LatencyHistogram& h) {
+    os << "  " << std::left << std::setw(20) << name << std::right
+       << std::setw(9) << h.count()
+       << std::setw(10) << h.percentile(0.50)
+       << std::setw(10) << h.percentile(0.99)
+       << std::setw(10) << h.percentile(0.999)
+       << std::setw(12) << h.max() << "\n";
+}
+
+#endif // LATENCY_HISTOGRAM_HH
@@ -0,0 +1,149 @@
+#ifndef LCVT_ADMISSION_HH
+#define LCVT_ADMISSION_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <ostream>
+#include <string>
+
+// Admission filter in front of an LCVT backend. A pc gets a table entry only
+// after it has committed the same value threshold + 1 times in a row; until
+// then its last value is tracked in a small direct-mapped sketch as a
+// fingerprint of (pc, value) plus a repeat counter. Streaming pcs whose
+// values never repeat stay out of the table. Sketch slots are shared by
+// aliasing pcs, so a fingerprint match can occasionally be spurious.
+struct AdmissionFilterConfig {
+    size_t sketch_entries = 1 << 12;   // power of two
+    unsigned threshold = 1;            // repeats needed before admission, at most 255
+};
+
+struct AdmissionStats {
+    uint64_t admitted = 0;   // pcs given a table entry
+    uint64_t filtered = 0;   // commits of non-resident pcs kept out of the table
+};
+
+template <class Table = LastCommittedValueTable>
+class AdmissionFilteredTable {
+public:
+    template <class... TableArgs>
+    explicit AdmissionFilteredTable(const AdmissionFilterConfig& config, TableArgs&&... table_args)
+        : config(config), table(std::forward<TableArgs>(table_args)...), sketch(config.sketch_entries)
+    {
+        if (config.sketch_entries == 0 || (config.sketch_entries & (config.sketch_entries - 1)) != 0) {
+            throw std::invalid_argument("sketch_entries must be a power of two");
+        }
+        if (config.threshold > 255) {
+            throw std::invalid_argument("admission threshold must be at most 255");
+        }
+    }
+
+    bool hasValue(PC pc) const { return table.hasValue(pc); }
+    Value lookup(PC pc) const { return table.lookup(pc); }
+    void prefetch(PC pc) const { table.prefetch(pc); }
+
+    void update(PC pc, Value val) {
+        if (table.hasValue(pc)) {
+            table.update(pc, val);
+            return;
+        }
+        uint64_t h = mixHash(pc, val);
+        SketchEntry& e = sketch[(pc >> 2) & (sketch.size() - 1)];
+        uint16_t fingerprint = uint16_t(h >> 48);
+        if (e.fingerprint == fingerprint) {
+            e.repeats += (e.repeats < 255);
+        } else {
+            e.fingerprint = fingerprint;
+            e.repeats = 0;
+        }
+        if (e.repeats >= config.threshold) {
+            table.update(pc, val);
+            e = SketchEntry();
+            stats.admitted++;
+        } else {
+            stats.filtered++;
+        }
+    }
+
+    size_t size() const { return table.size(); }
+
+    // Covers the table only; the sketch is a heuristic and not part of the
+    // LCVT contents.
+    uint64_t stateHash() const { return table.stateHash(); }
+    void dumpState(std::ostream& os) const { table.dumpState(os); }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        table.accountMemory(fp, prefix);
+        fp.add(prefix + "admission_sketch", sketch.capacity() * sizeof(SketchEntry));
+    }
+
+    const AdmissionStats& admissionStats() const { return stats; }
+    Table& backend() { return table; }
+    const Table& backend() const { return table; }
+
+private:
+    struct SketchEntry {
+        uint16_t fingerprint = 0;
+        uint8_t repeats = 0;
+    };
+
+    AdmissionFilterConfig config;
+    Table table;
+    std::vector<SketchEntry> sketch;
+    AdmissionStats stats;
+};
+
+template <class Table>
+Value lcvtPredictLookup(AdmissionFilteredTable<Table>& table, PC pc) {
+    return lcvtPredictLookup(table.backend(), pc);
+}
+
+// Memory and coverage of a filtered LCVT against an unfiltered one over the
+// same trace. Coverage is the fraction of value records predicted with high
+// confidence, accuracy the fraction of those that were right.
+struct AdmissionReport {
+    size_t bytes[2] = {0, 0};        // unfiltered, filtered
+    size_t entries[2] = {0, 0};
+    ReplayStats replay[2];
+    AdmissionStats stats;
+
+    double coverage(int i) const {
+        return replay[i].values ? double(replay[i].correct[high] + replay[i].incorrect[high]) / replay[i].values : 0.0;
+    }
+    double accuracy(int i) const {
+        uint64_t predicted = replay[i].correct[high] + replay[i].incorrect[high];
+        return predicted ? double(replay[i].correct[high]) / predicted : 0.0;
+    }
+};
+
+inline AdmissionReport compareAdmission(const std::vector<ValueTraceRecord>& trace,
+                                        const AdmissionFilterConfig& config = AdmissionFilterConfig()) {
+    AdmissionReport r;
+    MemoryFootprint fp[2];
+    {
+        ValuePredictor vp({});
+        r.replay[0] = replayValueTrace(vp, trace);
+        r.entries[0] = vp.lcvtSize();
+        vp.lcvtTable().accountMemory(fp[0], "lcvt.");
+    }
+    BasicValuePredictor<AdmissionFilteredTable<>> vp({}, config);
+    r.replay[1] = replayValueTrace(vp, trace);
+    r.entries[1] = vp.lcvtSize();
+    vp.lcvtTable().accountMemory(fp[1], "lcvt.");
+    r.stats = vp.lcvtTable().admissionStats();
+    r.bytes[0] = fp[0].total();
+    r.bytes[1] = fp[1].total();
+    return r;
+}
+
+inline void printAdmissionReport(std::ostream& os, const AdmissionReport& r) {
+    const char* names[2] = {"unfiltered", "filtered  "};
+    for (int i = 0; i < 2; i++) {
+        os << "  " << names[i] << "  entries " << r.entries[i] << ", " << r.bytes[i] << " bytes, coverage "
+           << r.coverage(i) << ", accuracy " << r.accuracy(i) << "\n";
+    }
+    os << "  memory saved " << (r.bytes[0] ? 1.0 - double(r.bytes[1]) / r.bytes[0] : 0.0)
+       << ", admitted " << r.stats.admitted << ", filtered commits " << r.stats.filtered << "\n";
+}
+
+#endif // LCVT_ADMISSION_HH
@@ -0,0 +1,321 @@
+#ifndef LCVT_HIERARCHY_HH
+#define LCVT_HIERARCHY_HH
+
+#include "vp.h"
+#include "lcvt_sizing.h"
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+// Bounded two-level LCVT: a small first level next to the predictor backed by
+// a larger, slower second level. Both are set-associative with LRU
+// replacement and stored in flat arrays. Entries that fall out of the second
+// level are lost, so hasValue can turn false for a pc that was committed.
+struct LcvtLevelConfig {
+    size_t sets;
+    size_t ways;
+    unsigned latency;   // cycles until a prediction read from this level is available
+};
+
+enum LcvtHierarchyPolicy : uint8_t {
+    // Commits write both levels; a second-level eviction also drops the pc
+    // from the first level.
+    lcvt_inclusive = 0,
+    // A pc lives in one level. Commits and promotions move it to the first
+    // level, whose victims are demoted to the second.
+    lcvt_exclusive = 1,
+};
+
+struct TwoLevelLcvtConfig {
+    LcvtLevelConfig l1{64, 4, 1};
+    LcvtLevelConfig l2{4096, 8, 3};
+    LcvtHierarchyPolicy policy = lcvt_exclusive;
+    // Whether a prediction served by the second level moves the pc to the
+    // first, or only commits do.
+    bool promote_on_predict = true;
+};
+
+struct LcvtHierarchyStats {
+    uint64_t delivered[2] = {0, 0};   // predictions served by each level
+    uint64_t promotions = 0;
+    uint64_t demotions = 0;
+    uint64_t evictions = 0;           // pcs dropped from the hierarchy
+
+    uint64_t predictions() const { return delivered[0] + delivered[1]; }
+    double fraction(int level) const {
+        return predictions() ? double(delivered[level]) / predictions() : 0.0;
+    }
+    // Mean latency of the delivered predictions under config.
+    double meanLatency(const TwoLevelLcvtConfig& config) const {
+        if (!predictions())
+            return 0.0;
+        return (double(delivered[0]) * config.l1.latency + double(delivered[1]) * config.l2.latency)
+               / predictions();
+    }
+};
+
+class TwoLevelLastCommittedValueTable {
+public:
+    explicit TwoLevelLastCommittedValueTable(const TwoLevelLcvtConfig& config = TwoLevelLcvtConfig())
+        : config(config), levels{Level(config.l1), Level(config.l2)} {}
+
+    bool hasValue(PC pc) const {
+        return locate(pc).level >= 0;
+    }
+
+    // Reads without touching replacement state or statistics.
+    Value lookup(PC pc) const {
+        Location loc = locate(pc);
+        return loc.level >= 0 ? levels[loc.level].value(loc.slot) : 0;
+    }
+
+    // The read behind a delivered prediction: counts the level that served
+    // it, updates LRU and applies promote_on_predict.
+    Value predictLookup(PC pc) {
+        Location loc = locate(pc);
+        if (loc.level < 0)
+            return 0;
+        stats.delivered[loc.level]++;
+        Value val = levels[loc.level].value(loc.slot);
+        levels[loc.level].touch(loc.slot, ++clock);
+        if (loc.level == 1 && config.promote_on_predict) {
+            promote(pc, val, loc.slot);
+        }
+        return val;
+    }
+
+    void update(PC pc, Value val) {
+        Location loc = locate(pc);
+        if (loc.level == 0) {
+            levels[0].value(loc.slot) = val;
+            levels[0].touch(loc.slot, ++clock);
+            if (config.policy == lcvt_inclusive)
+                writeSecondLevel(pc, val);
+            return;
+        }
+        if (config.policy == lcvt_inclusive) {
+            writeSecondLevel(pc, val);
+        } else if (loc.level == 1) {
+            levels[1].invalidate(loc.slot);
+            stats.promotions++;
+        }
+        fillFirstLevel(pc, val);
+    }
+
+    void prefetch(PC pc) const {
+        __builtin_prefetch(&levels[0].words[levels[0].setBase(pc)]);
+        __builtin_prefetch(&levels[1].words[levels[1].setBase(pc)]);
+    }
+
+    size_t size() const {
+        size_t n = levels[1].occupied;
+        if (config.policy == lcvt_exclusive)
+            n += levels[0].occupied;
+        return n;
+    }
+
+    // Same scheme as LastCommittedValueTable::stateHash.
+    uint64_t stateHash() const {
+        uint64_t h = 0;
+        forEachEntry([&](PC pc, Value val) { h += mixHash(pc, val); });
+        return mixHash(h, size());
+    }
+
+    void dumpState(std::ostream& os) const {
+        std::map<PC, Value> sorted;
+        forEachEntry([&](PC pc, Value val) { sorted[pc] = val; });
+        os << "lcvt entries=" << sorted.size() << "\n";
+        for (const auto& [pc, val] : sorted) {
+            os << "  " << std::hex << pc << " " << val << std::dec << "\n";
+        }
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        for (int i = 0; i < 2; i++) {
+            fp.add(prefix + "l" + std::to_string(i + 1), levels[i].words.capacity() * sizeof(uint64_t));
+        }
+    }
+
+    const LcvtHierarchyStats& hierarchyStats() const { return stats; }
+    const TwoLevelLcvtConfig& hierarchyConfig() const { return config; }
+
+private:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    struct Location {
+        int level;      // -1 = not present
+        size_t slot;
+    };
+
+    // One block of 3 * ways words per set: the keys (pc + 1, 0 = empty), then
+    // the values, then the LRU stamps, so a lookup touches adjacent lines.
+    // A slot is the index of its key word.
+    struct Level {
+        explicit Level(const LcvtLevelConfig& c) : sets(c.sets), ways(c.ways), words(3 * c.sets * c.ways, 0)
+        {
+            if (sets == 0 || (sets & (sets - 1)) != 0 || ways == 0) {
+                throw std::invalid_argument("LCVT levels need a power-of-two set count and at least one way");
+            }
+        }
+
+        uint64_t& key(size_t slot) { return words[slot]; }
+        uint64_t key(size_t slot) const { return words[slot]; }
+        Value& value(size_t slot) { return words[slot + ways]; }
+        Value value(size_t slot) const { return words[slot + ways]; }
+        uint64_t stamp(size_t slot) const { return words[slot + 2 * ways]; }
+
+        size_t setBase(PC pc) const {
+            return lcvtSetIndex(pc, sets) * 3 * ways;
+        }
+        size_t find(PC pc) const {
+            size_t base = setBase(pc);
+            for (size_t w = 0; w < ways; w++) {
+                if (words[base + w] == pc + 1)
+                    return base + w;
+            }
+            return NONE;
+        }
+        // An empty way if there is one, else the least recently used.
+        size_t victim(PC pc) const {
+            size_t base = setBase(pc);
+            size_t best = base;
+            for (size_t w = 0; w < ways; w++) {
+                if (key(base + w) == 0)
+                    return base + w;
+                if (stamp(base + w) < stamp(best))
+                    best = base + w;
+            }
+            return best;
+        }
+        void touch(size_t slot, uint64_t now) {
+            words[slot + 2 * ways] = now;
+        }
+        void fill(size_t slot, PC pc, Value val, uint64_t now) {
+            ++generation;
+            occupied += (key(slot) == 0);
+            key(slot) = pc + 1;
+            value(slot) = val;
+            touch(slot, now);
+        }
+        void invalidate(size_t slot) {
+            ++generation;
+            occupied -= (key(slot) != 0);
+            key(slot) = 0;
+        }
+        template <class F>
+        void forEach(F&& f) const {
+            for (size_t base = 0; base < words.size(); base += 3 * ways) {
+                for (size_t w = 0; w < ways; w++) {
+                    if (key(base + w) != 0)
+                        f(key(base + w) - 1, value(base + w));
+                }
+            }
+        }
+
+        size_t sets;
+        size_t ways;
+        std::vector<uint64_t> words;
+        size_t occupied = 0;
+        uint64_t generation = 0;    // bumped whenever a key changes
+    };
+
+    // The predictor probes a pc several times in a row (hasValue, then the
+    // read, then the commit's update), so the last location is remembered
+    // until either level changes a key.
+    Location locate(PC pc) const {
+        uint64_t generation = levels[0].generation + levels[1].generation;
+        if (memo_pc == pc && memo_generation == generation)
+            return memo;
+        Location loc{-1, 0};
+        for (int i = 0; i < 2 && loc.level < 0; i++) {
+            size_t slot = levels[i].find(pc);
+            if (slot != NONE)
+                loc = {i, slot};
+        }
+        memo_pc = pc;
+        memo_generation = generation;
+        memo = loc;
+        return loc;
+    }
+
+    // Moves (exclusive) or copies (inclusive) a second-level entry up.
+    void promote(PC pc, Value val, size_t lower_slot) {
+        stats.promotions++;
+        if (config.policy == lcvt_exclusive) {
+            levels[1].invalidate(lower_slot);
+        }
+        fillFirstLevel(pc, val);
+    }
+
+    void fillFirstLevel(PC pc, Value val) {
+        Level& l1 = levels[0];
+        size_t slot = l1.victim(pc);
+        if (l1.key(slot) != 0 && config.policy == lcvt_exclusive) {
+            stats.demotions++;
+            demote(l1.key(slot) - 1, l1.value(slot));
+        }
+        l1.fill(slot, pc, val, ++clock);
+    }
+
+    void writeSecondLevel(PC pc, Value val) {
+        Level& l2 = levels[1];
+        size_t slot = l2.find(pc);
+        if (slot == NONE) {
+            slot = l2.victim(pc);
+            if (l2.key(slot) != 0) {
+                stats.evictions++;
+                if (config.policy == lcvt_inclusive) {
+                    size_t upper = levels[0].find(l2.key(slot) - 1);
+                    if (upper != NONE)
+                        levels[0].invalidate(upper);
+                }
+            }
+        }
+        l2.fill(slot, pc, val, ++clock);
+    }
+
+    // Exclusive only: the pc is known not to be in the second level.
+    void demote(PC pc, Value val) {
+        Level& l2 = levels[1];
+        size_t slot = l2.victim(pc);
+        stats.evictions += (l2.key(slot) != 0);
+        l2.fill(slot, pc, val, ++clock);
+    }
+
+    // Each pc once; under inclusion the second level holds them all.
+    template <class F>
+    void forEachEntry(F&& f) const {
+        for (int i = (config.policy == lcvt_inclusive) ? 1 : 0; i < 2; i++) {
+            levels[i].forEach(f);
+        }
+    }
+
+    TwoLevelLcvtConfig config;
+    Level levels[2];
+    uint64_t clock = 0;
+    LcvtHierarchyStats stats;
+    mutable PC memo_pc = 0;
+    mutable uint64_t memo_generation = UINT64_MAX;
+    mutable Location memo{-1, 0};
+};
+
+// Delivered predictions go through predictLookup, see BasicValuePredictor.
+inline Value lcvtPredictLookup(TwoLevelLastCommittedValueTable& table, PC pc) {
+    return table.predictLookup(pc);
+}
+
+inline void printLcvtHierarchyStats(std::ostream& os, const LcvtHierarchyStats& stats,
+                                    const TwoLevelLcvtConfig& config) {
+    const LcvtLevelConfig* levels[2] = {&config.l1, &config.l2};
+    os << "  level  entries  latency  predictions  fraction\n";
+    for (int i = 0; i < 2; i++) {
+        os << "  l" << (i + 1) << std::setw(12) << levels[i]->sets * levels[i]->ways
+           << std::setw(9) << levels[i]->latency << std::setw(13) << stats.delivered[i]
+           << std::setw(10) << std::fixed << std::setprecision(4) << stats.fraction(i)
+           << std::defaultfloat << "\n";
+    }
+    os << "  mean latency " << stats.meanLatency(config) << ", promotions " << stats.promotions
+       << ", demotions " << stats.demotions << ", evictions " << stats.evictions << "\n";
+}
+
+#endif // LCVT_HIERARCHY_HH
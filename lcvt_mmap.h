@@ -0,0 +1,306 @@
+#ifndef LCVT_MMAP_HH
+#define LCVT_MMAP_HH
+
+#include "vp.h"
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Out-of-core LCVT backend: a linear-probing hash table kept in a
+// memory-mapped file, so cold buckets are paged by the OS and the footprint
+// is bounded by disk rather than RAM. A small direct-mapped cache of recently
+// used PCs is kept in RAM; it is write-through, so the file is always
+// current. Reopening an existing file resumes with its contents.
+class MappedLastCommittedValueTable {
+public:
+    MappedLastCommittedValueTable(const std::string& path, size_t initial_buckets = 1 << 16,
+                                  size_t hot_entries = 1 << 12)
+        : path(path)
+        , hot(hot_entries)
+    {
+        if (initial_buckets == 0 || (initial_buckets & (initial_buckets - 1)) != 0) {
+            throw std::invalid_argument("initial_buckets must be a power of two");
+        }
+        if ((hot_entries & (hot_entries - 1)) != 0) {
+            throw std::invalid_argument("hot_entries must be a power of two (or 0)");
+        }
+        open(path, initial_buckets);
+    }
+
+    ~MappedLastCommittedValueTable() {
+        unmap();
+    }
+
+    MappedLastCommittedValueTable(const MappedLastCommittedValueTable&) = delete;
+    MappedLastCommittedValueTable& operator=(const MappedLastCommittedValueTable&) = delete;
+
+    bool hasValue(PC pc) const {
+        if (hotHit(pc))
+            return true;
+        if (pc == TOP_PC)
+            return header->top_present;
+        return find(pc) != nullptr;
+    }
+
+    Value lookup(PC pc) const {
+        if (const HotEntry* h = hotHit(pc))
+            return h->value;
+        if (pc == TOP_PC) {
+            if (!header->top_present)
+                return 0;
+            hotInstall(pc, header->top_value);
+            return header->top_value;
+        }
+        const Bucket* b = find(pc);
+        if (!b)
+            return 0;
+        hotInstall(pc, b->value);
+        return b->value;
+    }
+
+    void update(PC pc, Value val) {
+        if (pc == TOP_PC) {
+            if (!header->top_present) {
+                header->top_present = 1;
+                header->occupied++;
+            }
+            header->top_value = val;
+            hotInstall(pc, val);
+            return;
+        }
+        if ((header->occupied + 1) * 10 > header->bucket_count * 7) {
+            grow();
+        }
+        Bucket* b = probe(buckets, header->bucket_count, pc);
+        if (b->key == 0) {
+            b->key = pc + 1;
+            header->occupied++;
+        }
+        b->value = val;
+        hotInstall(pc, val);
+    }
+
+    void prefetch(PC pc) const {
+        if (hotHit(pc) || pc == TOP_PC)
+            return;
+        __builtin_prefetch(&buckets[home(pc, header->bucket_count)]);
+    }
+
+    size_t size() const { return header->occupied; }
+    size_t bucketCount() const { return header->bucket_count; }
+
+    // Same scheme as LastCommittedValueTable::stateHash, so the two backends
+    // can be compared directly.
+    uint64_t stateHash() const {
+        uint64_t h = 0;
+        for (size_t i = 0; i < header->bucket_count; i++) {
+            if (buckets[i].key != 0)
+                h += mixHash(buckets[i].key - 1, buckets[i].value);
+        }
+        if (header->top_present)
+            h += mixHash(TOP_PC, header->top_value);
+        return mixHash(h, header->occupied);
+    }
+
+    void dumpState(std::ostream& os) const {
+        std::map<PC, Value> sorted;
+        for (size_t i = 0; i < header->bucket_count; i++) {
+            if (buckets[i].key != 0)
+                sorted[buckets[i].key - 1] = buckets[i].value;
+        }
+        if (header->top_present)
+            sorted[TOP_PC] = header->top_value;
+        os << "lcvt entries=" << sorted.size() << "\n";
+        for (const auto& [pc, val] : sorted) {
+            os << "  " << std::hex << pc << " " << val << std::dec << "\n";
+        }
+    }
+
+    // The mapping is file-backed; only touched pages become resident.
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        fp.add(prefix + "mapping", mapping_bytes);
+        fp.add(prefix + "hot", hot.capacity() * sizeof(HotEntry));
+    }
+
+    // Forces the mapped pages to disk.
+    void flush() {
+        if (msync(mapping, mapping_bytes, MS_SYNC) != 0) {
+            throw std::runtime_error("msync " + path + ": " + std::strerror(errno));
+        }
+    }
+
+private:
+    static constexpr uint64_t MAGIC = 0x5456434c50564d4dull; // "MMVPLCVT"
+    static constexpr uint64_t VERSION = 2;
+    // The pc whose pc + 1 would wrap to the empty key; kept in the header
+    static constexpr PC TOP_PC = ~PC(0);
+
+    struct Header {
+        uint64_t magic;
+        uint64_t version;
+        uint64_t bucket_count;
+        uint64_t occupied;          // including TOP_PC
+        uint64_t top_present;
+        Value top_value;
+    };
+
+    // key is pc + 1 so that zero-filled file pages read as empty buckets;
+    // TOP_PC never goes in a bucket
+    struct Bucket {
+        uint64_t key;
+        Value value;
+    };
+
+    struct HotEntry {
+        PC pc = 0;
+        Value value = 0;
+        bool valid = false;
+    };
+
+    static size_t bytesFor(size_t bucket_count) {
+        return sizeof(Header) + bucket_count * sizeof(Bucket);
+    }
+
+    static size_t home(PC pc, size_t bucket_count) {
+        return (pc * 0x9e3779b97f4a7c15ull) >> 17 & (bucket_count - 1);
+    }
+
+    static Bucket* probe(Bucket* table, size_t bucket_count, PC pc) {
+        size_t i = home(pc, bucket_count);
+        while (table[i].key != 0 && table[i].key != pc + 1) {
+            i = (i + 1) & (bucket_count - 1);
+        }
+        return &table[i];
+    }
+
+    const Bucket* find(PC pc) const {
+        const Bucket* b = probe(buckets, header->bucket_count, pc);
+        return (b->key != 0) ? b : nullptr;
+    }
+
+    size_t hotIndex(PC pc) const {
+        return (pc >> 2) & (hot.size() - 1);
+    }
+
+    const HotEntry* hotHit(PC pc) const {
+        if (hot.empty())
+            return nullptr;
+        const HotEntry& h = hot[hotIndex(pc)];
+        return (h.valid && h.pc == pc) ? &h : nullptr;
+    }
+
+    void hotInstall(PC pc, Value val) const {
+        if (hot.empty())
+            return;
+        hot[hotIndex(pc)] = {pc, val, true};
+    }
+
+    // Maps path, creating it with bucket_count empty buckets if it is empty.
+    void mapFile(const std::string& file, size_t bucket_count, int& out_fd, void*& out_mapping,
+                 size_t& out_bytes) {
+        out_fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+        if (out_fd < 0) {
+            throw std::runtime_error("open " + file + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (fstat(out_fd, &st) != 0) {
+            ::close(out_fd);
+            throw std::runtime_error("fstat " + file + ": " + std::strerror(errno));
+        }
+
+        bool fresh = (st.st_size == 0);
+        if (fresh) {
+            out_bytes = bytesFor(bucket_count);
+            if (ftruncate(out_fd, out_bytes) != 0) {
+                ::close(out_fd);
+                throw std::runtime_error("ftruncate " + file + ": " + std::strerror(errno));
+            }
+        } else {
+            out_bytes = st.st_size;
+        }
+
+        out_mapping = mmap(nullptr, out_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+        if (out_mapping == MAP_FAILED) {
+            ::close(out_fd);
+            throw std::runtime_error("mmap " + file + ": " + std::strerror(errno));
+        }
+
+        Header* h = static_cast<Header*>(out_mapping);
+        if (fresh) {
+            *h = {MAGIC, VERSION, bucket_count, 0, 0, 0};
+        } else if (h->magic != MAGIC || h->version != VERSION
+                   || out_bytes != bytesFor(h->bucket_count)) {
+            munmap(out_mapping, out_bytes);
+            ::close(out_fd);
+            throw std::runtime_error(file + " is not a mapped LCVT file");
+        }
+    }
+
+    void open(const std::string& file, size_t bucket_count) {
+        mapFile(file, bucket_count, fd, mapping, mapping_bytes);
+        header = static_cast<Header*>(mapping);
+        buckets = reinterpret_cast<Bucket*>(header + 1);
+    }
+
+    void unmap() {
+        if (mapping) {
+            munmap(mapping, mapping_bytes);
+            ::close(fd);
+            mapping = nullptr;
+        }
+    }
+
+    // Rehashes into a table twice the size, built next to the current file
+    // and renamed over it once complete.
+    void grow() {
+        size_t new_count = header->bucket_count * 2;
+        std::string tmp_path = path + ".grow";
+        ::unlink(tmp_path.c_str());
+
+        int new_fd;
+        void* new_mapping;
+        size_t new_bytes;
+        mapFile(tmp_path, new_count, new_fd, new_mapping, new_bytes);
+
+        Header* new_header = static_cast<Header*>(new_mapping);
+        Bucket* new_buckets = reinterpret_cast<Bucket*>(new_header + 1);
+        for (size_t i = 0; i < header->bucket_count; i++) {
+            if (buckets[i].key != 0) {
+                *probe(new_buckets, new_count, buckets[i].key - 1) = buckets[i];
+            }
+        }
+        new_header->occupied = header->occupied;
+        new_header->top_present = header->top_present;
+        new_header->top_value = header->top_value;
+
+        // The old mapping stays in use until the new file has replaced it
+        if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            int err = errno;
+            munmap(new_mapping, new_bytes);
+            ::close(new_fd);
+            ::unlink(tmp_path.c_str());
+            throw std::runtime_error("rename " + tmp_path + ": " + std::strerror(err));
+        }
+        unmap();
+        fd = new_fd;
+        mapping = new_mapping;
+        mapping_bytes = new_bytes;
+        header = new_header;
+        buckets = new_buckets;
+    }
+
+    std::string path;
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapping_bytes = 0;
+    Header* header = nullptr;
+    Bucket* buckets = nullptr;
+    mutable std::vector<HotEntry> hot;
+};
+
+#endif // LCVT_MMAP_HH
@@ -0,0 +1,120 @@
+#ifndef LCVT_SIZING_HH
+#define LCVT_SIZING_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+// Set index used for bounded, set-associative LCVT geometries.
+inline size_t lcvtSetIndex(PC pc, size_t sets) {
+    return ((pc >> 2) ^ (pc >> 14)) & (sets - 1);
+}
+
+// Hit-rate curves of a bounded LRU LCVT for many geometries at once.
+// hits[g][d] counts value commits whose per-set LRU stack distance is d
+// under geometry g (set_counts[g] sets), so a table with w ways hits on the
+// sum over d < w. equal_hits restricts that to commits whose value equals
+// the pc's last committed value, i.e. where an LCVT entry that is still
+// present holds the right value.
+struct LcvtSizingCurve {
+    std::vector<size_t> set_counts;
+    size_t max_ways = 0;
+    uint64_t accesses = 0;
+    uint64_t equal_accesses = 0;
+    std::vector<std::vector<uint64_t>> hits;
+    std::vector<std::vector<uint64_t>> equal_hits;
+
+    uint64_t hitsWithin(const std::vector<uint64_t>& distances, size_t ways) const {
+        uint64_t sum = 0;
+        for (size_t d = 0; d < ways && d < distances.size(); d++) {
+            sum += distances[d];
+        }
+        return sum;
+    }
+    double hitRate(size_t geometry, size_t ways) const {
+        return accesses ? double(hitsWithin(hits[geometry], ways)) / accesses : 0.0;
+    }
+    // Fraction of equal-value commits for which the value is still in the table.
+    double presentWhenEqualRate(size_t geometry, size_t ways) const {
+        return equal_accesses ? double(hitsWithin(equal_hits[geometry], ways)) / equal_accesses : 0.0;
+    }
+};
+
+// One pass over the trace computing per-set LRU stack distances
+// (Mattson et al.) for every set count in set_counts and associativities up
+// to max_ways. By LRU inclusion, truncating each stack to max_ways keeps the
+// distances below max_ways exact.
+inline LcvtSizingCurve analyzeLcvtSizing(const std::vector<ValueTraceRecord>& trace,
+                                         const std::vector<size_t>& set_counts, size_t max_ways) {
+    if (max_ways == 0 || max_ways > 255) {
+        throw std::invalid_argument("max_ways must be in [1, 255]");
+    }
+    for (size_t sets : set_counts) {
+        if (sets == 0 || (sets & (sets - 1)) != 0) {
+            throw std::invalid_argument("set counts must be powers of two");
+        }
+    }
+
+    LcvtSizingCurve curve;
+    curve.set_counts = set_counts;
+    curve.max_ways = max_ways;
+    curve.hits.assign(set_counts.size(), std::vector<uint64_t>(max_ways, 0));
+    curve.equal_hits.assign(set_counts.size(), std::vector<uint64_t>(max_ways, 0));
+
+    // Per geometry, each set's LRU stack is max_ways consecutive PCs, MRU first
+    std::vector<std::vector<PC>> stacks;
+    std::vector<std::vector<uint8_t>> fill;
+    for (size_t sets : set_counts) {
+        stacks.emplace_back(sets * max_ways);
+        fill.emplace_back(sets, 0);
+    }
+    LastCommittedValueTable last_values;
+
+    for (const auto& rec : trace) {
+        if (rec.kind != value_record)
+            continue;
+
+        bool equal = last_values.hasValue(rec.pc) && last_values.lookup(rec.pc) == rec.value;
+        last_values.update(rec.pc, rec.value);
+        curve.accesses++;
+        curve.equal_accesses += equal;
+
+        for (size_t g = 0; g < set_counts.size(); g++) {
+            size_t set = lcvtSetIndex(rec.pc, set_counts[g]);
+            PC* stack = &stacks[g][set * max_ways];
+            size_t depth = std::find(stack, stack + fill[g][set], rec.pc) - stack;
+
+            if (depth < fill[g][set]) {
+                curve.hits[g][depth]++;
+                if (equal)
+                    curve.equal_hits[g][depth]++;
+            } else if (fill[g][set] < max_ways) {
+                fill[g][set]++;
+            } else {
+                depth = max_ways - 1;  // evict the LRU entry
+            }
+            std::move_backward(stack, stack + depth, stack + depth + 1);
+            stack[0] = rec.pc;
+        }
+    }
+    return curve;
+}
+
+inline void printLcvtSizing(std::ostream& os, const LcvtSizingCurve& curve) {
+    os << "  entries   sets  ways  hit rate  present when equal\n";
+    for (size_t g = 0; g < curve.set_counts.size(); g++) {
+        for (size_t ways = 1; ways <= curve.max_ways; ways *= 2) {
+            os << "  " << std::setw(7) << curve.set_counts[g] * ways
+               << std::setw(7) << curve.set_counts[g]
+               << std::setw(6) << ways
+               << std::setw(10) << curve.hitRate(g, ways)
+               << std::setw(20) << curve.presentWhenEqualRate(g, ways) << "\n";
+        }
+    }
+    os << "  value commits: " << curve.accesses << ", equal to last committed value: "
+       << curve.equal_accesses << "\n";
+}
+
+#endif // LCVT_SIZING_HH
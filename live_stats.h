@@ -0,0 +1,336 @@
+#ifndef LIVE_STATS_HH
+#define LIVE_STATS_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include "shm_object.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <ostream>
+#include <signal.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Live counters of a running simulation in a POSIX shared memory page, read
+// by bpstat (bpstat.cc) or anything else that maps it. The run is the only
+// writer: counters are bumped with relaxed loads and stores, never locked
+// read-modify-writes, so publishing costs a few plain memory accesses.
+// Readers see each counter atomically but not a consistent set of them.
+//
+// The layout is fixed-size and versioned; bump LIVE_STATS_VERSION whenever
+// LiveStatsLayout changes.
+constexpr uint32_t LIVE_STATS_VERSION = 1;
+constexpr size_t LIVE_STATS_MAX_PREDICTORS = 8;
+constexpr size_t LIVE_STATS_MAX_COMPONENTS = 64;
+
+struct LivePredictorCounters {
+    char name[32];
+    uint32_t components;
+    std::atomic<uint64_t> correct;
+    std::atomic<uint64_t> wrong;
+    std::atomic<uint64_t> high_correct;     // high-confidence predictions only
+    std::atomic<uint64_t> high_wrong;
+    std::atomic<uint64_t> component_hits[LIVE_STATS_MAX_COMPONENTS];  // predictions provided by each component
+};
+
+struct LiveStatsLayout {
+    uint64_t magic;                 // written last by the creator
+    uint32_t version;
+    uint32_t layout_bytes;          // sizeof(LiveStatsLayout)
+    int32_t pid;
+    uint32_t predictors;
+    uint64_t start_ns;              // unix time
+    char label[64];
+    std::atomic<uint64_t> records;
+    std::atomic<uint64_t> updated_ns;   // unix time of the last heartbeat
+    std::atomic<uint32_t> finished;
+    alignas(64) LivePredictorCounters predictor[LIVE_STATS_MAX_PREDICTORS];
+};
+
+inline uint64_t liveStatsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct LivePredictorInfo {
+    std::string name;
+    size_t components = 0;      // 0 = no per-component hits
+};
+
+// Creates the page and removes it on destruction. The page is claimed with
+// OwnedShm (shm_object.h): an existing page of the same name is replaced
+// only if no running writer holds it, which makes the constructor throw.
+class LiveStatsWriter {
+public:
+    // Heartbeats (updated_ns) are taken every this many records.
+    static constexpr uint64_t HEARTBEAT_RECORDS = 1 << 16;
+
+    LiveStatsWriter(const std::string& name, const std::string& label,
+                    const std::vector<LivePredictorInfo>& predictors) : name(name)
+    {
+        if (predictors.size() > LIVE_STATS_MAX_PREDICTORS) {
+            throw std::invalid_argument("too many predictors for the stats page");
+        }
+        object = OwnedShm(name, 0644);
+        int fd = object.descriptor();
+        if (ftruncate(fd, sizeof(LiveStatsLayout)) != 0) {
+            throw std::runtime_error("ftruncate " + name + ": " + std::strerror(errno));
+        }
+        void* mapping = mmap(nullptr, sizeof(LiveStatsLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+        }
+        // The object is zero-filled, which is a valid state for every counter
+        page = static_cast<LiveStatsLayout*>(mapping);
+        page->version = LIVE_STATS_VERSION;
+        page->layout_bytes = sizeof(LiveStatsLayout);
+        page->pid = getpid();
+        page->predictors = predictors.size();
+        page->start_ns = liveStatsNow();
+        page->updated_ns.store(page->start_ns, std::memory_order_relaxed);
+        std::strncpy(page->label, label.c_str(), sizeof(page->label) - 1);
+        for (size_t p = 0; p < predictors.size(); p++) {
+            LivePredictorCounters& c = page->predictor[p];
+            std::strncpy(c.name, predictors[p].name.c_str(), sizeof(c.name) - 1);
+            c.components = std::min(predictors[p].components, LIVE_STATS_MAX_COMPONENTS);
+        }
+        // Published last, so a reader never sees a half-initialised page
+        std::atomic_thread_fence(std::memory_order_release);
+        page->magic = MAGIC;
+    }
+
+    // The name is unlinked by ~OwnedShm, only while it refers to this page.
+    ~LiveStatsWriter() {
+        if (page)
+            munmap(page, sizeof(LiveStatsLayout));
+    }
+
+    LiveStatsWriter(const LiveStatsWriter&) = delete;
+    LiveStatsWriter& operator=(const LiveStatsWriter&) = delete;
+
+    void addRecords(uint64_t n = 1) {
+        uint64_t records = page->records.load(std::memory_order_relaxed) + n;
+        page->records.store(records, std::memory_order_relaxed);
+        if (records >= next_heartbeat) {
+            page->updated_ns.store(liveStatsNow(), std::memory_order_relaxed);
+            next_heartbeat = records + HEARTBEAT_RECORDS;
+        }
+    }
+
+    // For predictors without a confidence, such as TAGE.
+    void recordPrediction(size_t p, bool correct) {
+        LivePredictorCounters& c = page->predictor[p];
+        bump(correct ? c.correct : c.wrong);
+    }
+
+    void recordPrediction(size_t p, bool correct, Confidence conf) {
+        recordPrediction(p, correct);
+        if (conf == high) {
+            LivePredictorCounters& c = page->predictor[p];
+            bump(correct ? c.high_correct : c.high_wrong);
+        }
+    }
+
+    void recordProviderHit(size_t p, size_t component) {
+        if (component < page->predictor[p].components)
+            bump(page->predictor[p].component_hits[component]);
+    }
+
+    // Replaces predictor p's counters with stats, for runs that keep a
+    // ReplayStats themselves and publish it periodically.
+    void publish(size_t p, const ReplayStats& stats) {
+        LivePredictorCounters& c = page->predictor[p];
+        uint64_t correct = stats.correct[low] + stats.correct[medium] + stats.correct[high];
+        uint64_t wrong = stats.incorrect[low] + stats.incorrect[medium] + stats.incorrect[high];
+        c.correct.store(correct, std::memory_order_relaxed);
+        c.wrong.store(wrong, std::memory_order_relaxed);
+        c.high_correct.store(stats.correct[high], std::memory_order_relaxed);
+        c.high_wrong.store(stats.incorrect[high], std::memory_order_relaxed);
+    }
+
+    void finish() {
+        page->updated_ns.store(liveStatsNow(), std::memory_order_relaxed);
+        page->finished.store(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint64_t MAGIC = 0x5354415453505642ull; // "BVPSTATS"
+    friend class LiveStatsReader;
+
+    static void bump(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::string name;
+    OwnedShm object;
+    LiveStatsLayout* page = nullptr;
+    uint64_t next_heartbeat = 0;
+};
+
+// A copy of the page at one moment.
+struct LiveStatsSnapshot {
+    struct Predictor {
+        std::string name;
+        uint64_t correct = 0;
+        uint64_t wrong = 0;
+        uint64_t high_correct = 0;
+        uint64_t high_wrong = 0;
+        std::vector<uint64_t> component_hits;
+
+        double accuracy() const {
+            return correct + wrong ? double(correct) / (correct + wrong) : 0.0;
+        }
+    };
+
+    std::string label;
+    int pid = 0;
+    uint64_t start_ns = 0;
+    uint64_t updated_ns = 0;
+    uint64_t taken_ns = 0;          // when this snapshot was read
+    uint64_t records = 0;
+    bool finished = false;
+    bool alive = false;             // the writer process still exists
+    std::vector<Predictor> predictors;
+};
+
+// Maps a page read-only.
+class LiveStatsReader {
+public:
+    explicit LiveStatsReader(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        }
+        struct {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t layout_bytes;
+        } header;
+        if (::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || header.magic != LiveStatsWriter::MAGIC) {
+            ::close(fd);
+            throw std::runtime_error(name + " is not a stats page");
+        }
+        if (header.version != LIVE_STATS_VERSION || header.layout_bytes != sizeof(LiveStatsLayout)) {
+            ::close(fd);
+            throw std::runtime_error(name + " has stats layout version " + std::to_string(header.version)
+                                     + ", expected " + std::to_string(LIVE_STATS_VERSION));
+        }
+        void* mapping = mmap(nullptr, sizeof(LiveStatsLayout), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+        }
+        page = static_cast<const LiveStatsLayout*>(mapping);
+    }
+
+    ~LiveStatsReader() {
+        munmap(const_cast<LiveStatsLayout*>(page), sizeof(LiveStatsLayout));
+    }
+
+    LiveStatsReader(const LiveStatsReader&) = delete;
+    LiveStatsReader& operator=(const LiveStatsReader&) = delete;
+
+    LiveStatsSnapshot snapshot() const {
+        LiveStatsSnapshot s;
+        s.label = std::string(page->label, strnlen(page->label, sizeof(page->label)));
+        s.pid = page->pid;
+        s.start_ns = page->start_ns;
+        s.finished = page->finished.load(std::memory_order_acquire);
+        s.updated_ns = page->updated_ns.load(std::memory_order_relaxed);
+        s.records = page->records.load(std::memory_order_relaxed);
+        s.taken_ns = liveStatsNow();
+        s.alive = kill(s.pid, 0) == 0 || errno == EPERM;
+        for (size_t p = 0; p < std::min<size_t>(page->predictors, LIVE_STATS_MAX_PREDICTORS); p++) {
+            const LivePredictorCounters& c = page->predictor[p];
+            LiveStatsSnapshot::Predictor out;
+            out.name = std::string(c.name, strnlen(c.name, sizeof(c.name)));
+            out.correct = c.correct.load(std::memory_order_relaxed);
+            out.wrong = c.wrong.load(std::memory_order_relaxed);
+            out.high_correct = c.high_correct.load(std::memory_order_relaxed);
+            out.high_wrong = c.high_wrong.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < std::min<size_t>(c.components, LIVE_STATS_MAX_COMPONENTS); i++) {
+                out.component_hits.push_back(c.component_hits[i].load(std::memory_order_relaxed));
+            }
+            s.predictors.push_back(out);
+        }
+        return s;
+    }
+
+private:
+    const LiveStatsLayout* page = nullptr;
+};
+
+// Replays a trace while publishing progress every `interval` records.
+template <class Predictor>
+ReplayStats replayValueTraceLive(Predictor& vp, const std::vector<ValueTraceRecord>& trace,
+                                 LiveStatsWriter& live, size_t slot, size_t interval = 4096) {
+    ReplayStats stats;
+    size_t published = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        replayRecord(vp, trace[i], i, stats, nullptr);
+        if (i + 1 - published == interval) {
+            live.addRecords(interval);
+            live.publish(slot, stats);
+            published = i + 1;
+        }
+    }
+    live.addRecords(trace.size() - published);
+    live.publish(slot, stats);
+    return stats;
+}
+
+// Human-readable report. With an earlier snapshot of the same run the
+// throughput is over the interval between them, else since the start.
+inline void printLiveStats(std::ostream& os, const LiveStatsSnapshot& s, const LiveStatsSnapshot* prev = nullptr) {
+    double elapsed = (s.taken_ns - s.start_ns) / 1e9;
+    uint64_t records = s.records;
+    double seconds = elapsed;
+    if (prev) {
+        records -= prev->records;
+        seconds = (s.taken_ns - prev->taken_ns) / 1e9;
+    }
+    const char* state = s.finished ? "finished" : s.alive ? "running" : "dead";
+    os << s.label << " (pid " << s.pid << ", " << state << ", " << std::fixed << std::setprecision(1)
+       << elapsed << " s, heartbeat " << (s.taken_ns - s.updated_ns) / 1e9 << " s ago)\n"
+       << "  records " << s.records << ", " << std::setprecision(3)
+       << (seconds > 0 ? records / seconds / 1e6 : 0.0) << " M/s\n";
+    for (const auto& p : s.predictors) {
+        uint64_t high = p.high_correct + p.high_wrong;
+        os << "  " << std::left << std::setw(20) << p.name << std::right << " correct " << p.correct
+           << " wrong " << p.wrong << " accuracy " << std::setprecision(4) << p.accuracy();
+        if (high)
+            os << ", high-confidence " << high << " (" << double(p.high_correct) / high << " correct)";
+        os << "\n";
+        if (!p.component_hits.empty()) {
+            os << "    provider hits";
+            for (uint64_t h : p.component_hits) {
+                os << " " << h;
+            }
+            os << "\n";
+        }
+    }
+    os << std::defaultfloat;
+}
+
+// key=value lines for scraping.
+inline void printLiveStatsRaw(std::ostream& os, const LiveStatsSnapshot& s) {
+    os << "label=" << s.label << "\npid=" << s.pid << "\nstate="
+       << (s.finished ? "finished" : s.alive ? "running" : "dead") << "\nstart_ns=" << s.start_ns
+       << "\nupdated_ns=" << s.updated_ns << "\ntaken_ns=" << s.taken_ns << "\nrecords=" << s.records << "\n";
+    for (const auto& p : s.predictors) {
+        os << p.name << ".correct=" << p.correct << "\n" << p.name << ".wrong=" << p.wrong << "\n"
+           << p.name << ".high_correct=" << p.high_correct << "\n" << p.name << ".high_wrong=" << p.high_wrong << "\n";
+        for (size_t i = 0; i < p.component_hits.size(); i++) {
+            os << p.name << ".component" << i << ".hits=" << p.component_hits[i] << "\n";
+        }
+    }
+}
+
+#endif // LIVE_STATS_HH
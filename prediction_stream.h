@@ -0,0 +1,243 @@
+#ifndef PREDICTION_STREAM_HH
+#define PREDICTION_STREAM_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary stream of per-record predictions, so repeated downstream runs with
+// the same workload and predictor configuration can mmap the answers
+// instead of recomputing them. Record i of the stream belongs to record i of
+// the trace. The file is a header followed by one 16-byte record per trace
+// record.
+struct PredictionStreamRecord {
+    enum Flags : uint8_t {
+        predicted = 1,     // the predictor made a prediction for this record
+        has_provider = 2,  // provider holds the providing component
+    };
+
+    Value value;          // predicted value, or 0/1 for a branch direction
+    uint8_t confidence;
+    uint8_t provider;
+    uint8_t flags;
+    uint8_t reserved[5];
+
+    bool valid() const { return flags & predicted; }
+};
+static_assert(sizeof(PredictionStreamRecord) == 16, "stream records are 16 bytes");
+
+namespace prediction_stream {
+constexpr uint64_t MAGIC = 0x4d52545344525056ull; // "VPRDSTRM"
+constexpr uint64_t VERSION = 1;
+
+struct Header {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t config_hash;
+    uint64_t records;
+};
+}
+
+// Appends records through a buffer; the record count in the header is
+// written by close() (or the destructor).
+class PredictionStreamWriter {
+public:
+    PredictionStreamWriter(const std::string& path, uint64_t config_hash)
+        : path(path)
+        , header{prediction_stream::MAGIC, prediction_stream::VERSION, config_hash, 0}
+    {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        }
+        writeAll(&header, sizeof(header));
+        buffer.reserve(BUFFER_RECORDS);
+    }
+
+    ~PredictionStreamWriter() {
+        if (fd >= 0) {
+            try {
+                close();
+            } catch (...) {
+            }
+        }
+    }
+
+    PredictionStreamWriter(const PredictionStreamWriter&) = delete;
+    PredictionStreamWriter& operator=(const PredictionStreamWriter&) = delete;
+
+    void append(const PredictionStreamRecord& rec) {
+        buffer.push_back(rec);
+        if (buffer.size() == BUFFER_RECORDS)
+            flushBuffer();
+    }
+
+    void close() {
+        flushBuffer();
+        int closing = fd;
+        fd = -1;
+        if (::pwrite(closing, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+            ::close(closing);
+            throw std::runtime_error("write " + path + ": " + std::strerror(errno));
+        }
+        ::close(closing);
+    }
+
+    uint64_t records() const { return header.records + buffer.size(); }
+
+private:
+    static constexpr size_t BUFFER_RECORDS = 1 << 14;
+
+    void writeAll(const void* data, size_t bytes) {
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t n = ::write(fd, p, bytes);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error("write " + path + ": " + std::strerror(errno));
+            }
+            p += n;
+            bytes -= n;
+        }
+    }
+
+    void flushBuffer() {
+        writeAll(buffer.data(), buffer.size() * sizeof(PredictionStreamRecord));
+        header.records += buffer.size();
+        buffer.clear();
+    }
+
+    std::string path;
+    prediction_stream::Header header;
+    int fd = -1;
+    std::vector<PredictionStreamRecord> buffer;
+};
+
+// Read-only mapping of a stream written by PredictionStreamWriter.
+class PredictionStreamReader {
+public:
+    explicit PredictionStreamReader(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("fstat " + path + ": " + std::strerror(errno));
+        }
+        mapping_bytes = st.st_size;
+        if (mapping_bytes < sizeof(prediction_stream::Header)) {
+            ::close(fd);
+            throw std::runtime_error(path + " is not a prediction stream");
+        }
+        mapping = mmap(nullptr, mapping_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("mmap " + path + ": " + std::strerror(errno));
+        }
+
+        header = static_cast<const prediction_stream::Header*>(mapping);
+        records = reinterpret_cast<const PredictionStreamRecord*>(header + 1);
+        if (header->magic != prediction_stream::MAGIC || header->version != prediction_stream::VERSION
+            || mapping_bytes != sizeof(*header) + header->records * sizeof(PredictionStreamRecord)) {
+            munmap(mapping, mapping_bytes);
+            mapping = nullptr;
+            throw std::runtime_error(path + " is not a prediction stream");
+        }
+    }
+
+    ~PredictionStreamReader() {
+        if (mapping)
+            munmap(mapping, mapping_bytes);
+    }
+
+    PredictionStreamReader(const PredictionStreamReader&) = delete;
+    PredictionStreamReader& operator=(const PredictionStreamReader&) = delete;
+
+    size_t size() const { return header->records; }
+    uint64_t configHash() const { return header->config_hash; }
+    const PredictionStreamRecord& operator[](size_t i) const { return records[i]; }
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_bytes = 0;
+    const prediction_stream::Header* header = nullptr;
+    const PredictionStreamRecord* records = nullptr;
+};
+
+// Which records an engine predicts: branches for an EqualityPredictor used
+// as a branch predictor, values for everything else.
+inline bool predictsRecord(const EqualityPredictor&, const ValueTraceRecord& rec) {
+    return rec.kind == branch_record;
+}
+template <class Predictor>
+bool predictsRecord(const Predictor&, const ValueTraceRecord& rec) {
+    return rec.kind == value_record;
+}
+
+// Replays the trace and writes one stream record per trace record. Each
+// record is predicted once, with predictOverriding(), which also supplies
+// the providing component, and that prediction is both written and scored.
+// The predictor needs configs() and predictOverriding().
+template <class Predictor>
+ReplayStats writePredictionStream(Predictor& vp, const std::vector<ValueTraceRecord>& trace,
+                                  const std::string& path) {
+    PredictionStreamWriter writer(path, componentConfigHash(vp.configs()));
+    ReplayStats stats;
+    for (size_t i = 0; i < trace.size(); i++) {
+        PredictionStreamRecord out{};
+        RecordPrediction scored{false, Confidence::low, 0};
+        if (predictsRecord(vp, trace[i])) {
+            auto pred = vp.predictOverriding(trace[i].pc);
+            scored = {true, pred.full.first, Value(pred.full.second)};
+            out.value = scored.value;
+            out.confidence = pred.full.first;
+            out.flags = PredictionStreamRecord::predicted;
+            if (pred.has_provider) {
+                out.provider = pred.provider;
+                out.flags |= PredictionStreamRecord::has_provider;
+            }
+        }
+        replayRecord(vp, trace[i], i, scored, stats, nullptr);
+        writer.append(out);
+    }
+    writer.close();
+    return stats;
+}
+
+// Scores a stream against its trace without running a predictor; gives the
+// same ReplayStats as replaying the predictor that wrote it. Throws on a
+// record with a confidence out of range.
+inline ReplayStats replayPredictionStream(const PredictionStreamReader& stream,
+                                          const std::vector<ValueTraceRecord>& trace) {
+    if (stream.size() != trace.size()) {
+        throw std::invalid_argument("prediction stream and trace differ in length");
+    }
+    ReplayStats stats;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const PredictionStreamRecord& rec = stream[i];
+        if (!rec.valid()) {
+            stats.branches++;
+            continue;
+        }
+        if (rec.confidence > Confidence::high) {
+            throw std::runtime_error("prediction stream record " + std::to_string(i) + " has a bad confidence");
+        }
+        Value actual = trace[i].kind == branch_record ? Value(trace[i].taken) : trace[i].value;
+        stats.count(Confidence(rec.confidence), rec.value == actual,
+                    trace[i].kind == value_record && isNoPrediction(Confidence(rec.confidence), rec.value));
+    }
+    return stats;
+}
+
+#endif // PREDICTION_STREAM_HH
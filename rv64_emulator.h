@@ -0,0 +1,509 @@
+#ifndef RV64_EMULATOR_HH
+#define RV64_EMULATOR_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <string>
+
+// User-mode RV64IM interpreter used as a value trace source: it runs a
+// statically linked program and hands every instruction that writes an
+// integer register (other than x0) to a sink as a value event, and every
+// conditional branch as a branch event. Nothing is written to disk.
+//
+// Supported: RV64I and M, without the compressed extension (build test
+// programs with -march=rv64im), FENCE as a no-op, and the Linux syscalls
+// exit, exit_group, write (fd 1 and 2 are captured in output()) and brk.
+// Other syscalls return -ENOSYS; EBREAK stops the machine.
+//
+// A sink provides onValue(pc, value) and onBranch(pc, taken).
+
+struct Rv64Fault : std::runtime_error {
+    Rv64Fault(const std::string& what, uint64_t pc) : std::runtime_error(what), pc(pc) {}
+    uint64_t pc;
+};
+
+class Rv64Machine {
+public:
+    explicit Rv64Machine(size_t stack_bytes = 1 << 20) : stack_bytes(stack_bytes) {}
+
+    // Maps the PT_LOAD segments of a static RV64 ELF executable and
+    // prepares a stack holding an empty argv, envp and auxv.
+    void loadElf(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file && !file.eof()) {
+            throw std::runtime_error("cannot read " + path);
+        }
+        Elf64_Ehdr eh;
+        if (image.size() < sizeof(eh)) {
+            throw std::runtime_error(path + " is not an ELF file");
+        }
+        std::memcpy(&eh, image.data(), sizeof(eh));
+        if (std::memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS64
+            || eh.e_machine != EM_RISCV || eh.e_type != ET_EXEC) {
+            throw std::runtime_error(path + " is not a static RV64 executable");
+        }
+        uint64_t end = 0;
+        for (size_t i = 0; i < eh.e_phnum; i++) {
+            Elf64_Phdr ph;
+            size_t offset = eh.e_phoff + i * eh.e_phentsize;
+            if (offset + sizeof(ph) > image.size()) {
+                throw std::runtime_error(path + ": truncated program headers");
+            }
+            std::memcpy(&ph, image.data() + offset, sizeof(ph));
+            if (ph.p_type != PT_LOAD)
+                continue;
+            if (ph.p_offset + ph.p_filesz > image.size() || ph.p_filesz > ph.p_memsz) {
+                throw std::runtime_error(path + ": segment outside the file");
+            }
+            Region& r = map(ph.p_vaddr, ph.p_memsz);
+            std::memcpy(r.bytes.data(), image.data() + ph.p_offset, ph.p_filesz);
+            end = std::max(end, ph.p_vaddr + ph.p_memsz);
+        }
+        start(eh.e_entry, end);
+    }
+
+    // Places raw instruction words at base and starts executing there.
+    void loadProgram(const std::vector<uint32_t>& code, uint64_t base = 0x10000) {
+        Region& r = map(base, code.size() * 4);
+        std::memcpy(r.bytes.data(), code.data(), code.size() * 4);
+        start(base, base + code.size() * 4);
+    }
+
+    // Zero-filled memory, e.g. for data used by a hand-written program.
+    void mapZeroed(uint64_t base, size_t bytes) {
+        map(base, bytes);
+    }
+
+    // Executes until the program exits or stops, or max_instructions have
+    // retired. Returns the number retired by this call.
+    template <class Sink>
+    uint64_t run(Sink& sink, uint64_t max_instructions = UINT64_MAX) {
+        uint64_t retired = 0;
+        while (!stopped && retired < max_instructions) {
+            step(sink);
+            retired++;
+        }
+        instructions += retired;
+        return retired;
+    }
+
+    bool stoppedRunning() const { return stopped; }
+    bool exited() const { return has_exited; }
+    int exitCode() const { return exit_code; }
+    const std::string& output() const { return out; }
+    uint64_t instructionsRetired() const { return instructions; }
+    uint64_t pc() const { return pc_; }
+    uint64_t reg(unsigned i) const { return x[i]; }
+    void setReg(unsigned i, uint64_t v) { if (i) x[i] = v; }
+
+    template <class T>
+    T read(uint64_t addr) {
+        T v;
+        std::memcpy(&v, translate(addr, sizeof(T)), sizeof(T));
+        return v;
+    }
+    template <class T>
+    void write(uint64_t addr, T v) {
+        std::memcpy(translate(addr, sizeof(T)), &v, sizeof(T));
+    }
+
+private:
+    static constexpr uint64_t STACK_TOP = 0x7ffff0000000ull;
+    static constexpr uint64_t PAGE = 4096;
+    static constexpr uint64_t HEAP_LIMIT = 64 << 20;
+    static constexpr size_t NO_HEAP = SIZE_MAX;
+
+    struct Region {
+        uint64_t base;
+        std::vector<uint8_t> bytes;
+    };
+
+    // Regions never overlap, so find() can take the first match. Mapping
+    // inside the range the heap may still grow into (up to heap_limit) caps
+    // the heap below the new region; overlapping the current heap throws.
+    Region& map(uint64_t base, size_t size) {
+        for (const Region& r : regions) {
+            if (base < r.base + r.bytes.size() && r.base < base + size) {
+                throw std::runtime_error("overlapping memory regions");
+            }
+        }
+        if (heap != NO_HEAP && base < heap_limit && brk_base < base + size) {
+            if (base < brk) {
+                throw std::runtime_error("region overlaps the heap");
+            }
+            heap_limit = base;
+        }
+        regions.push_back({base, std::vector<uint8_t>(size, 0)});
+        last_data = last_code = 0;
+        return regions.back();
+    }
+
+    void start(uint64_t entry, uint64_t image_end) {
+        Region& stack = map(STACK_TOP - stack_bytes, stack_bytes);
+        (void)stack;
+        // argc = 0, argv = {NULL}, envp = {NULL}, auxv = {AT_NULL}
+        uint64_t sp = STACK_TOP - 64;
+        for (int i = 0; i < 5; i++) {
+            write<uint64_t>(sp + 8 * i, 0);
+        }
+        x[2] = sp;
+        pc_ = entry;
+        brk_base = brk = (image_end + PAGE - 1) & ~(PAGE - 1);
+        heap_limit = brk_base + HEAP_LIMIT;
+        for (const Region& r : regions) {
+            if (r.base < heap_limit && brk_base < r.base + r.bytes.size())
+                heap_limit = std::max(brk_base, r.base);
+        }
+        heap = regions.size();
+        regions.push_back({brk_base, {}});
+    }
+
+    // The last region used by loads and stores, and by fetches, are tried first.
+    uint8_t* translate(uint64_t addr, size_t size) {
+        Region* r = &regions[last_data];
+        if (addr - r->base + size > r->bytes.size() || addr < r->base) {
+            r = find(addr, size);
+            last_data = r - regions.data();
+        }
+        return r->bytes.data() + (addr - r->base);
+    }
+    uint32_t fetch(uint64_t addr) {
+        Region* r = &regions[last_code];
+        if (addr - r->base + 4 > r->bytes.size() || addr < r->base) {
+            r = find(addr, 4);
+            last_code = r - regions.data();
+        }
+        uint32_t insn;
+        std::memcpy(&insn, r->bytes.data() + (addr - r->base), 4);
+        return insn;
+    }
+    Region* find(uint64_t addr, size_t size) {
+        for (Region& r : regions) {
+            if (addr >= r.base && addr - r.base + size <= r.bytes.size())
+                return &r;
+        }
+        throw Rv64Fault("access to unmapped address " + std::to_string(addr), pc_);
+    }
+
+    static int64_t immI(uint32_t i) { return int64_t(int32_t(i)) >> 20; }
+    static int64_t immS(uint32_t i) { return (int64_t(int32_t(i)) >> 25 << 5) | ((i >> 7) & 0x1f); }
+    static int64_t immB(uint32_t i) {
+        return (int64_t(int32_t(i)) >> 31 << 12) | ((i << 4) & 0x800) | ((i >> 20) & 0x7e0) | ((i >> 7) & 0x1e);
+    }
+    static int64_t immU(uint32_t i) { return int64_t(int32_t(i & 0xfffff000)); }
+    static int64_t immJ(uint32_t i) {
+        return (int64_t(int32_t(i)) >> 31 << 20) | (i & 0xff000) | ((i >> 9) & 0x800) | ((i >> 20) & 0x7fe);
+    }
+    static uint64_t sext32(uint64_t v) { return uint64_t(int64_t(int32_t(uint32_t(v)))); }
+
+    // RISC-V division never traps: x / 0 = -1 (all ones), x % 0 = x, and
+    // the overflowing signed case gives the dividend back (rem 0).
+    static uint64_t mulh(int64_t a, int64_t b) { return uint64_t((__int128(a) * __int128(b)) >> 64); }
+    static uint64_t mulhu(uint64_t a, uint64_t b) {
+        return uint64_t((static_cast<unsigned __int128>(a) * b) >> 64);
+    }
+    static uint64_t mulhsu(int64_t a, uint64_t b) {
+        return uint64_t((__int128(a) * static_cast<__int128>(b)) >> 64);
+    }
+    static uint64_t div(int64_t a, int64_t b) {
+        if (b == 0) return ~0ull;
+        if (a == INT64_MIN && b == -1) return uint64_t(a);
+        return uint64_t(a / b);
+    }
+    static uint64_t rem(int64_t a, int64_t b) {
+        if (b == 0) return uint64_t(a);
+        if (a == INT64_MIN && b == -1) return 0;
+        return uint64_t(a % b);
+    }
+    static uint64_t divu(uint64_t a, uint64_t b) { return b ? a / b : ~0ull; }
+    static uint64_t remu(uint64_t a, uint64_t b) { return b ? a % b : a; }
+
+    uint64_t syscall() {
+        switch (x[17]) {
+        case 93:   // exit
+        case 94:   // exit_group
+            has_exited = stopped = true;
+            exit_code = int(x[10]);
+            return x[10];
+        case 64: { // write
+            if (x[10] != 1 && x[10] != 2)
+                return uint64_t(-9);  // EBADF
+            for (uint64_t i = 0; i < x[12]; i++) {
+                out.push_back(char(read<uint8_t>(x[11] + i)));
+            }
+            return x[12];
+        }
+        case 214: { // brk
+            // Growing into another region fails and returns the old break
+            Region& h = regions[heap];
+            if (x[10] >= brk_base && x[10] <= heap_limit) {
+                h.bytes.resize(x[10] - brk_base, 0);
+                brk = x[10];
+            }
+            return brk;
+        }
+        default:
+            return uint64_t(-38);  // ENOSYS
+        }
+    }
+
+    template <class Sink>
+    void step(Sink& sink) {
+        uint64_t pc = pc_;
+        uint32_t i = fetch(pc);
+        unsigned rd = (i >> 7) & 0x1f;
+        unsigned funct3 = (i >> 12) & 7;
+        uint64_t a = x[(i >> 15) & 0x1f];
+        uint64_t b = x[(i >> 20) & 0x1f];
+        uint64_t next = pc + 4;
+        uint64_t v = 0;
+        bool writes = true;
+
+        switch (i & 0x7f) {
+        case 0x37: v = immU(i); break;                       // LUI
+        case 0x17: v = pc + immU(i); break;                  // AUIPC
+        case 0x6f: v = next; next = pc + immJ(i); break;     // JAL
+        case 0x67: v = next; next = (a + immI(i)) & ~1ull; break;  // JALR
+        case 0x63: {                                         // branches
+            bool taken;
+            switch (funct3) {
+            case 0: taken = a == b; break;
+            case 1: taken = a != b; break;
+            case 4: taken = int64_t(a) < int64_t(b); break;
+            case 5: taken = int64_t(a) >= int64_t(b); break;
+            case 6: taken = a < b; break;
+            case 7: taken = a >= b; break;
+            default: throw Rv64Fault("illegal branch", pc);
+            }
+            if (taken)
+                next = pc + immB(i);
+            sink.onBranch(pc, taken);
+            writes = false;
+            break;
+        }
+        case 0x03: {                                         // loads
+            uint64_t addr = a + immI(i);
+            switch (funct3) {
+            case 0: v = uint64_t(int64_t(read<int8_t>(addr))); break;
+            case 1: v = uint64_t(int64_t(read<int16_t>(addr))); break;
+            case 2: v = uint64_t(int64_t(read<int32_t>(addr))); break;
+            case 3: v = read<uint64_t>(addr); break;
+            case 4: v = read<uint8_t>(addr); break;
+            case 5: v = read<uint16_t>(addr); break;
+            case 6: v = read<uint32_t>(addr); break;
+            default: throw Rv64Fault("illegal load", pc);
+            }
+            break;
+        }
+        case 0x23: {                                         // stores
+            uint64_t addr = a + immS(i);
+            switch (funct3) {
+            case 0: write<uint8_t>(addr, b); break;
+            case 1: write<uint16_t>(addr, b); break;
+            case 2: write<uint32_t>(addr, b); break;
+            case 3: write<uint64_t>(addr, b); break;
+            default: throw Rv64Fault("illegal store", pc);
+            }
+            writes = false;
+            break;
+        }
+        case 0x13: {                                         // OP-IMM
+            int64_t imm = immI(i);
+            unsigned shamt = (i >> 20) & 0x3f;
+            unsigned funct6 = i >> 26;
+            // SLLI takes funct6 0, SRLI/SRAI 0 or 0x10; the rest is reserved
+            if ((funct3 == 1 && funct6 != 0) || (funct3 == 5 && (funct6 & ~0x10u) != 0))
+                throw Rv64Fault("illegal OP-IMM", pc);
+            switch (funct3) {
+            case 0: v = a + imm; break;
+            case 1: v = a << shamt; break;
+            case 2: v = int64_t(a) < imm; break;
+            case 3: v = a < uint64_t(imm); break;
+            case 4: v = a ^ imm; break;
+            case 5: v = (i >> 30) & 1 ? uint64_t(int64_t(a) >> shamt) : a >> shamt; break;
+            case 6: v = a | imm; break;
+            case 7: v = a & imm; break;
+            }
+            break;
+        }
+        case 0x1b: {                                         // OP-IMM-32
+            unsigned shamt = (i >> 20) & 0x1f;
+            unsigned funct7 = i >> 25;
+            // shamt[5] set is reserved for the W shifts
+            if ((funct3 == 1 && funct7 != 0) || (funct3 == 5 && funct7 != 0 && funct7 != 0x20))
+                throw Rv64Fault("illegal OP-IMM-32", pc);
+            switch (funct3) {
+            case 0: v = sext32(a + immI(i)); break;
+            case 1: v = sext32(uint32_t(a) << shamt); break;
+            case 5: v = (i >> 30) & 1 ? sext32(uint32_t(int32_t(a) >> shamt)) : sext32(uint32_t(a) >> shamt); break;
+            default: throw Rv64Fault("illegal OP-IMM-32", pc);
+            }
+            break;
+        }
+        case 0x33: {                                         // OP
+            unsigned funct7 = i >> 25;
+            if (funct7 == 1) {
+                switch (funct3) {
+                case 0: v = a * b; break;
+                case 1: v = mulh(a, b); break;
+                case 2: v = mulhsu(a, b); break;
+                case 3: v = mulhu(a, b); break;
+                case 4: v = div(a, b); break;
+                case 5: v = divu(a, b); break;
+                case 6: v = rem(a, b); break;
+                case 7: v = remu(a, b); break;
+                }
+                break;
+            }
+            // 0x20 selects SUB and SRA; other funct7 values are reserved
+            if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5)))
+                throw Rv64Fault("illegal OP", pc);
+            switch (funct3) {
+            case 0: v = funct7 == 0x20 ? a - b : a + b; break;
+            case 1: v = a << (b & 0x3f); break;
+            case 2: v = int64_t(a) < int64_t(b); break;
+            case 3: v = a < b; break;
+            case 4: v = a ^ b; break;
+            case 5: v = funct7 == 0x20 ? uint64_t(int64_t(a) >> (b & 0x3f)) : a >> (b & 0x3f); break;
+            case 6: v = a | b; break;
+            case 7: v = a & b; break;
+            }
+            break;
+        }
+        case 0x3b: {                                         // OP-32
+            unsigned funct7 = i >> 25;
+            int32_t sa = int32_t(a), sb = int32_t(b);
+            uint32_t ua = uint32_t(a), ub = uint32_t(b);
+            if (funct7 == 1) {
+                switch (funct3) {
+                case 0: v = sext32(ua * ub); break;
+                case 4: v = sext32(ub == 0 ? ~0u : (sa == INT32_MIN && sb == -1) ? ua : uint32_t(sa / sb)); break;
+                case 5: v = sext32(ub == 0 ? ~0u : ua / ub); break;
+                case 6: v = sext32(ub == 0 ? ua : (sa == INT32_MIN && sb == -1) ? 0 : uint32_t(sa % sb)); break;
+                case 7: v = sext32(ub == 0 ? ua : ua % ub); break;
+                default: throw Rv64Fault("illegal OP-32", pc);
+                }
+                break;
+            }
+            if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5)))
+                throw Rv64Fault("illegal OP-32", pc);
+            switch (funct3) {
+            case 0: v = sext32(funct7 == 0x20 ? ua - ub : ua + ub); break;
+            case 1: v = sext32(ua << (ub & 0x1f)); break;
+            case 5: v = funct7 == 0x20 ? sext32(uint32_t(sa >> (ub & 0x1f))) : sext32(ua >> (ub & 0x1f)); break;
+            default: throw Rv64Fault("illegal OP-32", pc);
+            }
+            break;
+        }
+        case 0x0f:                                           // FENCE
+            writes = false;
+            break;
+        case 0x73:                                           // SYSTEM
+            if (i == 0x00000073) {
+                rd = 10;
+                v = syscall();
+            } else if (i == 0x00100073) {
+                stopped = true;
+                writes = false;
+            } else {
+                throw Rv64Fault("unsupported SYSTEM instruction", pc);
+            }
+            break;
+        default:
+            throw Rv64Fault("illegal instruction", pc);
+        }
+
+        if (writes && rd != 0) {
+            x[rd] = v;
+            sink.onValue(pc, v);
+        }
+        pc_ = next;
+    }
+
+    size_t stack_bytes;
+    uint64_t x[32] = {};
+    uint64_t pc_ = 0;
+    std::vector<Region> regions;
+    size_t last_data = 0;
+    size_t last_code = 0;
+    size_t heap = NO_HEAP;
+    uint64_t brk_base = 0;
+    uint64_t brk = 0;
+    uint64_t heap_limit = 0;       // the heap may grow up to here
+    bool stopped = false;
+    bool has_exited = false;
+    int exit_code = 0;
+    std::string out;
+    uint64_t instructions = 0;
+};
+
+// Records the events as a value trace.
+struct ValueTraceRecorder {
+    std::vector<ValueTraceRecord> trace;
+
+    void onValue(PC pc, Value v) { trace.push_back({value_record, false, pc, v}); }
+    void onBranch(PC pc, bool taken) { trace.push_back({branch_record, taken, pc, 0}); }
+};
+
+// Feeds the events straight into a predictor with replayRecord, so the
+// statistics equal those of replaying the recorded trace.
+template <class Predictor>
+class PredictorTraceSink {
+public:
+    explicit PredictorTraceSink(Predictor& vp) : vp(vp) {}
+
+    void onValue(PC pc, Value v) { replayRecord(vp, {value_record, false, pc, v}, seq++, stats, nullptr); }
+    void onBranch(PC pc, bool taken) { replayRecord(vp, {branch_record, taken, pc, 0}, seq++, stats, nullptr); }
+
+    const ReplayStats& replayStats() const { return stats; }
+
+private:
+    Predictor& vp;
+    ReplayStats stats;
+    InstSeqNum seq = 0;
+};
+
+// Instruction encoders for hand-written test programs.
+namespace rv64asm {
+inline uint32_t r(uint32_t op, unsigned rd, unsigned f3, unsigned rs1, unsigned rs2, uint32_t f7) {
+    return op | rd << 7 | f3 << 12 | rs1 << 15 | rs2 << 20 | f7 << 25;
+}
+inline uint32_t i(uint32_t op, unsigned rd, unsigned f3, unsigned rs1, int32_t imm) {
+    return op | rd << 7 | f3 << 12 | rs1 << 15 | uint32_t(imm) << 20;
+}
+inline uint32_t s(uint32_t op, unsigned f3, unsigned rs1, unsigned rs2, int32_t imm) {
+    return op | (uint32_t(imm) & 0x1f) << 7 | f3 << 12 | rs1 << 15 | rs2 << 20 | (uint32_t(imm) >> 5) << 25;
+}
+inline uint32_t b(unsigned f3, unsigned rs1, unsigned rs2, int32_t off) {
+    uint32_t o = uint32_t(off);
+    return 0x63 | ((o >> 11) & 1) << 7 | ((o >> 1) & 0xf) << 8 | f3 << 12 | rs1 << 15 | rs2 << 20
+           | ((o >> 5) & 0x3f) << 25 | ((o >> 12) & 1) << 31;
+}
+inline uint32_t j(unsigned rd, int32_t off) {
+    uint32_t o = uint32_t(off);
+    return 0x6f | rd << 7 | ((o >> 12) & 0xff) << 12 | ((o >> 11) & 1) << 20 | ((o >> 1) & 0x3ff) << 21
+           | ((o >> 20) & 1) << 31;
+}
+inline uint32_t lui(unsigned rd, uint32_t imm20) { return 0x37 | rd << 7 | imm20 << 12; }
+inline uint32_t addi(unsigned rd, unsigned rs1, int32_t imm) { return i(0x13, rd, 0, rs1, imm); }
+inline uint32_t andi(unsigned rd, unsigned rs1, int32_t imm) { return i(0x13, rd, 7, rs1, imm); }
+inline uint32_t slli(unsigned rd, unsigned rs1, unsigned shamt) { return i(0x13, rd, 1, rs1, shamt); }
+inline uint32_t add(unsigned rd, unsigned rs1, unsigned rs2) { return r(0x33, rd, 0, rs1, rs2, 0); }
+inline uint32_t sub(unsigned rd, unsigned rs1, unsigned rs2) { return r(0x33, rd, 0, rs1, rs2, 0x20); }
+inline uint32_t mul(unsigned rd, unsigned rs1, unsigned rs2) { return r(0x33, rd, 0, rs1, rs2, 1); }
+inline uint32_t divu(unsigned rd, unsigned rs1, unsigned rs2) { return r(0x33, rd, 5, rs1, rs2, 1); }
+inline uint32_t remu(unsigned rd, unsigned rs1, unsigned rs2) { return r(0x33, rd, 7, rs1, rs2, 1); }
+inline uint32_t ld(unsigned rd, unsigned rs1, int32_t imm) { return i(0x03, rd, 3, rs1, imm); }
+inline uint32_t sd(unsigned rs2, unsigned rs1, int32_t imm) { return s(0x23, 3, rs1, rs2, imm); }
+inline uint32_t beq(unsigned rs1, unsigned rs2, int32_t off) { return b(0, rs1, rs2, off); }
+inline uint32_t bne(unsigned rs1, unsigned rs2, int32_t off) { return b(1, rs1, rs2, off); }
+inline uint32_t blt(unsigned rs1, unsigned rs2, int32_t off) { return b(4, rs1, rs2, off); }
+inline uint32_t ecall() { return 0x73; }
+}
+
+#endif // RV64_EMULATOR_HH
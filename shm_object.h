@@ -0,0 +1,150 @@
+#ifndef SHM_OBJECT_HH
+#define SHM_OBJECT_HH
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A named POSIX shared memory object owned by one process at a time. The
+// owner holds a shared flock on the object for as long as it lives, and the
+// kernel drops it when the process dies, so an object nobody holds locked is
+// stale and may be replaced, whatever state it was left in. The owner
+// unlinks the name on destruction, but only while the name still refers to
+// its own object.
+class OwnedShm {
+public:
+    OwnedShm() = default;
+
+    // Creates name exclusively, replacing a stale object of that name. Throws
+    // if a live owner holds it.
+    OwnedShm(const std::string& name, mode_t mode) : name(name) {
+        for (int attempt = 0; attempt < 8; attempt++) {
+            fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+            if (fd < 0) {
+                if (errno != EEXIST) {
+                    throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+                }
+                removeIfStale(name);
+                continue;
+            }
+            struct stat st;
+            if (flock(fd, LOCK_SH) != 0 || fstat(fd, &st) != 0) {
+                int err = errno;
+                close();
+                shm_unlink(name.c_str());
+                throw std::runtime_error("lock " + name + ": " + std::strerror(err));
+            }
+            dev = st.st_dev;
+            ino = st.st_ino;
+            // Another process may have judged it stale and unlinked it
+            // between the shm_open and the flock
+            if (namesThis())
+                return;
+            close();
+        }
+        throw std::runtime_error("cannot create " + name + ": it keeps being replaced");
+    }
+
+    OwnedShm(OwnedShm&& other) noexcept
+        : name(std::move(other.name)), fd(other.fd), dev(other.dev), ino(other.ino)
+    {
+        other.fd = -1;
+    }
+
+    OwnedShm& operator=(OwnedShm&& other) noexcept {
+        if (this != &other) {
+            release();
+            name = std::move(other.name);
+            fd = other.fd;
+            dev = other.dev;
+            ino = other.ino;
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    ~OwnedShm() {
+        release();
+    }
+
+    OwnedShm(const OwnedShm&) = delete;
+    OwnedShm& operator=(const OwnedShm&) = delete;
+
+    int descriptor() const { return fd; }
+
+    // Throws if name is held by a live owner, else unlinks it.
+    static void removeIfStale(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            throw std::runtime_error(name + " is in use");
+        }
+        // Unlink only the object we hold locked, not one that replaced it
+        struct stat st;
+        OwnedShm probe;
+        probe.name = name;
+        if (fstat(fd, &st) == 0) {
+            probe.dev = st.st_dev;
+            probe.ino = st.st_ino;
+            if (probe.namesThis())
+                shm_unlink(name.c_str());
+        }
+        ::close(fd);
+    }
+
+private:
+    bool namesThis() const {
+        int current = shm_open(name.c_str(), O_RDONLY, 0);
+        if (current < 0)
+            return false;
+        struct stat st;
+        bool same = fstat(current, &st) == 0 && st.st_dev == dev && st.st_ino == ino;
+        ::close(current);
+        return same;
+    }
+
+    void close() {
+        ::close(fd);
+        fd = -1;
+    }
+
+    void release() {
+        if (fd >= 0) {
+            if (namesThis())
+                shm_unlink(name.c_str());
+            close();
+        }
+    }
+
+    std::string name;
+    int fd = -1;
+    dev_t dev = 0;             // identity of the object, see namesThis
+    ino_t ino = 0;
+};
+
+// Whether process pid has exited. Unlike kill(pid, 0) this also sees an
+// exited child that its parent has not reaped yet.
+inline bool processGone(pid_t pid) {
+    if (pid <= 0)
+        return false;
+    int fd = int(syscall(SYS_pidfd_open, pid, 0));
+    if (fd < 0)
+        return kill(pid, 0) != 0 && errno == ESRCH;
+    pollfd p{fd, POLLIN, 0};
+    bool gone = poll(&p, 1, 0) > 0;
+    ::close(fd);
+    return gone;
+}
+
+#endif // SHM_OBJECT_HH
@@ -0,0 +1,348 @@
+#ifndef SHM_RING_HH
+#define SHM_RING_HH
+
+#include "vp.h"
+#include "vp_daemon.h"
+#include "shm_object.h"
+#include <atomic>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Shared-memory transport for driving a predictor from another process.
+// Two single-producer single-consumer rings live in one POSIX shared memory
+// object: requests (DaemonRequest, see vp_daemon.h) from the client, and
+// responses to predict requests from the server. Producers fill slots
+// privately and publish a whole batch with one store; a consumer that finds
+// its ring empty spins briefly, then sleeps on a futex until the producer's
+// next publication. Sleepers wake up periodically to check that the other
+// side's process still exists, and throw if it has gone.
+
+namespace shm_futex {
+inline void wait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout = nullptr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+inline void wakeAll(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+}
+
+// Placed in shared memory with its slots directly behind it; see bytesFor.
+// Indices are free-running 32-bit counters, so capacity must be a power of two.
+template <class T>
+class SpscRing {
+public:
+    static size_t bytesFor(uint32_t capacity) {
+        return sizeof(SpscRing) + size_t(capacity) * sizeof(T);
+    }
+
+    // Called once by the creator, before the other side attaches.
+    void init(uint32_t capacity) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("ring capacity must be a power of two");
+        }
+        head.store(0, std::memory_order_relaxed);
+        pending = 0;
+        producer_waiting.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        consumer_waiting.store(0, std::memory_order_relaxed);
+        mask = capacity - 1;
+    }
+
+    // Producer: stage an item. It becomes visible at the next publish(); a
+    // full ring publishes and waits for the consumer, whose pid is *peer
+    // (0 = none attached yet).
+    void push(const T& item, const std::atomic<int32_t>* peer = nullptr) {
+        while (pending - tail.load(std::memory_order_acquire) > mask) {
+            publish();
+            waitForChange(tail, pending - mask - 1, producer_waiting, peer);
+        }
+        slots()[pending & mask] = item;
+        pending++;
+    }
+
+    void publish() {
+        if (head.load(std::memory_order_relaxed) == pending)
+            return;
+        head.store(pending, std::memory_order_seq_cst);
+        if (consumer_waiting.load(std::memory_order_seq_cst))
+            shm_futex::wakeAll(head);
+    }
+
+    // Consumer: waits for at least one item from the producer, whose pid is
+    // *peer, and takes up to max of them.
+    size_t pop(T* out, size_t max, const std::atomic<int32_t>* peer = nullptr) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+        while (h == t) {
+            waitForChange(head, t, consumer_waiting, peer);
+            h = head.load(std::memory_order_acquire);
+        }
+        size_t n = std::min<size_t>(max, h - t);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = slots()[(t + i) & mask];
+        }
+        tail.store(t + n, std::memory_order_seq_cst);
+        if (producer_waiting.load(std::memory_order_seq_cst))
+            shm_futex::wakeAll(tail);
+        return n;
+    }
+
+private:
+    static constexpr int SPINS = 256;
+    static constexpr long PEER_CHECK_NS = 100 * 1000 * 1000;
+
+    T* slots() { return reinterpret_cast<T*>(this + 1); }
+
+    // Waits until word != seen. Announcing the waiter before the last check
+    // pairs with the other side's store-then-check, so a wakeup is not lost.
+    static void waitForChange(std::atomic<uint32_t>& word, uint32_t seen, std::atomic<uint32_t>& waiting,
+                              const std::atomic<int32_t>* peer) {
+        for (int i = 0; i < SPINS; i++) {
+            if (word.load(std::memory_order_acquire) != seen)
+                return;
+        }
+        waiting.store(1, std::memory_order_seq_cst);
+        const timespec timeout{0, PEER_CHECK_NS};
+        while (word.load(std::memory_order_seq_cst) == seen) {
+            shm_futex::wait(word, seen, &timeout);
+            if (peer && word.load(std::memory_order_seq_cst) == seen) {
+                int32_t pid = peer->load(std::memory_order_acquire);
+                if (processGone(pid)) {
+                    waiting.store(0, std::memory_order_relaxed);
+                    throw std::runtime_error("process " + std::to_string(pid) + " on the other side is gone");
+                }
+            }
+        }
+        waiting.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer side
+    alignas(64) std::atomic<uint32_t> head;
+    uint32_t pending;
+    std::atomic<uint32_t> producer_waiting;
+    // Consumer side
+    alignas(64) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> consumer_waiting;
+    uint32_t mask;
+};
+
+// The mapped shared memory object holding both rings, and the pids of the
+// server and the attached client.
+class ShmChannel {
+public:
+    // The server creates the object, replacing one left by a server that is
+    // gone and throwing if a live server holds it; clients open it.
+    static ShmChannel create(const std::string& name, uint32_t capacity) {
+        return ShmChannel(name, capacity, true);
+    }
+    static ShmChannel open(const std::string& name) {
+        return ShmChannel(name, 0, false);
+    }
+
+    ShmChannel(ShmChannel&& other) noexcept
+        : name(std::move(other.name)), object(std::move(other.object)), mapping(other.mapping), bytes(other.bytes)
+    {
+        other.mapping = nullptr;
+    }
+
+    // The server's object is unlinked by ~OwnedShm.
+    ~ShmChannel() {
+        if (mapping)
+            munmap(mapping, bytes);
+    }
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    SpscRing<DaemonRequest>& requests() {
+        return *reinterpret_cast<SpscRing<DaemonRequest>*>(static_cast<char*>(mapping) + sizeof(Header));
+    }
+    SpscRing<DaemonResponse>& responses() {
+        return *reinterpret_cast<SpscRing<DaemonResponse>*>(static_cast<char*>(mapping) + responsesOffset(header()->capacity));
+    }
+    std::atomic<int32_t>& serverPid() { return header()->server_pid; }
+    std::atomic<int32_t>& clientPid() { return header()->client_pid; }
+
+private:
+    static constexpr uint64_t MAGIC = 0x474e495250564d53ull; // "SMVPRING"
+
+    struct alignas(64) Header {
+        uint64_t magic;
+        uint32_t capacity;
+        std::atomic<int32_t> server_pid;
+        std::atomic<int32_t> client_pid;    // 0 = no client attached
+    };
+
+    static size_t responsesOffset(uint32_t capacity) {
+        size_t offset = sizeof(Header) + SpscRing<DaemonRequest>::bytesFor(capacity);
+        return (offset + 63) & ~size_t(63);
+    }
+    static size_t bytesFor(uint32_t capacity) {
+        return responsesOffset(capacity) + SpscRing<DaemonResponse>::bytesFor(capacity);
+    }
+
+    Header* header() { return static_cast<Header*>(mapping); }
+
+    ShmChannel(const std::string& name, uint32_t capacity, bool create) : name(name) {
+        int fd;
+        if (create) {
+            object = OwnedShm(name, 0600);
+            fd = dup(object.descriptor());
+        } else {
+            fd = shm_open(name.c_str(), O_RDWR, 0);
+        }
+        if (fd < 0) {
+            throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        }
+
+        if (create) {
+            bytes = bytesFor(capacity);
+            if (ftruncate(fd, bytes) != 0) {
+                int err = errno;
+                ::close(fd);
+                throw std::runtime_error("ftruncate " + name + ": " + std::strerror(err));
+            }
+        } else {
+            Header h;
+            if (::pread(fd, &h, sizeof(h), 0) != ssize_t(sizeof(h)) || h.magic != MAGIC) {
+                ::close(fd);
+                throw std::runtime_error(name + " is not a predictor channel");
+            }
+            bytes = bytesFor(h.capacity);
+        }
+
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+        }
+        if (create) {
+            header()->capacity = capacity;
+            header()->server_pid.store(getpid(), std::memory_order_relaxed);
+            header()->client_pid.store(0, std::memory_order_relaxed);
+            requests().init(capacity);
+            responses().init(capacity);
+            // Published last, so a client never sees a half-initialised channel
+            std::atomic_thread_fence(std::memory_order_release);
+            header()->magic = MAGIC;
+        } else {
+            header()->client_pid.store(getpid(), std::memory_order_release);
+        }
+    }
+
+    std::string name;
+    OwnedShm object;          // the server's claim on the name
+    void* mapping = nullptr;
+    size_t bytes = 0;
+};
+
+// Drains the request ring into a predictor, answering predict and state hash
+// requests on the response ring, until a daemon_shutdown request. A failed
+// request that gets no response (commit, branch, branch commit, squash) is
+// latched and reported as an error on the next response instead. serve()
+// throws if the client process dies.
+template <class Predictor>
+class ShmPredictorServer {
+public:
+    ShmPredictorServer(Predictor& vp, const std::string& name, uint32_t capacity = 1 << 12)
+        : vp(vp), channel(ShmChannel::create(name, capacity)), batch(capacity) {}
+
+    void serve() {
+        SpscRing<DaemonRequest>& requests = channel.requests();
+        SpscRing<DaemonResponse>& responses = channel.responses();
+        std::atomic<int32_t>& client = channel.clientPid();
+        for (;;) {
+            size_t n = requests.pop(batch.data(), batch.size(), &client);
+            for (size_t i = 0; i < n; i++) {
+                const DaemonRequest& req = batch[i];
+                if (req.op == daemon_shutdown) {
+                    responses.publish();
+                    client.store(0, std::memory_order_release);
+                    failed = false;
+                    return;
+                }
+                DaemonResponse resp{};
+                try {
+                    if (!applyPredictorRequest(vp, req, resp))
+                        resp.status = DaemonResponse::error;
+                } catch (const std::exception&) {
+                    resp.status = DaemonResponse::error;
+                }
+                if (req.op == daemon_predict || req.op == daemon_state_hash) {
+                    if (failed)
+                        resp.status = DaemonResponse::error;
+                    failed = false;
+                    responses.push(resp, &client);
+                } else if (resp.status == DaemonResponse::error) {
+                    failed = true;
+                }
+            }
+            responses.publish();
+        }
+    }
+
+private:
+    Predictor& vp;
+    ShmChannel channel;
+    std::vector<DaemonRequest> batch;
+    bool failed = false;        // a request without a response failed
+};
+
+// Client side. Commits and branch events are only staged; they reach the
+// server together with the next request that needs an answer, or flush().
+// predict() and stateHash() throw if that request or any staged one since
+// the last answer failed, or if the server process is gone.
+class ShmPredictorClient {
+public:
+    explicit ShmPredictorClient(const std::string& name) : channel(ShmChannel::open(name)) {}
+
+    std::pair<Confidence, Value> predict(PC pc) {
+        DaemonResponse resp = ask({daemon_predict, 0, {}, pc, 0});
+        return {Confidence(resp.confidence), resp.value};
+    }
+    void onValueCommit(PC pc, Value val) {
+        channel.requests().push({daemon_commit, 0, {}, pc, val}, &channel.serverPid());
+    }
+    void updateOnBranch(InstSeqNum seqNum, bool taken) {
+        channel.requests().push({daemon_branch, taken, {}, 0, seqNum}, &channel.serverPid());
+    }
+    void onBranchCommit(InstSeqNum seqNum) {
+        channel.requests().push({daemon_branch_commit, 0, {}, 0, seqNum}, &channel.serverPid());
+    }
+    void squash(InstSeqNum seqNum) {
+        channel.requests().push({daemon_squash, 0, {}, 0, seqNum}, &channel.serverPid());
+    }
+    uint64_t stateHash() {
+        return ask({daemon_state_hash, 0, {}, 0, 0}).value;
+    }
+    void flush() {
+        channel.requests().publish();
+    }
+    void shutdown() {
+        channel.requests().push({daemon_shutdown, 0, {}, 0, 0}, &channel.serverPid());
+        flush();
+    }
+
+private:
+    DaemonResponse ask(const DaemonRequest& req) {
+        channel.requests().push(req, &channel.serverPid());
+        flush();
+        DaemonResponse resp;
+        channel.responses().pop(&resp, 1, &channel.serverPid());
+        if (resp.status != DaemonResponse::ok) {
+            throw std::runtime_error("predictor server rejected a request");
+        }
+        return resp;
+    }
+
+    ShmChannel channel;
+};
+
+#endif // SHM_RING_HH
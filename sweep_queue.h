@@ -0,0 +1,565 @@
+#ifndef SWEEP_QUEUE_HH
+#define SWEEP_QUEUE_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include "prediction_stream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <signal.h>
+#include <sstream>
+#include <string>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// Persistent local job queue for sweeps. A job replays a value trace, either
+// derived from a branch trace or recorded (loadValueTrace), through a
+// ValuePredictor of one geometry, or,
+// as a branch job, runs an EqualityPredictor of that geometry as a branch
+// predictor over the branches, like the EqualityPredictor half of the
+// trace_gcc.txt suite run. The reference TAGE half of that run is not
+// covered: tage.h keeps its state in globals and draws from rand(), so it
+// cannot be checkpointed. The queue is a directory:
+//
+//   jobs/<id>.job          job description (text)
+//   checkpoints/<id>.ckpt  predictor state and stats after some record
+//   results/<id>.result    final stats (text)
+//   results/<id>.error     why the job failed (text)
+//   locks/<id>.lock        flock()ed by the worker running the job, holds its pid
+//
+// A job's id is a hash of its contents and of the trace file's size and
+// modification time, so submitting it again is a no-op, while a job over a
+// trace that has since changed is a new job. A job whose trace changes after
+// submission fails instead of running on the new contents.
+// Workers checkpoint every checkpoint_interval records and resume from the
+// last checkpoint; replay is deterministic, so a resumed job ends with the
+// same result as an uninterrupted one. Every file is written to a temporary
+// name, fsync()ed and renamed, so a killed worker or a crash leaves either
+// the old or the new version; a job whose result does not parse is run
+// again. The flock is released by the kernel when a worker dies, so
+// several workers can drain one queue and pick up each other's jobs. A job
+// that throws (missing trace, corrupt job file, I/O error) is marked failed
+// and skipped; submitting it again clears the failure.
+enum SweepJobKind : uint8_t {
+    sweep_value_job = 0,            // ValuePredictor over the value trace
+    sweep_branch_job = 1,           // EqualityPredictor as a branch predictor
+};
+
+struct SweepJob {
+    std::string trace_path;         // made absolute by submit()
+    size_t branches = SIZE_MAX;     // branches of the trace to use; SIZE_MAX = all
+    std::vector<ComponentConfig> configs = defaultValuePredictorConfig();
+    SweepJobKind kind = sweep_value_job;
+    bool value_trace = false;       // trace_path is a value trace, not a branch trace
+    // Identity of the trace file when submitted; set by submit()
+    uint64_t trace_size = 0;
+    uint64_t trace_mtime_ns = 0;
+};
+
+inline const char* sweepJobKindName(SweepJobKind kind) {
+    return kind == sweep_branch_job ? "branch" : "value";
+}
+
+struct SweepResult {
+    ReplayStats stats;
+    uint64_t state_hash = 0;        // of the predictor after the last record
+};
+
+enum SweepJobState : uint8_t { sweep_pending = 0, sweep_running = 1, sweep_done = 2, sweep_failed = 3 };
+
+struct SweepJobStatus {
+    std::string id;
+    SweepJob job;
+    SweepJobState state;
+    uint64_t checkpointed = 0;      // records covered by the last checkpoint
+    std::string error;              // set when failed
+};
+
+struct SweepRunOptions {
+    uint64_t checkpoint_interval = 1 << 20;    // records between checkpoints
+    // Records to replay in this call before checkpointing and returning,
+    // e.g. to fit a time slice. UINT64_MAX = until the queue is drained.
+    uint64_t record_budget = UINT64_MAX;
+};
+
+struct SweepRunReport {
+    size_t completed = 0;
+    size_t failed = 0;
+    size_t resumed = 0;             // jobs started from a checkpoint
+    uint64_t records = 0;           // records replayed by this call
+    uint64_t checkpoints = 0;
+    bool budget_exhausted = false;
+};
+
+class SweepQueue {
+public:
+    explicit SweepQueue(const std::string& dir) : dir(dir) {
+        for (const char* sub : {"", "/jobs", "/checkpoints", "/results", "/locks"}) {
+            std::filesystem::create_directories(dir + sub);
+        }
+    }
+
+    // Relative trace paths are taken relative to the current directory. The
+    // trace file must exist; its current size and mtime are part of the id.
+    static std::string jobId(const SweepJob& job) {
+        auto [size, mtime_ns] = traceIdentity(absoluteTracePath(job.trace_path));
+        uint64_t h = mixHash(componentConfigHash(job.configs), job.branches);
+        h = mixHash(mixHash(h, size), mtime_ns);
+        if (job.kind != sweep_value_job)
+            h = mixHash(h, job.kind);
+        if (job.value_trace)
+            h = mixHash(h, 0x76616c756573ull);     // "values"
+        for (char c : absoluteTracePath(job.trace_path)) {
+            h = mixHash(h, uint8_t(c));
+        }
+        std::ostringstream id;
+        id << std::hex << std::setw(16) << std::setfill('0') << h;
+        return id.str();
+    }
+
+    // Returns the job's id; a job already in the queue is left as it is,
+    // except that a failed one is cleared to be retried.
+    std::string submit(const SweepJob& job) {
+        std::string id = jobId(job);
+        std::string path = dir + "/jobs/" + id + ".job";
+        if (access(path.c_str(), F_OK) != 0) {
+            std::string trace = absoluteTracePath(job.trace_path);
+            auto [size, mtime_ns] = traceIdentity(trace);
+            std::ostringstream text;
+            text << "bvp-sweep-job " << FORMAT_VERSION << "\ntrace " << trace << "\ntrace_identity " << size << " "
+                 << mtime_ns << "\nbranches "
+                 << (job.branches == SIZE_MAX ? std::string("all") : std::to_string(job.branches))
+                 << "\nkind " << sweepJobKindName(job.kind) << "\nformat "
+                 << (job.value_trace ? "values" : "branches") << "\ncomponents " << job.configs.size() << "\n";
+            for (const auto& c : job.configs) {
+                text << c.size << " " << c.ghist_bits << " " << c.index_bits << " " << c.tag_bits << " "
+                     << c.ahead << " " << c.select_bits << "\n";
+            }
+            writeAtomically(path, text.str());
+        }
+        unlink(errorPath(id).c_str());
+        return id;
+    }
+
+    std::vector<std::string> jobIds() const {
+        std::vector<std::string> ids;
+        for (const auto& entry : std::filesystem::directory_iterator(dir + "/jobs")) {
+            if (entry.path().extension() == ".job")
+                ids.push_back(entry.path().stem().string());
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    SweepJob job(const std::string& id) const {
+        std::ifstream in(dir + "/jobs/" + id + ".job");
+        std::string magic, key, branches;
+        unsigned version = 0;
+        SweepJob job;
+        size_t n = 0;
+        in >> magic >> version >> key;
+        if (!in || magic != "bvp-sweep-job" || version != FORMAT_VERSION || key != "trace") {
+            throw std::runtime_error("job " + id + " is missing or has an unknown format");
+        }
+        in.get();
+        std::getline(in, job.trace_path);
+        in >> key >> job.trace_size >> job.trace_mtime_ns >> key >> branches;
+        if (!in || (branches != "all" && branches.find_first_not_of("0123456789") != std::string::npos)) {
+            throw std::runtime_error("job " + id + " is truncated");
+        }
+        job.branches = (branches == "all") ? SIZE_MAX : std::stoull(branches);
+        std::string kind;
+        in >> key >> kind;
+        if (kind != "value" && kind != "branch") {
+            throw std::runtime_error("job " + id + " has an unknown kind");
+        }
+        job.kind = (kind == "branch") ? sweep_branch_job : sweep_value_job;
+        std::string format;
+        in >> key >> format;
+        if (format != "values" && format != "branches") {
+            throw std::runtime_error("job " + id + " has an unknown trace format");
+        }
+        job.value_trace = (format == "values");
+        in >> key >> n;
+        job.configs.resize(n);
+        for (auto& c : job.configs) {
+            in >> c.size >> c.ghist_bits >> c.index_bits >> c.tag_bits >> c.ahead >> c.select_bits;
+        }
+        if (!in) {
+            throw std::runtime_error("job " + id + " is truncated");
+        }
+        return job;
+    }
+
+    std::optional<SweepResult> result(const std::string& id) const {
+        std::ifstream in(dir + "/results/" + id + ".result");
+        if (!in)
+            return std::nullopt;
+        SweepResult r;
+        std::string key;
+        in >> key >> r.stats.values >> key >> r.stats.branches >> key;
+        for (uint64_t& c : r.stats.correct)
+            in >> c;
+        in >> key;
+        for (uint64_t& c : r.stats.incorrect)
+            in >> c;
+        in >> key >> r.stats.unpredicted_correct >> r.stats.unpredicted_incorrect;
+        in >> key >> std::hex >> r.state_hash;
+        if (!in) {
+            throw std::runtime_error("result of job " + id + " is truncated");
+        }
+        return r;
+    }
+
+    // Why the job failed, if it did.
+    std::optional<std::string> error(const std::string& id) const {
+        std::ifstream in(errorPath(id));
+        if (!in)
+            return std::nullopt;
+        std::string text;
+        std::getline(in, text);
+        return text;
+    }
+
+    std::vector<SweepJobStatus> status() const {
+        std::vector<SweepJobStatus> out;
+        for (const std::string& id : jobIds()) {
+            SweepJobStatus s{id, {}, sweep_pending, 0, {}};
+            std::optional<std::string> failure = error(id);
+            try {
+                s.job = job(id);
+            } catch (const std::runtime_error& e) {
+                failure = e.what();
+            }
+            if (failure) {
+                s.state = sweep_failed;
+                s.error = *failure;
+            } else if (hasResult(id)) {
+                s.state = sweep_done;
+            } else {
+                s.state = workerAlive(id) ? sweep_running : sweep_pending;
+                s.checkpointed = checkpointedRecords(id);
+            }
+            out.push_back(s);
+        }
+        return out;
+    }
+
+    // Runs pending jobs that no other worker holds until the queue is
+    // drained or the record budget is spent. A job that throws is recorded
+    // as failed and the next one is run. Jobs held by another worker are
+    // tried once more at the end, in case it has died or stopped meanwhile.
+    SweepRunReport run(const SweepRunOptions& options = SweepRunOptions()) {
+        if (options.checkpoint_interval == 0) {
+            throw std::invalid_argument("checkpoint_interval must be positive");
+        }
+        SweepRunReport report;
+        std::vector<std::string> ids = jobIds();
+        for (int pass = 0; pass < 2 && !ids.empty() && !report.budget_exhausted; pass++) {
+            std::vector<std::string> locked;
+            for (const std::string& id : ids) {
+                if (hasResult(id) || access(errorPath(id).c_str(), F_OK) == 0)
+                    continue;
+                if (report.records >= options.record_budget) {
+                    report.budget_exhausted = true;
+                    break;
+                }
+                try {
+                    JobLock lock(lockPath(id));
+                    if (!lock.held()) {
+                        locked.push_back(id);
+                        continue;
+                    }
+                    // Another worker may have finished it before we got the lock
+                    if (hasResult(id))
+                        continue;
+                    runJob(id, options, report);
+                } catch (const std::exception& e) {
+                    writeAtomically(errorPath(id), std::string(e.what()) + "\n");
+                    report.failed++;
+                }
+            }
+            ids.swap(locked);
+        }
+        return report;
+    }
+
+private:
+    static constexpr unsigned FORMAT_VERSION = 5;
+    static constexpr uint64_t CHECKPOINT_MAGIC = 0x54504b4350575342ull; // "BSWPCKPT"
+
+    // Holds an exclusive flock on path while alive, if it could get one, and
+    // then keeps the holder's pid in the file for status().
+    class JobLock {
+    public:
+        explicit JobLock(const std::string& path) {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+            }
+            locked = flock(fd, LOCK_EX | LOCK_NB) == 0;
+            if (locked) {
+                std::string pid = std::to_string(getpid()) + "\n";
+                if (ftruncate(fd, 0) != 0 || pwrite(fd, pid.data(), pid.size(), 0) != ssize_t(pid.size())) {
+                    int err = errno;
+                    ::close(fd);
+                    throw std::runtime_error("write " + path + ": " + std::strerror(err));
+                }
+            }
+        }
+        ~JobLock() {
+            // Clear the pid before releasing; if this fails status() sees a
+            // stale pid, which is only wrong until that process is gone
+            if (locked)
+                (void)!ftruncate(fd, 0);
+            ::close(fd);
+        }
+        JobLock(const JobLock&) = delete;
+        JobLock& operator=(const JobLock&) = delete;
+
+        bool held() const { return locked; }
+
+    private:
+        int fd;
+        bool locked;
+    };
+
+    std::string lockPath(const std::string& id) const { return dir + "/locks/" + id + ".lock"; }
+    std::string errorPath(const std::string& id) const { return dir + "/results/" + id + ".error"; }
+
+    // Whether the worker whose pid is in the job's lock file is still alive
+    bool workerAlive(const std::string& id) const {
+        std::ifstream in(lockPath(id));
+        pid_t pid = 0;
+        if (!(in >> pid) || pid <= 0)
+            return false;
+        return kill(pid, 0) == 0 || errno == EPERM;
+    }
+
+    static std::string absoluteTracePath(const std::string& path) {
+        return std::filesystem::absolute(path).lexically_normal().string();
+    }
+
+    // Size and modification time (ns) of the trace file.
+    static std::pair<uint64_t, uint64_t> traceIdentity(const std::string& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            throw std::runtime_error("stat " + path + ": " + std::strerror(errno));
+        }
+        return {uint64_t(st.st_size), uint64_t(st.st_mtim.tv_sec) * 1000000000 + uint64_t(st.st_mtim.tv_nsec)};
+    }
+    std::string checkpointPath(const std::string& id) const { return dir + "/checkpoints/" + id + ".ckpt"; }
+
+    bool hasResult(const std::string& id) const {
+        try {
+            return result(id).has_value();
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+
+    static void writeAtomically(const std::string& path, const std::string& contents) {
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("open " + tmp + ": " + std::strerror(errno));
+        }
+        const char* p = contents.data();
+        size_t left = contents.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            p += n;
+            left -= n;
+        }
+        bool ok = left == 0 && fsync(fd) == 0;
+        int err = errno;
+        ::close(fd);
+        if (!ok) {
+            unlink(tmp.c_str());
+            throw std::runtime_error("cannot write " + tmp + ": " + std::strerror(err));
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            err = errno;
+            unlink(tmp.c_str());
+            throw std::runtime_error("cannot rename " + tmp + ": " + std::strerror(err));
+        }
+        // Make the rename itself durable
+        std::string parent = std::filesystem::path(path).parent_path().string();
+        int dir_fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0 || fsync(dir_fd) != 0) {
+            err = errno;
+            if (dir_fd >= 0)
+                ::close(dir_fd);
+            throw std::runtime_error("cannot sync " + parent + ": " + std::strerror(err));
+        }
+        ::close(dir_fd);
+    }
+
+    // Checkpoint: magic, format version, job id hash, trace file identity,
+    // trace records, next record, the ReplayStats words, then the
+    // predictor's save() state.
+    static uint64_t idHash(const std::string& id) { return std::stoull(id, nullptr, 16); }
+
+    template <class Predictor>
+    void writeCheckpoint(const std::string& id, uint64_t trace_identity, size_t trace_size, size_t next,
+                         const ReplayStats& stats, const Predictor& vp) const {
+        std::ostringstream out;
+        for (uint64_t word : {CHECKPOINT_MAGIC, uint64_t(FORMAT_VERSION), idHash(id), trace_identity, uint64_t(trace_size),
+                              uint64_t(next), stats.values, stats.branches, stats.unpredicted_correct,
+                              stats.unpredicted_incorrect}) {
+            saveWord(out, word);
+        }
+        for (size_t c = 0; c < 3; c++) {
+            saveWord(out, stats.correct[c]);
+            saveWord(out, stats.incorrect[c]);
+        }
+        vp.save(out);
+        writeAtomically(checkpointPath(id), out.str());
+    }
+
+    // Restores vp and stats and returns the next record, or 0 when there is
+    // no usable checkpoint (vp and stats are then reset by the caller).
+    template <class Predictor>
+    size_t readCheckpoint(const std::string& id, uint64_t trace_identity, size_t trace_size, ReplayStats& stats,
+                          Predictor& vp) const {
+        std::ifstream in(checkpointPath(id), std::ios::binary);
+        if (!in)
+            return 0;
+        try {
+            if (loadWord(in) != CHECKPOINT_MAGIC || loadWord(in) != FORMAT_VERSION || loadWord(in) != idHash(id)
+                || loadWord(in) != trace_identity || loadWord(in) != trace_size)
+                return 0;
+            size_t next = loadWord(in);
+            stats.values = loadWord(in);
+            stats.branches = loadWord(in);
+            stats.unpredicted_correct = loadWord(in);
+            stats.unpredicted_incorrect = loadWord(in);
+            for (size_t c = 0; c < 3; c++) {
+                stats.correct[c] = loadWord(in);
+                stats.incorrect[c] = loadWord(in);
+            }
+            vp.load(in);
+            return next <= trace_size ? next : 0;
+        } catch (const std::runtime_error&) {
+            return 0;
+        }
+    }
+
+    uint64_t checkpointedRecords(const std::string& id) const {
+        std::ifstream in(checkpointPath(id), std::ios::binary);
+        try {
+            if (!in || loadWord(in) != CHECKPOINT_MAGIC || loadWord(in) != FORMAT_VERSION)
+                return 0;
+            loadWord(in);
+            loadWord(in);
+            loadWord(in);
+            return loadWord(in);
+        } catch (const std::runtime_error&) {
+            return 0;
+        }
+    }
+
+    void runJob(const std::string& id, const SweepRunOptions& options, SweepRunReport& report) {
+        SweepJob j = job(id);
+        if (traceIdentity(j.trace_path) != std::make_pair(j.trace_size, j.trace_mtime_ns)) {
+            throw std::runtime_error("trace " + j.trace_path + " has changed since the job was submitted");
+        }
+        auto trace = j.value_trace ? loadValueTrace(j.trace_path, j.branches)
+                                   : makeValueTraceFromBranches(j.trace_path, j.branches);
+        uint64_t identity = mixHash(j.trace_size, j.trace_mtime_ns);
+        if (j.kind == sweep_branch_job) {
+            replayJob(id, identity, trace, options, report,
+                      [&] { return std::make_unique<EqualityPredictor>(j.configs); });
+        } else {
+            ValuePredictorParams params;
+            params.components = j.configs;
+            replayJob(id, identity, trace, options, report, [&] { return std::make_unique<ValuePredictor>(params); });
+        }
+    }
+
+    // make() returns a fresh predictor in a unique_ptr.
+    template <class MakePredictor>
+    void replayJob(const std::string& id, uint64_t trace_identity, const std::vector<ValueTraceRecord>& trace,
+                   const SweepRunOptions& options, SweepRunReport& report, MakePredictor make) {
+        auto vp = make();
+        ReplayStats stats;
+        size_t next = readCheckpoint(id, trace_identity, trace.size(), stats, *vp);
+        if (next > 0) {
+            report.resumed++;
+        } else {
+            // A rejected checkpoint may have been partly loaded
+            vp = make();
+            stats = ReplayStats();
+        }
+
+        while (next < trace.size()) {
+            uint64_t left = options.record_budget - report.records;
+            size_t end = next + std::min<uint64_t>({trace.size() - next, options.checkpoint_interval, left});
+            for (size_t i = next; i < end; i++) {
+                replayRecord(*vp, trace[i], i, stats, nullptr);
+            }
+            report.records += end - next;
+            next = end;
+            if (next < trace.size()) {
+                writeCheckpoint(id, trace_identity, trace.size(), next, stats, *vp);
+                report.checkpoints++;
+                if (report.records >= options.record_budget) {
+                    report.budget_exhausted = true;
+                    return;
+                }
+            }
+        }
+
+        std::ostringstream text;
+        text << "values " << stats.values << "\nbranches " << stats.branches << "\ncorrect";
+        for (uint64_t c : stats.correct)
+            text << " " << c;
+        text << "\nincorrect";
+        for (uint64_t c : stats.incorrect)
+            text << " " << c;
+        text << "\nunpredicted " << stats.unpredicted_correct << " " << stats.unpredicted_incorrect;
+        text << "\nstate_hash " << std::hex << vp->stateHash() << "\n";
+        writeAtomically(dir + "/results/" + id + ".result", text.str());
+        unlink(checkpointPath(id).c_str());
+        report.completed++;
+    }
+
+    std::string dir;
+};
+
+inline void printSweepStatus(std::ostream& os, const std::vector<SweepJobStatus>& jobs) {
+    const char* states[4] = {"pending", "running", "done", "failed"};
+    for (const auto& s : jobs) {
+        if (s.job.trace_path.empty()) {      // the job file itself is unreadable
+            os << s.id << "  " << std::left << std::setw(8) << states[s.state] << std::right << "  " << s.error
+               << "\n";
+            continue;
+        }
+        os << s.id << "  " << std::left << std::setw(8) << states[s.state] << std::right << "  "
+           << sweepJobKindName(s.job.kind) << " job, " << s.job.configs.size() << " components, "
+           << (s.job.value_trace ? "value trace " : "") << s.job.trace_path;
+        if (s.job.branches != SIZE_MAX)
+            os << " (" << s.job.branches << " branches)";
+        if (s.state != sweep_done && s.checkpointed)
+            os << ", checkpoint at record " << s.checkpointed;
+        if (s.state == sweep_failed)
+            os << ": " << s.error;
+        os << "\n";
+    }
+}
+
+#endif // SWEEP_QUEUE_HH
@@ -141,6 +141,17 @@ int tagResult[NUM_BANKS];
 
 int8_t useAlternate = 8;
 
+// Optional access counters for the energy model: NUM_BANKS + 1 tables, the
+// banks first and the bimodal predictor last. NULL disables counting.
+typedef struct TageTableActivityStruct{
+    uint64_t reads;
+    uint64_t tagCompares;
+    uint64_t writes;
+    uint64_t allocations;
+} TageTableActivity;
+
+TageTableActivity* tage_activity = NULL;
+
 
 // Bimodal prediction. If tag miss in every table, use bimodal predictor result.
 uint8_t t_getBimodalPrediction(uint32_t pc){
@@ -263,6 +274,15 @@ uint8_t tage_predict(uint32_t pc){
         bankGlobalIndex[i] = getGlobalIndex(pc, i);
     }
 
+    // All banks and the bimodal table are read in parallel
+    if (tage_activity) {
+        for (int i = 0; i < NUM_BANKS; i++) {
+            tage_activity[i].reads++;
+            tage_activity[i].tagCompares++;
+        }
+        tage_activity[NUM_BANKS].reads++;
+    }
+
     primaryPrediction = NOTTAKEN;
     alternatePrediction = NOTTAKEN;
     primaryBank = NUM_BANKS;
@@ -360,6 +380,8 @@ void tage_train(uint32_t pc, uint8_t outcome) {
             // If there are no useful entry, make all corresponding entries a little bit not useful.
             for (int i = primaryBank - 1; i >= 0; i--) {
                 tageBank[i].entry[bankGlobalIndex[i]].usefulness--;
+                if (tage_activity)
+                    tage_activity[i].writes++;
             }
         } else {
             // Randomly allocate the entry to banks.
@@ -377,6 +399,8 @@ void tage_train(uint32_t pc, uint8_t outcome) {
                     tageBank[i].entry[bankGlobalIndex[i]].tag = generateGlobalEntryTag(pc, i);
                     tageBank[i].entry[bankGlobalIndex[i]].saturateCounter = (outcome == TAKEN) ? 0 : -1;
                     tageBank[i].entry[bankGlobalIndex[i]].usefulness = 0;
+                    if (tage_activity)
+                        tage_activity[i].allocations++;
                     break;
                 }
             }
@@ -391,6 +415,9 @@ void tage_train(uint32_t pc, uint8_t outcome) {
         updateSaturateMinMax(&(t_bimodalPredictor[BIMODAL_INDEX(pc)]), outcome, 0, (1 << LEN_BIMODAL) - 1);
 
     }
+    // Counter and usefulness share the entry, so one write covers both
+    if (tage_activity)
+        tage_activity[primaryBank].writes++;
 
     if ((lastPrediction != alternatePrediction)) {
         updateSaturateMinMax(&(tageBank[primaryBank].entry[bankGlobalIndex[primaryBank]].usefulness),
@@ -0,0 +1,94 @@
+#ifndef TAGE_ENGINE_HH
+#define TAGE_ENGINE_HH
+
+#include "vp.h"
+#include "vp_replay.h"
+#include "tage.h"
+#include "energy_model.h"
+#include <ostream>
+
+// Adapts the global reference TAGE in tage.h to the engine interface used by
+// replay and validation. tage.h keeps its state in globals, so only one
+// TageEngine can be live at a time; it is meant as the reference side when
+// validating a faster TAGE.
+class TageEngine {
+public:
+    explicit TageEngine(unsigned seed = 1) {
+        tage_init();
+        srand(seed);
+    }
+
+    uint64_t stateHash() const {
+        uint64_t h = mixHash(t_pathHistory, useAlternate);
+        for (size_t i = 0; i < BIMODAL_SIZE; i++) {
+            h = mixHash(h, uint8_t(t_bimodalPredictor[i]));
+        }
+        for (size_t i = 0; i < MAX_HISTORY_LEN; i++) {
+            h = mixHash(h, t_globalHistory[i]);
+        }
+        for (size_t b = 0; b < NUM_BANKS; b++) {
+            const Bank& bank = tageBank[b];
+            h = mixHash(h, bank.indexCompressed.compressed);
+            h = mixHash(h, bank.tagCompressed[0].compressed);
+            h = mixHash(h, bank.tagCompressed[1].compressed);
+            for (size_t j = 0; j < (1 << LEN_GLOBAL); j++) {
+                const BankEntry& e = bank.entry[j];
+                h = mixHash(h, (uint64_t(e.tag) << 16) | (uint8_t(e.saturateCounter) << 8) | uint8_t(e.usefulness));
+            }
+        }
+        return h;
+    }
+
+    // The reference TAGE is statically sized; these are its global arrays.
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix = "tage.") const {
+        for (size_t b = 0; b < NUM_BANKS; b++) {
+            fp.add(prefix + "bank" + std::to_string(b), sizeof(Bank));
+        }
+        fp.add(prefix + "bimodal", sizeof(t_bimodalPredictor));
+        fp.add(prefix + "history", sizeof(t_globalHistory) + sizeof(t_pathHistory));
+    }
+
+    // Prints the history registers and every bank entry that is not reset.
+    void dumpState(std::ostream& os) const {
+        os << "path_history=" << t_pathHistory << " use_alternate=" << int(useAlternate) << "\n";
+        for (size_t b = 0; b < NUM_BANKS; b++) {
+            const Bank& bank = tageBank[b];
+            os << "bank " << b << " index_fold=" << bank.indexCompressed.compressed
+               << " tag_fold=" << bank.tagCompressed[0].compressed << "," << bank.tagCompressed[1].compressed << "\n";
+            for (size_t j = 0; j < (1 << LEN_GLOBAL); j++) {
+                const BankEntry& e = bank.entry[j];
+                if (e.tag == 0 && e.saturateCounter == 0 && e.usefulness == 0)
+                    continue;
+                os << "  [" << j << "] tag=" << e.tag << " ctr=" << int(e.saturateCounter)
+                   << " u=" << int(e.usefulness) << "\n";
+            }
+        }
+    }
+};
+
+inline RecordPrediction stepRecord(TageEngine&, const ValueTraceRecord& rec, InstSeqNum) {
+    if (rec.kind != branch_record) {
+        return {false, Confidence::low, 0};
+    }
+
+    bool taken = tage_predict((uint32_t)rec.pc) == TAKEN;
+    tage_train((uint32_t)rec.pc, rec.taken ? TAKEN : NOTTAKEN);
+    return {true, Confidence::low, taken};
+}
+
+// Energy of the reference TAGE from counters collected through tage_activity
+// (NUM_BANKS + 1 entries, bimodal last).
+inline void addTageEnergy(EnergyReport& report, const TageTableActivity* activity,
+                          const EnergyModel& model = defaultEnergyModel()) {
+    for (int b = 0; b <= NUM_BANKS; b++) {
+        bool bimodal = (b == NUM_BANKS);
+        TableGeometry geometry{bimodal ? "bimodal" : "tage" + std::to_string(b),
+                               size_t(bimodal ? (BIMODAL_SIZE * LEN_BIMODAL + 7) / 8
+                                              : ((1 << LEN_GLOBAL) * (LEN_COUNTS + LEN_TAG + 2) + 7) / 8),
+                               size_t(bimodal ? 0 : LEN_TAG)};
+        TableActivity a{activity[b].reads, activity[b].tagCompares, activity[b].writes, activity[b].allocations};
+        addTableEnergy(report, geometry, a, model);
+    }
+}
+
+#endif // TAGE_ENGINE_HH
@@ -5,6 +5,34 @@
 #include <vector>
 #include <random>
 #include "tage.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include "lcvt_mmap.h"
+#include "vp_validate.h"
+#include "tage_engine.h"
+#include "ipc_model.h"
+#include "lcvt_sizing.h"
+#include <list>
+#include "vtage.h"
+#include "hybrid_vp.h"
+#include <sstream>
+#include <unistd.h>
+#include "energy_model.h"
+#include "hogwild_warmup.h"
+#include "vp_ablation.h"
+#include "prediction_stream.h"
+#include "vp_daemon.h"
+#include "shm_ring.h"
+#include "latency_histogram.h"
+#include "lcvt_hierarchy.h"
+#include "lcvt_admission.h"
+#include "kernel_cache.h"
+#include "rv64_emulator.h"
+#include "live_stats.h"
+#include "sweep_queue.h"
+#include <sys/wait.h>
+#include <thread>
+#include <chrono>
 
 // Test dual-counter behavior described in Section 5.1
 void test_dual_counter() {
@@ -362,6 +390,13 @@ void test_accuracy_on_trace() {
         return;
     }
     
+    // Live progress for bpstat when BPSTAT_PAGE names a shared memory object
+    std::unique_ptr<LiveStatsWriter> live;
+    if (const char* page = std::getenv("BPSTAT_PAGE")) {
+        live = std::make_unique<LiveStatsWriter>(page, "test_accuracy_on_trace trace_gcc.txt",
+                                                 std::vector<LivePredictorInfo>{{"equality", configs.size()}, {"tage", 0}});
+    }
+
     std::string address_str, outcome_str;
     while (file >> address_str >> outcome_str) {
         uint64_t address = std::stoull(address_str, nullptr, 16);
@@ -369,6 +404,11 @@ void test_accuracy_on_trace() {
 
         // Get prediction from EqualityPredictor
         auto [conf, eq_prediction] = eq.predict(address);
+        if (live) {
+            OverridingPrediction<bool> detail = eq.predictOverriding(address);
+            if (detail.has_provider)
+                live->recordProviderHit(0, detail.provider);
+        }
 
         // Get prediction from TAGE
         uint8_t tage_pred_value = tage_predict((uint32_t)address); 
@@ -398,6 +438,12 @@ void test_accuracy_on_trace() {
         }
         tage_total++;
 
+        if (live) {
+            live->addRecords();
+            live->recordPrediction(0, eq_prediction == taken, conf);
+            live->recordPrediction(1, tage_prediction == taken);
+        }
+
         if (eq_total % 100000 == 0) {
             double eq_accuracy = static_cast<double>(eq_correct) / eq_total;
             double eq_mpki = static_cast<double>(eq_wrong) / eq_total * 1000;
@@ -414,6 +460,8 @@ void test_accuracy_on_trace() {
     }
 
     file.close();
+    if (live)
+        live->finish();
 
     // Final accuracy results
     double final_eq_accuracy = static_cast<double>(eq_correct) / eq_total;
@@ -428,6 +476,1787 @@ void test_accuracy_on_trace() {
               << ", MPKI: " << final_tage_mpki << "\n";
 }
 
+// The coroutine replay must see exactly what the sequential replay sees
+void test_interleaved_replay() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 100000);
+
+    ValuePredictor seq_vp({});
+    PredictionLog seq_log;
+    ReplayStats seq = replayValueTrace(seq_vp, trace, &seq_log);
+
+    for (size_t group : {1, 3, 8}) {
+        ValuePredictor amac_vp({});
+        PredictionLog amac_log;
+        ReplayStats amac = replayValueTraceInterleaved(amac_vp, trace, group, &amac_log);
+
+        assert(amac == seq);
+        assert(amac_log == seq_log);
+    }
+
+    std::cout << "Interleaved replay test passed. Values: " << seq.values
+              << ", high confidence correct: " << seq.correct[high] << "\n";
+}
+
+// The mapped LCVT must behave like the in-memory one and persist its contents
+void test_mapped_lcvt() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    std::string path = "/tmp/test_lcvt_" + std::to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+
+    ValuePredictor reference_vp({});
+    ReplayStats reference = replayValueTrace(reference_vp, trace);
+
+    {
+        // Small initial table and hot cache so growth and eviction are exercised
+        BasicValuePredictor<MappedLastCommittedValueTable> mapped_vp({}, path, 16, 64);
+        ReplayStats mapped = replayValueTrace(mapped_vp, trace);
+        assert(mapped == reference);
+    }
+
+    LastCommittedValueTable expected;
+    for (const auto& rec : trace) {
+        if (rec.kind == value_record)
+            expected.update(rec.pc, rec.value);
+    }
+    MappedLastCommittedValueTable reopened(path);
+    for (const auto& rec : trace) {
+        assert(reopened.hasValue(rec.pc) == expected.hasValue(rec.pc));
+        assert(reopened.lookup(rec.pc) == expected.lookup(rec.pc));
+    }
+    unlink(path.c_str());
+
+    {
+        // The largest pc cannot be stored as pc + 1 and is kept aside; it
+        // survives growth and reopening
+        {
+            MappedLastCommittedValueTable table(path, 16, 0);
+            table.update(~PC(0), 7);
+            table.update(0, 3);
+            assert(table.hasValue(~PC(0)) && table.lookup(~PC(0)) == 7 && table.lookup(0) == 3);
+            for (PC pc = 1; pc <= 100; pc++)
+                table.update(pc * 64, pc);
+            table.update(~PC(0), 8);
+            assert(table.size() == 102);
+            LastCommittedValueTable same;
+            same.update(~PC(0), 8);
+            same.update(0, 3);
+            for (PC pc = 1; pc <= 100; pc++)
+                same.update(pc * 64, pc);
+            assert(table.stateHash() == same.stateHash());
+        }
+        MappedLastCommittedValueTable table(path, 16, 0);
+        assert(table.lookup(~PC(0)) == 8 && table.lookup(64 * 100) == 100 && !table.hasValue(~PC(0) - 1));
+
+        // A failed grow leaves the table usable
+        unlink(path.c_str());
+        mkdir(path.c_str(), 0700);
+        std::ofstream(path + "/block") << "x";
+        bool failed = false;
+        try {
+            for (PC pc = 101; pc <= 1000; pc++)
+                table.update(pc * 64, pc);
+        } catch (const std::runtime_error&) {
+            failed = true;
+        }
+        assert(failed && table.lookup(64 * 100) == 100 && table.lookup(~PC(0)) == 8);
+        std::filesystem::remove_all(path);
+    }
+
+    std::cout << "Mapped LCVT test passed. Entries: " << reopened.size() << "\n";
+}
+
+void test_lockstep_validation() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 20000);
+    std::string path = "/tmp/test_validate_" + std::to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+
+    // Two LCVT backends must agree on every prediction and on the full state
+    {
+        ValuePredictor ref({});
+        BasicValuePredictor<MappedLastCommittedValueTable> cand({}, path, 64, 16);
+        ValidationOptions options;
+        options.hash_interval = 1000;
+        ValidationReport report = validateLockstep(ref, cand, trace, options);
+        assert(report.identical);
+        assert(report.records == trace.size());
+    }
+    unlink(path.c_str());
+
+    // A candidate with different tag bits must be caught, with both states dumped
+    std::vector<ComponentConfig> configs = {{256, 0, 8, 0}, {256, 8, 8, 8}, {256, 32, 8, 8}};
+    std::vector<ComponentConfig> altered = {{256, 0, 8, 0}, {256, 8, 8, 7}, {256, 32, 8, 8}};
+    EqualityPredictor ref(configs, 42);
+    EqualityPredictor cand(altered, 42);
+    std::ostringstream dump;
+    ValidationOptions options;
+    options.hash_interval = 1;
+    options.dump = &dump;
+    ValidationReport report = validateLockstep(ref, cand, trace, options);
+    assert(!report.identical);
+    assert(report.first_divergence + 1 == report.records);
+    assert(dump.str().find("--- candidate state ---") != std::string::npos);
+
+    // The global reference TAGE replays identically once reseeded
+    uint64_t hashes[2];
+    for (auto& h : hashes) {
+        TageEngine tage(7);
+        for (size_t i = 0; i < trace.size(); i++) {
+            stepRecord(tage, trace[i], i);
+        }
+        h = tage.stateHash();
+    }
+    assert(hashes[0] == hashes[1]);
+
+    std::cout << "Lockstep validation test passed. Altered config diverged at record "
+              << report.first_divergence << " (" << report.reason << ")\n";
+}
+
+void test_ipc_model() {
+    // 100 correct / 1 wrong at high, 50 / 10 at medium, 10 / 40 at low
+    ReplayStats stats;
+    stats.correct[high] = 100;
+    stats.incorrect[high] = 1;
+    stats.correct[medium] = 50;
+    stats.incorrect[medium] = 10;
+    stats.correct[low] = 10;
+    stats.incorrect[low] = 40;
+
+    LatencyModelParams params;
+    params.load_latency = 5;
+    params.dependency_distance = 1;
+    params.flush_penalty = 20;
+
+    // Saved 4 cycles per hit: high nets 380, adding medium costs 200 - 200 = 0
+    IpcEstimate est = estimateIpcImpact(stats, 10000, params);
+    assert(est.net_gain[high] == 380);
+    assert(est.net_gain[medium] == 380);
+    assert(est.net_gain[low] == 380 + 40 - 800);
+    assert(est.use_predictions && est.best_threshold == high);
+
+    // With a cheap flush, using medium predictions pays off
+    params.flush_penalty = 2;
+    est = estimateIpcImpact(stats, 10000, params);
+    assert(est.best_threshold == medium || est.best_threshold == low);
+    assert(est.speedup > 1.0);
+
+    // Never worth it when a prediction saves nothing
+    params.dependency_distance = 10;
+    est = estimateIpcImpact(stats, 10000, params);
+    assert(!est.use_predictions && est.speedup == 1.0 && est.valid);
+
+    // Records with no prediction count for nothing at the low threshold:
+    // 8 of the low wrong and 6 of the low right ones made none
+    stats.unpredicted_correct = 6;
+    stats.unpredicted_incorrect = 8;
+    params.dependency_distance = 1;
+    params.flush_penalty = 20;
+    est = estimateIpcImpact(stats, 10000, params);
+    assert(est.net_gain[high] == 380 && est.net_gain[medium] == 380);
+    assert(est.net_gain[low] == 380 + 4 * 4 - 32 * 20);
+
+    // A gain beyond the baseline cycles is flagged rather than turned into
+    // a speedup
+    est = estimateIpcImpact(stats, 100, params);
+    assert(!est.valid && est.use_predictions && est.speedup == 1.0);
+
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 200000);
+    ValuePredictor vp({});
+    ReplayStats replay = replayValueTrace(vp, trace);
+    assert(replay.unpredicted_correct + replay.unpredicted_incorrect > 0);
+    assert(replay.unpredicted_correct <= replay.correct[low] && replay.unpredicted_incorrect <= replay.incorrect[low]);
+    std::cout << "Modeled IPC impact on the gcc-derived value trace (default latencies):\n";
+    printIpcEstimate(std::cout, estimateIpcImpact(replay, trace.size()), trace.size());
+
+    std::cout << "IPC model test passed\n";
+}
+
+// The ahead fold must equal a plain fold of the history k branches ago,
+// also across squashes
+void test_ahead_pipelined_path() {
+    const size_t k = 3;
+    PathTracker ahead_pt(16, 5, 6, k, 2);
+    std::vector<bool> outcomes;
+    for (int i = 0; i < 300; i++) {
+        bool outcome = (rand() % 3) != 0;
+        outcomes.push_back(outcome);
+        ahead_pt.addBranch(outcome);
+
+        if (i % 37 == 36) {
+            ahead_pt.revertBranches(5);
+            outcomes.resize(outcomes.size() - 5);
+        }
+
+        PathTracker delayed(16, 5, 6);
+        for (size_t j = 0; j + k < outcomes.size(); j++) {
+            delayed.addBranch(outcomes[j]);
+        }
+        assert(ahead_pt.ahead_folded_path == delayed.folded_path);
+        assert(ahead_pt.getTag(0x1234) == delayed.getTag(0x1234));
+
+        // Set bits come from the old history, the low select bits from the newest outcomes
+        unsigned recent = 0;
+        for (size_t j = 0; j < 2 && j < outcomes.size(); j++) {
+            recent |= outcomes[outcomes.size() - 1 - j] << j;
+        }
+        unsigned hashed = 0x1234 ^ (0x1234 >> 2) ^ (0x1234 >> 5);
+        assert((ahead_pt.getIndex(0x1234) & ~3u) == (delayed.getIndex(0x1234) & ~3u));
+        assert((ahead_pt.getIndex(0x1234) & 3u) == ((hashed ^ recent) & 3u));
+    }
+
+    // Accuracy cost of hiding the latest branches from the lookup
+    std::ifstream file("trace_gcc.txt");
+    std::vector<std::pair<PC, bool>> branches;
+    std::string address_str, outcome_str;
+    while (branches.size() < 300000 && file >> address_str >> outcome_str) {
+        branches.push_back({std::stoull(address_str, nullptr, 16), outcome_str == "t"});
+    }
+    std::cout << "Ahead pipelining on " << branches.size() << " branches:\n";
+    for (size_t depth : {0, 1, 2, 4}) {
+        std::vector<ComponentConfig> configs = {{2048, 0, 11, 0}};
+        for (size_t ghist : {2, 4, 8, 16, 32, 64, 128}) {
+            configs.push_back({512, ghist, 9, 12, depth, std::min<size_t>(depth, 1)});
+        }
+        EqualityPredictor eq(configs);
+        long wrong = 0;
+        for (auto [address, taken] : branches) {
+            if (eq.predict(address).second != taken)
+                wrong++;
+            eq.onValueCommit(address, taken);
+            eq.updateOnBranch(0, taken);
+            eq.onBranchCommit(0);
+        }
+        std::cout << "  ahead " << depth << ": MPKI " << 1000.0 * wrong / branches.size() << "\n";
+    }
+
+    std::cout << "Ahead-pipelined path test passed\n";
+}
+
+// One-pass stack distances must match simulating each LRU geometry directly
+void test_lcvt_sizing_curve() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 100000);
+    std::vector<size_t> set_counts = {16, 64, 256};
+    LcvtSizingCurve curve = analyzeLcvtSizing(trace, set_counts, 8);
+
+    for (size_t g = 0; g < set_counts.size(); g++) {
+        for (size_t ways : {1, 2, 4, 8}) {
+            std::vector<std::list<PC>> sets(set_counts[g]);
+            LastCommittedValueTable last_values;
+            uint64_t hits = 0;
+            uint64_t equal_hits = 0;
+            for (const auto& rec : trace) {
+                if (rec.kind != value_record)
+                    continue;
+                bool equal = last_values.hasValue(rec.pc) && last_values.lookup(rec.pc) == rec.value;
+                last_values.update(rec.pc, rec.value);
+
+                auto& set = sets[lcvtSetIndex(rec.pc, set_counts[g])];
+                auto it = std::find(set.begin(), set.end(), rec.pc);
+                if (it != set.end()) {
+                    hits++;
+                    equal_hits += equal;
+                    set.erase(it);
+                } else if (set.size() == ways) {
+                    set.pop_back();
+                }
+                set.push_front(rec.pc);
+            }
+            assert(hits == curve.hitsWithin(curve.hits[g], ways));
+            assert(equal_hits == curve.hitsWithin(curve.equal_hits[g], ways));
+        }
+    }
+
+    std::cout << "LCVT sizing curve on the gcc-derived value trace:\n";
+    printLcvtSizing(std::cout, curve);
+    std::cout << "LCVT sizing curve test passed\n";
+}
+
+// VTAGE must learn values that depend on the branch history, which the
+// last-value predictor cannot
+void test_vtage_context_values() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 200000);
+
+    // Context-dependent values are the (vpc >> 2) % 4 == 2 class of the generated trace
+    auto context_correct_high = [&](auto& vp) {
+        uint64_t correct = 0;
+        for (size_t i = 0; i < trace.size(); i++) {
+            RecordPrediction pred = stepRecord(vp, trace[i], i);
+            if (pred.valid && (trace[i].pc >> 2) % 4 == 2 && pred.confidence == high
+                && pred.value == trace[i].value)
+                correct++;
+        }
+        return correct;
+    };
+
+    ValuePredictor lcvt_vp({});
+    VTagePredictor vtage;
+    uint64_t lcvt_correct = context_correct_high(lcvt_vp);
+    uint64_t vtage_correct = context_correct_high(vtage);
+    assert(vtage_correct > lcvt_correct);
+
+    VTagePredictor replayed;
+    ReplayStats stats = replayValueTrace(replayed, trace);
+    assert(double(stats.correct[high]) / (stats.correct[high] + stats.incorrect[high]) > 0.95);
+
+    std::cout << "VTAGE context value test passed. Correct high-confidence context values: LCVT "
+              << lcvt_correct << ", VTAGE " << vtage_correct << "\n";
+}
+
+// The stride engine must cover induction variables, and the chooser must
+// not lose what last-value prediction already gets right
+void test_hybrid_stride_predictor() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 200000);
+
+    // Strided values are the (vpc >> 2) % 4 == 1 class of the generated trace
+    auto correct_high = [&](auto& vp, uint64_t& strided) {
+        ReplayStats stats;
+        strided = 0;
+        for (size_t i = 0; i < trace.size(); i++) {
+            RecordPrediction pred = stepRecord(vp, trace[i], i);
+            if (!pred.valid)
+                continue;
+            bool correct = pred.value == trace[i].value;
+            (correct ? stats.correct : stats.incorrect)[pred.confidence]++;
+            if (correct && pred.confidence == high && (trace[i].pc >> 2) % 4 == 1)
+                strided++;
+        }
+        return stats;
+    };
+
+    uint64_t lcvt_strided, hybrid_strided, full_strided;
+    ValuePredictor lcvt_vp({});
+    HybridValuePredictor hybrid;
+    HybridValuePredictor full({.use_context_engine = true});
+    ReplayStats lcvt_stats = correct_high(lcvt_vp, lcvt_strided);
+    ReplayStats hybrid_stats = correct_high(hybrid, hybrid_strided);
+    ReplayStats full_stats = correct_high(full, full_strided);
+
+    assert(hybrid_strided > 10 * (lcvt_strided + 1));
+    assert(hybrid_stats.correct[high] > lcvt_stats.correct[high]);
+    assert(full_stats.correct[high] > hybrid_stats.correct[high]);
+    assert(double(full_stats.incorrect[high]) / full_stats.correct[high] < 0.05);
+
+    std::cout << "Hybrid stride predictor test passed. Correct high-confidence values (strided): LCVT "
+              << lcvt_stats.correct[high] << " (" << lcvt_strided << "), last value + stride "
+              << hybrid_stats.correct[high] << " (" << hybrid_strided << "), + VTAGE "
+              << full_stats.correct[high] << " (" << full_strided << ")\n";
+}
+
+void test_banked_prediction_groups() {
+    // Four value-producing instructions per branch, so fetch groups fill up
+    std::vector<ValueTraceRecord> trace;
+    for (const auto& rec : makeValueTraceFromBranches("trace_gcc.txt", 50000)) {
+        trace.push_back(rec);
+        if (rec.kind == value_record) {
+            for (PC offset : {0x40, 0x80, 0xc0}) {
+                trace.push_back({value_record, false, rec.pc + offset, rec.value + offset});
+            }
+        }
+    }
+
+    // Enough ports for the whole group: no conflicts
+    BankConflictStats unlimited_stats;
+    ValuePredictor unlimited({});
+    ReplayStats reference = replayValueTraceGrouped(unlimited, trace, 8, {.banks = 1, .read_ports = 8}, unlimited_stats);
+    assert(unlimited_stats.predictions_with_conflict == 0);
+    assert(unlimited_stats.predictions == reference.values);
+
+    // Reporting losers must not change any prediction
+    BankConflictStats reported_stats;
+    ValuePredictor reported({});
+    ReplayStats reported_replay = replayValueTraceGrouped(reported, trace, 8, {.banks = 2, .read_ports = 1}, reported_stats);
+    assert(reported_replay == reference);
+    assert(reported_stats.predictions_with_conflict > 0);
+
+    std::cout << "Bank conflicts, 8-wide fetch groups, 1 read port per bank:\n";
+    for (size_t banks : {1, 2, 4, 8}) {
+        BankConflictStats bank_stats;
+        ValuePredictor vp({});
+        ReplayStats stats = replayValueTraceGrouped(vp, trace, 8, {.banks = banks, .read_ports = 1, .drop_losers = true}, bank_stats);
+        assert(stats.correct[high] <= reference.correct[high]);
+        std::cout << "  " << banks << " banks: " << 100.0 * bank_stats.predictions_with_conflict / bank_stats.predictions
+                  << "% of predictions lose a port, high-confidence correct " << stats.correct[high]
+                  << " (unlimited " << reference.correct[high] << ")\n";
+    }
+
+    // Models the bit masks and port arrays cannot represent are rejected
+    bool rejected = false;
+    try {
+        BankConflictStats no_ports;
+        ValuePredictor vp({});
+        replayValueTraceGrouped(vp, trace, 8, {.banks = 1, .read_ports = 0}, no_ports);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    assert(rejected);
+    rejected = false;
+    try {
+        EqualityPredictor too_many(std::vector<ComponentConfig>(65, {256, 8, 8, 10}));
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    std::cout << "Banked prediction group test passed\n";
+}
+
+void test_overriding_prediction() {
+    std::vector<ComponentConfig> configs = {
+        {2048, 0, 11, 0},
+        {512, 4, 9, 12},
+        {512, 16, 9, 12},
+        {512, 64, 9, 12}
+    };
+    EqualityPredictor eq(configs);
+    OverrideStats branch_stats;
+
+    std::ifstream file("trace_gcc.txt");
+    std::string address_str, outcome_str;
+    for (int i = 0; i < 300000 && file >> address_str >> outcome_str; i++) {
+        PC address = std::stoull(address_str, nullptr, 16);
+        bool taken = (outcome_str == "t");
+
+        auto pred = eq.predictOverriding(address);
+        assert(pred.full == eq.predict(address));
+        branch_stats.record(pred, taken);
+
+        eq.onValueCommit(address, taken);
+        eq.updateOnBranch(0, taken);
+        eq.onBranchCommit(0);
+    }
+
+    uint64_t by_component = 0;
+    for (uint64_t n : branch_stats.overrides_by_component)
+        by_component += n;
+    assert(by_component == branch_stats.overrides);
+    assert(branch_stats.overrides_by_component.empty() || branch_stats.overrides_by_component[0] == 0);
+    assert(branch_stats.full_correct > branch_stats.fast_correct);
+
+    std::cout << "Overriding on " << branch_stats.predictions << " branches: fast accuracy "
+              << double(branch_stats.fast_correct) / branch_stats.predictions << ", full accuracy "
+              << double(branch_stats.full_correct) / branch_stats.predictions << ", late overrides "
+              << branch_stats.overrides << " (fixed " << branch_stats.fixed << ", broken "
+              << branch_stats.broken << ")\n  by component:";
+    for (size_t c = 0; c < branch_stats.overrides_by_component.size(); c++)
+        std::cout << " " << branch_stats.overrides_by_component[c];
+    std::cout << "\n";
+
+    // Value predictions: the full answer must be what predict() returns
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    ValuePredictor vp({});
+    OverrideStats value_stats;
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (trace[i].kind == value_record) {
+            auto pred = vp.predictOverriding(trace[i].pc);
+            assert(pred.full == vp.predict(trace[i].pc));
+            value_stats.record(pred, trace[i].value);
+        }
+        stepRecord(vp, trace[i], i);
+    }
+    assert(value_stats.predictions == 50000);
+    assert(value_stats.overrides > 0);
+
+    std::cout << "Overriding prediction test passed\n";
+}
+
+void test_silent_write_filter() {
+    // A saturated taken counter that sees another taken outcome is rewritten unchanged
+    EqualityPredictor eq({{16, 0, 4, 0}});
+    for (int i = 0; i < 20; i++) {
+        eq.onValueCommit(0x40, true);
+    }
+    assert(eq.writeStats()[0].real == 7);
+    assert(eq.writeStats()[0].silent == 13);
+    eq.setSilentWriteFilter(true);
+    eq.onValueCommit(0x40, true);
+    assert(eq.writeStats()[0].silent == 13 && eq.writeStats()[0].suppressed == 1);
+
+    // Filtering must not change predictions or state
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    ValuePredictor unfiltered({});
+    ValuePredictor filtered({});
+    filtered.setSilentWriteFilter(true);
+    ValidationOptions options;
+    options.hash_interval = 1000;
+    ValidationReport report = validateLockstep(unfiltered, filtered, trace, options);
+    assert(report.identical);
+
+    uint64_t unfiltered_writes = 0, filtered_writes = 0, suppressed = 0;
+    std::cout << "Writes per component (real/silent/allocations, unfiltered):";
+    for (size_t c = 0; c < unfiltered.writeStats().size(); c++) {
+        const WriteStats& u = unfiltered.writeStats()[c];
+        const WriteStats& f = filtered.writeStats()[c];
+        std::cout << " " << u.real << "/" << u.silent << "/" << u.allocations;
+        assert(u.real == f.real && u.allocations == f.allocations);
+        assert(u.silent == f.suppressed && f.silent == 0);
+        unfiltered_writes += u.physicalWrites();
+        filtered_writes += f.physicalWrites();
+        suppressed += f.suppressed;
+    }
+    std::cout << "\n  physical writes " << unfiltered_writes << " -> " << filtered_writes
+              << " with the filter (" << suppressed << " silent updates dropped)\n";
+    assert(filtered_writes < unfiltered_writes);
+
+    std::cout << "Silent write filter test passed\n";
+}
+
+void test_energy_model() {
+    EnergyModel model = defaultEnergyModel();
+    SramEnergyPoint mid = model.at(2048);
+    assert(mid.read_pj > model.at(1024).read_pj && mid.read_pj < model.at(4096).read_pj);
+    assert(std::abs(mid.read_pj - (0.45 + 0.90) / 2) < 1e-9);
+    assert(model.at(1 << 30).read_pj == model.points.back().read_pj);
+
+    std::vector<ComponentConfig> configs = {
+        {2048, 0, 11, 0},
+        {512, 4, 9, 12},
+        {512, 16, 9, 12},
+        {512, 64, 9, 12}
+    };
+    EqualityPredictor eq(configs);
+    std::vector<TableActivity> ep_activity;
+    eq.setActivityCounters(&ep_activity);
+
+    TageTableActivity tage_counters[NUM_BANKS + 1] = {};
+    TageEngine tage;
+    tage_activity = tage_counters;
+
+    uint64_t branches = 0, ep_miss = 0, tage_miss = 0;
+    std::ifstream file("trace_gcc.txt");
+    std::string address_str, outcome_str;
+    for (; branches < 200000 && file >> address_str >> outcome_str; branches++) {
+        PC address = std::stoull(address_str, nullptr, 16);
+        bool taken = (outcome_str == "t");
+
+        ep_miss += eq.predict(address).second != taken;
+        eq.onValueCommit(address, taken);
+        eq.updateOnBranch(0, taken);
+        eq.onBranchCommit(0);
+
+        tage_miss += (tage_predict((uint32_t)address) == TAKEN) != taken;
+        tage_train((uint32_t)address, taken ? TAKEN : NOTTAKEN);
+    }
+    tage_activity = NULL;
+
+    // Every component is looked up at prediction and again at commit
+    for (size_t c = 0; c < configs.size(); c++) {
+        assert(ep_activity[c].reads == 2 * branches);
+        assert(ep_activity[c].tag_compares == (c == 0 ? 0 : 2 * branches));
+        assert(ep_activity[c].writes <= eq.writeStats()[c].physicalWrites());
+    }
+    assert(tage_counters[0].reads == branches && tage_counters[NUM_BANKS].reads == branches);
+
+    // Turning counting off leaves the counters untouched
+    std::vector<TableActivity> before = ep_activity;
+    eq.setActivityCounters(nullptr);
+    eq.predict(0x1234);
+    assert(ep_activity[0].reads == before[0].reads);
+
+    EnergyReport ep_report;
+    std::vector<TableGeometry> geometry = equalityPredictorGeometry(configs);
+    for (size_t c = 0; c < configs.size(); c++)
+        addTableEnergy(ep_report, geometry[c], ep_activity[c], model);
+    EnergyReport tage_report;
+    addTageEnergy(tage_report, tage_counters, model);
+    assert(ep_report.totalPj() > 0 && tage_report.totalPj() > 0);
+
+    // Branches stand in for instructions here
+    std::cout << "EqualityPredictor energy on " << branches << " branches:\n";
+    printEnergyReport(std::cout, ep_report, branches, branches, 1000.0 * ep_miss / branches);
+    std::cout << "TAGE energy:\n";
+    printEnergyReport(std::cout, tage_report, branches, branches, 1000.0 * tage_miss / branches);
+
+    // Value predictor: the LCVT is read at prediction and read and written at commit
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 20000);
+    ValuePredictor vp({});
+    std::vector<TableActivity> vp_activity;
+    TableActivity lcvt_activity;
+    vp.setActivityCounters(&vp_activity, &lcvt_activity);
+    ReplayStats stats = replayValueTrace(vp, trace);
+    assert(lcvt_activity.reads == 2 * stats.values && lcvt_activity.writes + lcvt_activity.allocations == stats.values);
+    assert(lcvt_activity.allocations == vp.lcvtSize());
+    EnergyReport vp_report = estimateValuePredictorEnergy(vp.configs(), vp_activity, vp.lcvtSize(), lcvt_activity);
+    uint64_t wrong = stats.incorrect[Confidence::high];
+    std::cout << "ValuePredictor energy on " << stats.values << " values:\n";
+    printEnergyReport(std::cout, vp_report, trace.size(), stats.values, 1000.0 * wrong / trace.size());
+
+    std::cout << "Energy model test passed\n";
+}
+
+void test_hogwild_warmup() {
+    std::vector<ComponentConfig> configs = {
+        {2048, 0, 11, 0},
+        {512, 4, 9, 12},
+        {512, 16, 9, 12},
+        {512, 64, 9, 12}
+    };
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 500000);
+    std::vector<ValueTraceRecord> warm(trace.begin(), trace.begin() + 800000);
+    std::vector<ValueTraceRecord> measure(trace.begin() + 800000, trace.end());
+
+    // One thread is an exact serial warmup
+    EqualityPredictor serial(configs);
+    for (size_t i = 0; i < warm.size(); i++) {
+        stepRecord(serial, warm[i], i);
+    }
+    EqualityPredictor single(configs);
+    hogwildWarmup(single, warm, 1);
+    for (size_t c = 0; c < configs.size(); c++) {
+        for (size_t i = 0; i < configs[c].size; i++) {
+            const EqualityPredictorEntry& a = serial.entryAt(c, i);
+            const EqualityPredictorEntry& b = single.entryAt(c, i);
+            assert(a.tag == b.tag && a.taken_counter == b.taken_counter && a.not_taken_counter == b.not_taken_counter);
+        }
+    }
+    assert(stepRecord(serial, measure[0], 0) == stepRecord(single, measure[0], 0));
+
+    HogwildReport report = compareHogwildWarmup(configs, warm, measure, 4);
+    std::cout << "Hogwild warmup with " << report.threads << " threads ("
+              << std::thread::hardware_concurrency() << " CPUs): " << report.serial_seconds << "s serial, "
+              << report.hogwild_seconds << "s hogwild, speedup " << report.speedup
+              << "\n  accuracy after serial warmup " << report.serial_accuracy << ", after hogwild warmup "
+              << report.hogwild_accuracy << " (drift " << report.drift << ")\n";
+    assert(std::abs(report.drift) < 0.01);
+
+    std::cout << "Hogwild warmup test passed\n";
+}
+
+void test_ablation() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    AblationResult r = runAblation(trace);
+    assert(r.without.size() == defaultValuePredictorConfig().size() - 1);
+
+    // Each variant must match a separately configured predictor
+    ValuePredictor full({});
+    assert(r.full == replayValueTrace(full, trace));
+    for (size_t k = 0; k < r.without.size(); k++) {
+        ValuePredictorParams params;
+        params.components.erase(params.components.begin() + k + 1);
+        ValuePredictor reduced(params);
+        assert(r.without[k] == replayValueTrace(reduced, trace));
+    }
+
+    std::cout << "Leave-one-out ablation on " << r.full.values << " values:\n";
+    printAblation(std::cout, r);
+    std::cout << "Ablation test passed\n";
+}
+
+void test_prediction_stream() {
+    std::string path = "/tmp/test_stream_" + std::to_string(getpid()) + ".bin";
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+
+    // Value predictor: value records are predicted, branches are not. Each
+    // record is predicted once, as in a plain replay.
+    ValuePredictor vp({});
+    std::vector<TableActivity> activity, fresh_activity;
+    TableActivity lcvt_activity, fresh_lcvt_activity;
+    vp.setActivityCounters(&activity, &lcvt_activity);
+    ReplayStats written = writePredictionStream(vp, trace, path);
+    ValuePredictor fresh({});
+    fresh.setActivityCounters(&fresh_activity, &fresh_lcvt_activity);
+    assert(written == replayValueTrace(fresh, trace));
+    assert(vp.stateHash() == fresh.stateHash());
+    assert(lcvt_activity.reads == fresh_lcvt_activity.reads);
+    for (size_t c = 0; c < activity.size(); c++)
+        assert(activity[c].reads == fresh_activity[c].reads && activity[c].writes == fresh_activity[c].writes);
+
+    // With an LCVT whose prediction reads move entries, the stream scores the
+    // same read that a replay does
+    {
+        TwoLevelLcvtConfig config;
+        config.l1 = {16, 2, 1};
+        config.l2 = {64, 4, 4};
+        BasicValuePredictor<TwoLevelLastCommittedValueTable> streamed({}, config);
+        BasicValuePredictor<TwoLevelLastCommittedValueTable> replayed({}, config);
+        assert(writePredictionStream(streamed, trace, path + ".l2") == replayValueTrace(replayed, trace));
+        assert(streamed.stateHash() == replayed.stateHash());
+        unlink((path + ".l2").c_str());
+    }
+    {
+        PredictionStreamReader stream(path);
+        assert(stream.size() == trace.size());
+        assert(stream.configHash() == componentConfigHash(defaultValuePredictorConfig()));
+        assert(replayPredictionStream(stream, trace) == written);
+        for (size_t i = 0; i < trace.size(); i++) {
+            assert(stream[i].valid() == (trace[i].kind == value_record));
+            assert(!stream[i].valid() || (stream[i].flags & PredictionStreamRecord::has_provider));
+        }
+    }
+
+    // EqualityPredictor as a branch predictor
+    std::vector<ComponentConfig> configs = {
+        {2048, 0, 11, 0},
+        {512, 4, 9, 12},
+        {512, 16, 9, 12}
+    };
+    EqualityPredictor ep(configs);
+    ReplayStats branch_stats = writePredictionStream(ep, trace, path);
+    {
+        PredictionStreamReader stream(path);
+        assert(stream.configHash() == componentConfigHash(configs));
+        assert(stream.configHash() != componentConfigHash(defaultValuePredictorConfig()));
+        assert(replayPredictionStream(stream, trace) == branch_stats);
+        assert(stream[0].valid() && !stream[1].valid());
+    }
+
+    // A record with a confidence out of range is rejected when scored
+    {
+        std::fstream patch(path, std::ios::in | std::ios::out | std::ios::binary);
+        patch.seekp(sizeof(prediction_stream::Header) + offsetof(PredictionStreamRecord, confidence));
+        patch.put(char(200));
+    }
+    bool rejected = false;
+    try {
+        PredictionStreamReader stream(path);
+        replayPredictionStream(stream, trace);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // A file that is not a stream is rejected
+    { std::ofstream junk(path); junk << "not a stream, just some text\n"; }
+    rejected = false;
+    try {
+        PredictionStreamReader stream(path);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    unlink(path.c_str());
+
+    std::cout << "Prediction stream: " << trace.size() << " records, " << sizeof(PredictionStreamRecord)
+              << " bytes each\n";
+    std::cout << "Prediction stream test passed\n";
+}
+
+void test_predictor_daemon() {
+    std::string socket_path = "/tmp/test_vpd_" + std::to_string(getpid()) + ".sock";
+    std::string snapshot_path = "/tmp/test_vpd_" + std::to_string(getpid()) + ".state";
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 40000);
+    size_t warm = trace.size() / 2;
+
+    // Resident predictor and a local reference, warmed identically
+    ValuePredictor served({});
+    ValuePredictor local({});
+    for (size_t i = 0; i < warm; i++) {
+        stepRecord(served, trace[i], i);
+        stepRecord(local, trace[i], i);
+    }
+    {
+        // A non-socket at the path is left alone
+        std::ofstream(socket_path) << "not a socket";
+        bool refused = false;
+        try {
+            PredictorDaemon<ValuePredictor> wrong(served, socket_path);
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        assert(refused && access(socket_path.c_str(), F_OK) == 0);
+        unlink(socket_path.c_str());
+    }
+    PredictorDaemon<ValuePredictor> daemon(served, socket_path, snapshot_path);
+    std::thread server([&daemon] { daemon.serve(); });
+    {
+        // A second daemon does not take over the live one's socket
+        bool refused = false;
+        try {
+            PredictorDaemon<ValuePredictor> second(served, socket_path);
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        assert(refused);
+    }
+
+    {
+        DaemonClient client(socket_path);
+        std::vector<DaemonRequest> batch;
+        std::vector<DaemonResponse> responses;
+        std::vector<std::pair<size_t, RecordPrediction>> expected;  // response index, local prediction
+        double worst_us = 0;
+        for (size_t i = warm; i < trace.size(); i++) {
+            const ValueTraceRecord& rec = trace[i];
+            RecordPrediction pred = stepRecord(local, rec, i);
+            if (rec.kind == branch_record) {
+                batch.push_back({daemon_branch, rec.taken, {}, rec.pc, i});
+                batch.push_back({daemon_branch_commit, 0, {}, 0, i});
+            } else {
+                expected.push_back({batch.size(), pred});
+                batch.push_back({daemon_predict, 0, {}, rec.pc, 0});
+                batch.push_back({daemon_commit, 0, {}, rec.pc, rec.value});
+            }
+
+            if (batch.size() >= 256 || i + 1 == trace.size()) {
+                responses.resize(batch.size());
+                auto t0 = std::chrono::steady_clock::now();
+                client.call(batch.data(), batch.size(), responses.data());
+                double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+                worst_us = std::max(worst_us, us);
+                for (const auto& r : responses)
+                    assert(r.status == DaemonResponse::ok);
+                for (const auto& [index, p] : expected)
+                    assert(responses[index].confidence == p.confidence && responses[index].value == p.value);
+                batch.clear();
+                expected.clear();
+            }
+        }
+        assert(client.call({daemon_state_hash, 0, {}, 0, 0}).value == local.stateHash());
+
+        // Snapshot, then restore it into a fresh predictor
+        DaemonResponse snap = client.call({daemon_snapshot, 0, {}, 0, 0});
+        assert(snap.status == DaemonResponse::ok && snap.value == local.stateHash());
+        ValuePredictor restored({});
+        std::ifstream in(snapshot_path, std::ios::binary);
+        restored.load(in);
+        assert(restored.stateHash() == local.stateHash());
+        assert(client.call({99, 0, {}, 0, 0}).status == DaemonResponse::error);
+
+        // Branch commits with nothing in flight or out of order are refused,
+        // and the daemon keeps serving
+        assert(client.call({daemon_branch_commit, 0, {}, 0, 12345}).status == DaemonResponse::error);
+        client.call({daemon_branch, 1, {}, 0x40, 500000});
+        client.call({daemon_branch, 0, {}, 0x44, 500001});
+        assert(client.call({daemon_branch_commit, 0, {}, 0, 500001}).status == DaemonResponse::error);
+        assert(client.call({daemon_branch_commit, 0, {}, 0, 500000}).status == DaemonResponse::ok);
+        assert(client.call({daemon_branch_commit, 0, {}, 0, 500001}).status == DaemonResponse::ok);
+        local.updateOnBranch(500000, true);
+        local.updateOnBranch(500001, false);
+        local.onBranchCommit(500000);
+        local.onBranchCommit(500001);
+        assert(client.call({daemon_state_hash, 0, {}, 0, 0}).value == local.stateHash());
+
+        std::cout << "Predictor daemon: " << daemon.batchesServed() << " batches, slowest 256-request batch "
+                  << worst_us << " us\n";
+        client.call({daemon_shutdown, 0, {}, 0, 0});
+    }
+    server.join();
+    unlink(snapshot_path.c_str());
+    {
+        // A socket nobody listens on is replaced, and a daemon going away
+        // leaves a newer daemon's socket in place
+        std::string path = socket_path + "2";
+        sockaddr_un addr = daemon_io::socketAddress(path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        close(fd);
+        auto old = std::make_unique<PredictorDaemon<ValuePredictor>>(served, path);
+        unlink(path.c_str());
+        {
+            PredictorDaemon<ValuePredictor> newer(served, path);
+            old.reset();
+            assert(access(path.c_str(), F_OK) == 0);
+        }
+        assert(access(path.c_str(), F_OK) != 0);
+    }
+
+    std::cout << "Predictor daemon test passed\n";
+}
+
+void test_shm_ring_transport() {
+    std::string name = "/test_vp_ring_" + std::to_string(getpid());
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 30000);
+
+    // The predictor is served by this process and driven by a forked client,
+    // which checks every prediction against its own in-process predictor.
+    ValuePredictor served({});
+    ShmPredictorServer<ValuePredictor> server(served, name, 64);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int status = 0;
+        try {
+            ShmPredictorClient client(name);
+            ValuePredictor local({});
+            for (size_t i = 0; i < trace.size(); i++) {
+                const ValueTraceRecord& rec = trace[i];
+                if (stepRecord(client, rec, i) != stepRecord(local, rec, i))
+                    status = 1;
+            }
+            if (client.stateHash() != local.stateHash())
+                status = 2;
+            client.shutdown();
+        } catch (...) {
+            status = 3;
+        }
+        _exit(status);
+    }
+    assert(pid > 0);
+    auto t0 = std::chrono::steady_clock::now();
+    server.serve();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    ValuePredictor reference({});
+    replayValueTrace(reference, trace);
+    assert(served.stateHash() == reference.stateHash());
+
+    std::cout << "Shared-memory rings: " << trace.size() << " records from another process, "
+              << ns / trace.size() << " ns/record\n";
+
+    // A second server does not take over a live server's channel
+    bool refused = false;
+    try {
+        ShmPredictorServer<ValuePredictor> second(served, name, 64);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    assert(refused);
+
+    // A failed request without a response is reported by the next answer
+    pid = fork();
+    if (pid == 0) {
+        int status = 0;
+        ShmPredictorClient client(name);
+        client.onBranchCommit(123456789);
+        try {
+            client.stateHash();
+            status = 1;
+        } catch (const std::runtime_error&) {
+        }
+        try {
+            client.stateHash();
+        } catch (const std::runtime_error&) {
+            status = 2;
+        }
+        client.shutdown();
+        _exit(status);
+    }
+    server.serve();
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // A client that dies without shutting down ends serve() with an error
+    pid = fork();
+    if (pid == 0) {
+        ShmPredictorClient client(name);
+        client.onValueCommit(0x40, 1);
+        client.flush();
+        _exit(0);
+    }
+    refused = false;
+    try {
+        server.serve();
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    assert(refused && waitpid(pid, &status, 0) == pid);
+
+    // A channel left by a dead server is replaced, and its clients get an
+    // error instead of waiting forever
+    std::string stale = name + "_stale";
+    pid = fork();
+    if (pid == 0) {
+        new ShmChannel(ShmChannel::create(stale, 64));
+        _exit(0);
+    }
+    assert(waitpid(pid, &status, 0) == pid);
+    refused = false;
+    try {
+        ShmPredictorClient orphan(stale);
+        orphan.predict(0x40);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    assert(refused);
+    {
+        ShmChannel replacement = ShmChannel::create(stale, 64);
+    }
+    assert(shm_open(stale.c_str(), O_RDONLY, 0) < 0 && errno == ENOENT);
+    std::cout << "Shared-memory ring test passed\n";
+}
+
+void test_latency_histogram() {
+    // Buckets are contiguous and each value lands in the bucket that covers it
+    for (uint64_t v : {0ull, 1ull, 31ull, 32ull, 33ull, 63ull, 64ull, 1000ull, 123456789ull, ~0ull}) {
+        size_t b = LatencyHistogram::bucketOf(v);
+        assert(LatencyHistogram::bucketHigh(b) >= v);
+        assert(b == 0 || LatencyHistogram::bucketHigh(b - 1) < v);
+    }
+
+    LatencyHistogram h;
+    for (uint64_t v = 1; v <= 10000; v++) {
+        h.record(v);
+    }
+    h.record(5000000);
+    assert(h.count() == 10001 && h.max() == 5000000);
+    // Percentiles are exact to within the 1/32 bucket precision
+    for (double p : {0.5, 0.99, 0.999}) {
+        double exact = p * 10001;
+        assert(h.percentile(p) >= exact && h.percentile(p) <= exact * (1 + 1.0 / 32) + 1);
+    }
+    assert(h.percentile(1.0) == 5000000);
+
+    uint64_t t0 = readCycles();
+    uint64_t t1 = readCycles();
+    assert(t1 >= t0);
+
+    std::cout << "Latency histogram test passed\n";
+}
+
+void test_memory_footprint() {
+    auto item = [](const MemoryFootprint& fp, const std::string& name) {
+        for (const auto& [n, bytes] : fp.items) {
+            if (n == name)
+                return bytes;
+        }
+        assert(false && "missing footprint item");
+        return size_t(0);
+    };
+
+    ValuePredictor vp({});
+    for (PC pc = 0; pc < 1000; pc++) {
+        vp.onValueCommit(0x1000 + pc * 4, pc);
+    }
+    MemoryFootprint fp;
+    vp.accountMemory(fp);
+
+    auto configs = vp.configs();
+    size_t sum = 0;
+    for (size_t i = 0; i < configs.size(); i++) {
+        std::string prefix = "ep.component" + std::to_string(i) + ".";
+        assert(item(fp, prefix + "entries") == configs[i].size * sizeof(EqualityPredictorEntry));
+        assert(item(fp, prefix + "path") == sizeof(PathTracker));
+    }
+    assert(item(fp, "lcvt.nodes") == 1000 * UNORDERED_MAP_NODE_BYTES);
+    assert(item(fp, "lcvt.buckets") >= 1000 * sizeof(void*));
+    for (const auto& [n, bytes] : fp.items) {
+        sum += bytes;
+    }
+    assert(fp.total() == sum);
+
+    // Deeper speculation grows the branch queue by whole deque blocks
+    MemoryFootprint shallow, deep;
+    EqualityPredictor ep(defaultValuePredictorConfig());
+    ep.accountMemory(shallow);
+    for (InstSeqNum seq = 0; seq < MAX_BRANCH_SPEC_DISTANCE; seq++) {
+        ep.updateOnBranch(seq, seq & 1);
+    }
+    ep.accountMemory(deep);
+    assert(item(deep, "ep.branch_queue") > item(shallow, "ep.branch_queue"));
+
+    std::cout << "Memory footprint: " << fp.total() << " bytes for 1000 static PCs\n";
+    std::cout << "Memory footprint test passed\n";
+}
+
+void test_lcvt_hierarchy() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    ValuePredictor reference({});
+    ReplayStats expected = replayValueTrace(reference, trace);
+
+    // With a second level that never evicts, both policies predict exactly
+    // like the unbounded table and hold the same state
+    for (auto policy : {lcvt_inclusive, lcvt_exclusive}) {
+        for (bool promote : {false, true}) {
+            TwoLevelLcvtConfig config;
+            config.l1 = {16, 2, 1};
+            config.l2 = {256, 16, 4};
+            config.policy = policy;
+            config.promote_on_predict = promote;
+            BasicValuePredictor<TwoLevelLastCommittedValueTable> vp({}, config);
+            assert(replayValueTrace(vp, trace) == expected);
+            assert(vp.stateHash() == reference.stateHash());
+        }
+    }
+
+    // A small loop is served from the first level once it is warm
+    TwoLevelLastCommittedValueTable table;
+    for (int round = 0; round < 100; round++) {
+        for (PC pc = 0x1000; pc < 0x1010; pc += 4) {
+            if (table.hasValue(pc))
+                assert(table.predictLookup(pc) == pc + round - 1);
+            table.update(pc, pc + round);
+        }
+    }
+    assert(table.hierarchyStats().predictions() == 99 * 4);
+    assert(table.hierarchyStats().delivered[1] == 0);
+
+    // Bounded capacity: pcs beyond the second level are dropped, inclusion holds
+    TwoLevelLcvtConfig tiny;
+    tiny.l1 = {1, 2, 1};
+    tiny.l2 = {1, 4, 3};
+    tiny.policy = lcvt_inclusive;
+    TwoLevelLastCommittedValueTable bounded(tiny);
+    for (PC pc = 0; pc < 40; pc += 4) {
+        bounded.update(pc, pc);
+    }
+    assert(bounded.size() == 4);
+    assert(bounded.hierarchyStats().evictions == 6);
+    assert(!bounded.hasValue(0) && bounded.hasValue(36));
+
+    // Exclusive: the same pcs fit in both levels together; second-level
+    // predictions are promoted and the first-level victim demoted
+    tiny.policy = lcvt_exclusive;
+    TwoLevelLastCommittedValueTable exclusive(tiny);
+    for (PC pc = 0; pc < 24; pc += 4) {
+        exclusive.update(pc, pc);
+    }
+    assert(exclusive.size() == 6 && exclusive.hierarchyStats().evictions == 0);
+    assert(exclusive.predictLookup(0) == 0 && exclusive.hierarchyStats().delivered[1] == 1);
+    assert(exclusive.predictLookup(0) == 0 && exclusive.hierarchyStats().delivered[0] == 1);
+    assert(exclusive.size() == 6);
+
+    std::cout << "LCVT hierarchy test passed\n";
+}
+
+void test_lcvt_admission() {
+    // 64 pcs with constant values, interleaved with streaming pcs whose
+    // values never repeat
+    std::vector<ValueTraceRecord> trace;
+    uint64_t unique = 1;
+    for (int round = 0; round < 200; round++) {
+        for (PC i = 0; i < 64; i++) {
+            trace.push_back({value_record, false, 0x1000 + i * 4, 100 + i});
+            trace.push_back({value_record, false, 0x80000 + (unique % 5000) * 4, unique * 7919});
+            unique++;
+            if (i % 8 == 7)
+                trace.push_back({branch_record, (round & 1) != 0, 0x400000 + i * 4, 0});
+        }
+    }
+
+    AdmissionReport r = compareAdmission(trace);
+    assert(r.entries[0] == 64 + 5000);
+    assert(r.entries[1] >= 64 && r.entries[1] < 64 + 100);
+    assert(r.bytes[1] < r.bytes[0] / 4);
+    assert(r.stats.admitted == r.entries[1]);
+    // The constant pcs are still predicted; only their first rounds are lost
+    assert(r.coverage(1) > 0.45 && r.coverage(1) <= r.coverage(0));
+    assert(r.accuracy(1) >= r.accuracy(0));
+
+    // Resident pcs are updated directly; a higher threshold admits later
+    AdmissionFilteredTable<> table({1 << 4, 2});
+    table.update(0x40, 5);
+    table.update(0x40, 5);
+    assert(!table.hasValue(0x40));
+    table.update(0x40, 5);
+    assert(table.hasValue(0x40) && table.lookup(0x40) == 5);
+    table.update(0x40, 6);
+    assert(table.lookup(0x40) == 6);
+
+    printAdmissionReport(std::cout, r);
+    std::cout << "LCVT admission filter test passed\n";
+}
+
+void test_kernel_cache() {
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 20000);
+    KernelCacheOptions options;
+    options.cache_dir = "/tmp/test_kernels_" + std::to_string(getpid());
+
+    std::vector<ComponentConfig> configs = {
+        {.size = 1024, .ghist_bits = 0, .index_bits = 10, .tag_bits = 0},
+        {.size = 512, .ghist_bits = 5, .index_bits = 9, .tag_bits = 10},
+        {.size = 512, .ghist_bits = 27, .index_bits = 9, .tag_bits = 11},
+    };
+    {
+        KernelCache cache(options);
+        auto kernel = cache.create(configs);
+        assert(kernel->specialized());
+        assert(cache.cacheStats().compiled == 1);
+
+        // Identical to the generic predictor on every record and in state
+        ValuePredictorParams params;
+        params.components = configs;
+        ValuePredictor reference(params);
+        ValidationOptions vo;
+        vo.hash_interval = 500;
+        ValidationReport report = validateLockstep(reference, *kernel, trace, vo);
+        assert(report.identical);
+
+        // Speculative history is reverted the same way
+        for (InstSeqNum seq = 100000; seq < 100040; seq++) {
+            reference.updateOnBranch(seq, seq % 3 == 0);
+            kernel->updateOnBranch(seq, seq % 3 == 0);
+        }
+        reference.squash(100010);
+        kernel->squash(100010);
+        assert(kernel->stateHash() == reference.stateHash());
+
+        // A second kernel for the same geometry reuses the loaded object
+        auto again = cache.create(configs);
+        assert(again->specialized() && cache.cacheStats().compiled == 1 && cache.cacheStats().loaded == 1);
+        ValuePredictor fresh(params);
+        assert(again->replay(trace) == replayValueTrace(fresh, trace));
+
+        // Ahead-pipelined geometries are not specialized
+        auto ahead = defaultValuePredictorConfig();
+        ahead[3].ahead = 2;
+        assert(!cache.create(ahead)->specialized());
+    }
+    {
+        // A later run finds the object on disk
+        KernelCache cache(options);
+        assert(cache.create(configs)->specialized() && cache.cacheStats().compiled == 0);
+    }
+    {
+        // Editing a header the kernel includes builds a new object
+        KernelCacheOptions edited = options;
+        edited.include_dir = options.cache_dir + "_include";
+        std::filesystem::create_directories(edited.include_dir);
+        for (const char* header : {"vp.h", "value_trace.h", "vp_replay.h", "vp_kernel.h"}) {
+            std::filesystem::copy_file(header, edited.include_dir + "/" + header);
+        }
+        std::ofstream(edited.include_dir + "/vp.h", std::ios::app) << "\n// edited\n";
+        KernelCache cache(edited);
+        assert(cache.create(configs)->specialized() && cache.cacheStats().compiled == 1);
+        std::filesystem::remove_all(edited.include_dir);
+    }
+    {
+        // Objects or directories others could have written are not loaded
+        std::vector<std::string> objects;
+        for (const auto& entry : std::filesystem::directory_iterator(options.cache_dir)) {
+            if (entry.path().extension() == ".so")
+                objects.push_back(entry.path());
+        }
+        for (const auto& so : objects)
+            chmod(so.c_str(), 0666);
+        KernelCache cache(options);
+        auto kernel = cache.create(configs);
+        assert(!kernel->specialized() && cache.lastError().find("refusing") != std::string::npos);
+        for (const auto& so : objects)
+            chmod(so.c_str(), 0644);
+        chmod(options.cache_dir.c_str(), 0777);
+        KernelCache open_dir(options);
+        assert(!open_dir.create(configs)->specialized());
+        chmod(options.cache_dir.c_str(), 0700);
+        assert(KernelCache(options).create(configs)->specialized());
+        // The error is of the last create() only
+        assert(cache.create(configs)->specialized() && cache.lastError().empty());
+        assert(!cache.create({{1024, 0, 10, 0, 1, 0}})->specialized() && !cache.lastError().empty());
+    }
+    {
+        // Without a compiler the generic engine is used
+        KernelCacheOptions broken = options;
+        broken.cache_dir += "_nocc";
+        broken.compiler = "/nonexistent/c++";
+        KernelCache cache(broken);
+        auto kernel = cache.create(configs);
+        assert(!kernel->specialized() && cache.cacheStats().generic == 1 && !cache.lastError().empty());
+        std::system(("rm -rf '" + broken.cache_dir + "'").c_str());
+    }
+    std::system(("rm -rf '" + options.cache_dir + "'").c_str());
+
+    std::cout << "Kernel cache test passed\n";
+}
+
+// Sum of squares 1..100, stored and reloaded, divided by 7; writes "ok\n"
+// and exits with the remainder.
+static std::vector<uint32_t> rv64SumOfSquares() {
+    using namespace rv64asm;
+    return {
+        addi(5, 0, 1),            // t0 = 1
+        addi(6, 0, 0),            // t1 = 0
+        addi(7, 0, 101),          // t2 = 101
+        lui(28, 0x20),            // t3 = 0x20000
+        mul(29, 5, 5),            // loop: t4 = t0 * t0
+        add(6, 6, 29),
+        addi(5, 5, 1),
+        blt(5, 7, -12),
+        sd(6, 28, 0),
+        ld(10, 28, 0),
+        addi(29, 0, 7),
+        divu(30, 10, 29),
+        remu(31, 10, 29),
+        lui(11, 0xa7),            // a1 = "ok\n"
+        addi(11, 11, -1169),
+        sd(11, 28, 8),
+        addi(10, 0, 1),           // write(1, t3 + 8, 3)
+        addi(11, 28, 8),
+        addi(12, 0, 3),
+        addi(17, 0, 64),
+        ecall(),
+        addi(10, 31, 0),          // exit(t6)
+        addi(17, 0, 93),
+        ecall(),
+    };
+}
+
+void test_rv64_emulator() {
+    std::vector<uint32_t> code = rv64SumOfSquares();
+    {
+        Rv64Machine m;
+        m.loadProgram(code);
+        m.mapZeroed(0x20000, 4096);
+        ValueTraceRecorder recorder;
+        // Stops after a budget and resumes where it left off
+        assert(m.run(recorder, 10) == 10 && !m.stoppedRunning());
+        m.run(recorder);
+        assert(m.exited() && m.exitCode() == 5 && m.output() == "ok\n");
+        assert(m.reg(6) == 338350 && m.reg(30) == 48335);
+        assert(m.instructionsRetired() == 420);
+
+        size_t branches = 0, taken = 0;
+        for (const auto& rec : recorder.trace) {
+            branches += rec.kind == branch_record;
+            taken += rec.kind == branch_record && rec.taken;
+        }
+        assert(branches == 100 && taken == 99 && recorder.trace.size() == 418);
+        assert(recorder.trace[0].kind == value_record && recorder.trace[0].pc == 0x10000 && recorder.trace[0].value == 1);
+
+        // Streaming into a predictor gives the same result as replaying the recorded trace
+        Rv64Machine again;
+        again.loadProgram(code);
+        again.mapZeroed(0x20000, 4096);
+        ValuePredictor streamed({}), replayed({});
+        PredictorTraceSink<ValuePredictor> sink(streamed);
+        again.run(sink);
+        assert(sink.replayStats() == replayValueTrace(replayed, recorder.trace));
+        assert(streamed.stateHash() == replayed.stateHash());
+    }
+    {
+        // The same program as a static ELF executable
+        std::vector<uint8_t> image(sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr));
+        Elf64_Ehdr eh{};
+        std::memcpy(eh.e_ident, ELFMAG, SELFMAG);
+        eh.e_ident[EI_CLASS] = ELFCLASS64;
+        eh.e_ident[EI_DATA] = ELFDATA2LSB;
+        eh.e_ident[EI_VERSION] = EV_CURRENT;
+        eh.e_type = ET_EXEC;
+        eh.e_machine = EM_RISCV;
+        eh.e_version = EV_CURRENT;
+        eh.e_entry = 0x10000 + image.size();
+        eh.e_phoff = sizeof(Elf64_Ehdr);
+        eh.e_ehsize = sizeof(Elf64_Ehdr);
+        eh.e_phentsize = sizeof(Elf64_Phdr);
+        eh.e_phnum = 1;
+        Elf64_Phdr ph{};
+        ph.p_type = PT_LOAD;
+        ph.p_vaddr = 0x10000;
+        ph.p_filesz = image.size() + code.size() * 4;
+        ph.p_memsz = ph.p_filesz;
+        std::memcpy(image.data(), &eh, sizeof(eh));
+        std::memcpy(image.data() + sizeof(eh), &ph, sizeof(ph));
+        image.insert(image.end(), reinterpret_cast<uint8_t*>(code.data()),
+                     reinterpret_cast<uint8_t*>(code.data() + code.size()));
+        std::string path = "/tmp/test_rv64_" + std::to_string(getpid()) + ".elf";
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<char*>(image.data()), image.size());
+
+        Rv64Machine m;
+        m.loadElf(path);
+        m.mapZeroed(0x20000, 4096);
+        ValueTraceRecorder recorder;
+        m.run(recorder);
+        assert(m.exited() && m.exitCode() == 5 && m.output() == "ok\n");
+        unlink(path.c_str());
+
+        bool rejected = false;
+        try {
+            Rv64Machine other;
+            other.loadElf("trace_gcc.txt");
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    {
+        // Division by zero does not trap; EBREAK stops without exiting
+        using namespace rv64asm;
+        Rv64Machine m;
+        m.loadProgram({addi(10, 0, -5), addi(11, 0, 0), divu(12, 10, 11), remu(13, 10, 11), 0x00100073, 0});
+        ValueTraceRecorder recorder;
+        m.run(recorder);
+        assert(m.stoppedRunning() && !m.exited());
+        assert(m.reg(12) == ~0ull && m.reg(13) == uint64_t(-5));
+
+        // The heap cannot grow into a region mapped above it, and nothing can
+        // be mapped over the heap
+        Rv64Machine h;
+        h.loadProgram({lui(10, 0x30), addi(17, 0, 214), ecall(), addi(5, 10, 0),
+                       lui(10, 0x20), ecall(), 0x00100073});
+        h.mapZeroed(0x20000, 4096);
+        h.write<uint64_t>(0x20000, 42);
+        h.run(recorder);
+        assert(h.reg(5) == 0x11000 && h.reg(10) == 0x20000);
+        assert(h.read<uint64_t>(0x20000) == 42);
+        h.write<uint64_t>(0x1fff8, 7);
+        assert(h.read<uint64_t>(0x20000) == 42);
+        bool overlapped = false;
+        try {
+            h.mapZeroed(0x18000, 4096);
+        } catch (const std::runtime_error&) {
+            overlapped = true;
+        }
+        assert(overlapped);
+
+        // Illegal instructions fault with their pc
+        Rv64Machine bad;
+        bad.loadProgram({addi(10, 0, 1), 0});
+        bool faulted = false;
+        try {
+            bad.run(recorder);
+        } catch (const Rv64Fault& f) {
+            faulted = f.pc == 0x10004;
+        }
+        assert(faulted);
+
+        // So do the funct7/funct6 encodings the ISA reserves, while their
+        // legal neighbours run
+        auto faults = [&](uint32_t inst) {
+            Rv64Machine m;
+            m.loadProgram({addi(10, 0, 1), inst, 0x00100073});
+            try {
+                m.run(recorder);
+            } catch (const Rv64Fault& f) {
+                assert(f.pc == 0x10004);
+                return true;
+            }
+            return false;
+        };
+        for (uint32_t inst : {r(0x33, 5, 0, 10, 10, 0x02), r(0x33, 5, 1, 10, 10, 0x20), r(0x33, 5, 7, 10, 10, 0x40),
+                              r(0x3b, 5, 1, 10, 10, 0x20), r(0x3b, 5, 0, 10, 10, 0x04), r(0x3b, 5, 1, 10, 10, 1),
+                              i(0x1b, 5, 1, 10, 0x20), i(0x1b, 5, 5, 10, 0x420), i(0x13, 5, 1, 10, 0x400),
+                              i(0x13, 5, 5, 10, 0x200)}) {
+            assert(faults(inst));
+        }
+        for (uint32_t inst : {r(0x33, 5, 0, 10, 10, 0x20), r(0x33, 5, 5, 10, 10, 0x20), r(0x3b, 5, 5, 10, 10, 0x20),
+                              r(0x3b, 5, 4, 10, 10, 1), i(0x1b, 5, 5, 10, 0x41f), i(0x13, 5, 5, 10, 0x43f)}) {
+            assert(!faults(inst));
+        }
+    }
+
+    std::cout << "RV64 emulator test passed\n";
+}
+
+void test_live_stats() {
+    std::string name = "/test_vp_stats_" + std::to_string(getpid());
+    auto trace = makeValueTraceFromBranches("trace_gcc.txt", 50000);
+    {
+        LiveStatsWriter live(name, "live stats test", {{"value", 4}, {"oracle", 0}});
+        LiveStatsReader reader(name);
+        LiveStatsSnapshot s = reader.snapshot();
+        assert(s.label == "live stats test" && s.pid == getpid() && s.alive && !s.finished);
+        assert(s.records == 0 && s.predictors.size() == 2 && s.predictors[0].component_hits.size() == 4);
+
+        // A reader in another thread only ever sees progress
+        std::atomic<bool> done{false};
+        bool monotonic = true;
+        std::thread watcher([&] {
+            uint64_t last = 0;
+            while (!done.load()) {
+                LiveStatsSnapshot w = reader.snapshot();
+                monotonic &= w.records >= last;
+                last = w.records;
+            }
+        });
+        ValuePredictor vp({});
+        ReplayStats stats = replayValueTraceLive(vp, trace, live, 0, 1000);
+        for (int i = 0; i < 10; i++) {
+            live.recordPrediction(1, i < 7, i < 5 ? high : low);
+            live.recordProviderHit(0, i % 2 ? 3 : 1);
+        }
+        live.recordProviderHit(0, 9);   // beyond the declared components: ignored
+        done = true;
+        watcher.join();
+        assert(monotonic);
+
+        ValuePredictor reference({});
+        assert(stats == replayValueTrace(reference, trace));
+        live.finish();
+        s = reader.snapshot();
+        assert(s.finished && s.records == trace.size());
+        const auto& p = s.predictors[0];
+        assert(p.name == "value" && p.correct + p.wrong == stats.values);
+        assert(p.high_correct == stats.correct[high] && p.high_wrong == stats.incorrect[high]);
+        assert(p.component_hits == std::vector<uint64_t>({0, 5, 0, 5}));
+        const auto& o = s.predictors[1];
+        assert(o.correct == 7 && o.wrong == 3 && o.high_correct == 5 && o.high_wrong == 0);
+
+        std::ostringstream report;
+        printLiveStats(report, s);
+        assert(report.str().find("live stats test") != std::string::npos);
+        std::ostringstream raw;
+        printLiveStatsRaw(raw, s);
+        assert(raw.str().find("oracle.correct=7\n") != std::string::npos);
+    }
+
+    {
+        // A page whose writer is running is not taken over
+        auto first = std::make_unique<LiveStatsWriter>(name, "first", std::vector<LivePredictorInfo>{});
+        bool refused = false;
+        try {
+            LiveStatsWriter second(name, "second", {});
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        assert(refused && LiveStatsReader(name).snapshot().label == "first");
+
+        // If the name has been reused, the old writer leaves the new page alone
+        shm_unlink(name.c_str());
+        LiveStatsWriter later(name, "later", {});
+        first.reset();
+        assert(LiveStatsReader(name).snapshot().label == "later");
+    }
+    {
+        // A page another writer has just created, not yet sized or
+        // initialised, is still in use
+        OwnedShm starting(name, 0644);
+        bool refused = false;
+        try {
+            LiveStatsWriter second(name, "second", {});
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        struct stat st;
+        assert(refused && fstat(starting.descriptor(), &st) == 0 && st.st_nlink == 1);
+    }
+    {
+        // A page left behind by a dead process is replaced
+        pid_t pid = fork();
+        if (pid == 0) {
+            new LiveStatsWriter(name, "crashed", {});
+            _exit(0);
+        }
+        int status;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(!LiveStatsReader(name).snapshot().alive);
+        LiveStatsWriter replacement(name, "replacement", {});
+        assert(LiveStatsReader(name).snapshot().label == "replacement");
+    }
+
+    // The page is removed with its writer; other objects are rejected
+    bool rejected = false;
+    try {
+        LiveStatsReader gone(name);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    ShmChannel channel = ShmChannel::create(name, 64);
+    rejected = false;
+    try {
+        LiveStatsReader wrong(name);
+    } catch (const std::runtime_error& e) {
+        rejected = std::string(e.what()).find("not a stats page") != std::string::npos;
+    }
+    assert(rejected);
+
+    std::cout << "Live stats page test passed\n";
+}
+
+void test_sweep_queue() {
+    std::string dir = "/tmp/test_sweep_" + std::to_string(getpid());
+    SweepJob small{"trace_gcc.txt", 20000, {{1024, 0, 10, 0}, {256, 8, 8, 10}, {256, 32, 8, 11}}};
+    SweepJob standard{"trace_gcc.txt", 20000};
+    // What an uninterrupted run of a job gives
+    auto reference = [](const SweepJob& job) {
+        ValuePredictorParams params;
+        params.components = job.configs;
+        ValuePredictor vp(params);
+        SweepResult r;
+        r.stats = replayValueTrace(vp, makeValueTraceFromBranches(job.trace_path, job.branches));
+        r.state_hash = vp.stateHash();
+        return r;
+    };
+    auto matches = [](const std::optional<SweepResult>& r, const SweepResult& expected) {
+        return r && r->stats == expected.stats && r->state_hash == expected.state_hash;
+    };
+
+    {
+        SweepQueue queue(dir);
+        std::string id = queue.submit(small);
+        assert(queue.submit(small) == id);
+        queue.submit(standard);
+        assert(queue.jobIds().size() == 2);
+        SweepJob back = queue.job(id);
+        assert(back.trace_path == std::filesystem::absolute("trace_gcc.txt").string() && back.branches == 20000);
+        assert(componentConfigHash(back.configs) == componentConfigHash(small.configs));
+
+        // A time slice stops mid-job with a checkpoint
+        SweepRunOptions options;
+        options.checkpoint_interval = 4000;
+        options.record_budget = 15000;
+        SweepRunReport report = queue.run(options);
+        assert(report.budget_exhausted && report.completed == 0 && report.records == 15000 && report.checkpoints == 4);
+        size_t checkpointed = 0;
+        for (const auto& s : queue.status()) {
+            assert(s.state == sweep_pending);
+            checkpointed += s.checkpointed;
+        }
+        assert(checkpointed == 15000);
+    }
+    {
+        // A new worker resumes it and finishes both jobs
+        SweepQueue queue(dir);
+        SweepRunOptions options;
+        options.checkpoint_interval = 4000;
+        SweepRunReport report = queue.run(options);
+        assert(report.completed == 2 && report.resumed == 1 && !report.budget_exhausted);
+        assert(matches(queue.result(SweepQueue::jobId(small)), reference(small)));
+        assert(matches(queue.result(SweepQueue::jobId(standard)), reference(standard)));
+        for (const auto& s : queue.status()) {
+            assert(s.state == sweep_done);
+        }
+
+        // Finished jobs are not run again, even when resubmitted
+        queue.submit(small);
+        report = queue.run(options);
+        assert(report.completed == 0 && report.records == 0);
+
+        // A result cut short (e.g. by a crash) does not count as done
+        std::ofstream(dir + "/results/" + SweepQueue::jobId(small) + ".result") << "values 12";
+        assert(queue.status()[0].state != sweep_done || queue.status()[1].state != sweep_done);
+        report = queue.run(options);
+        assert(report.completed == 1);
+        assert(matches(queue.result(SweepQueue::jobId(small)), reference(small)));
+    }
+    {
+        // A worker killed mid-job loses only the records since its last checkpoint
+        SweepJob longer{"trace_gcc.txt", 200000};
+        SweepQueue queue(dir);
+        std::string id = queue.submit(longer);
+        std::string checkpoint = dir + "/checkpoints/" + id + ".ckpt";
+        pid_t pid = fork();
+        if (pid == 0) {
+            SweepRunOptions options;
+            options.checkpoint_interval = 2000;
+            SweepQueue(dir).run(options);
+            _exit(0);
+        }
+        assert(pid > 0);
+        while (access(checkpoint.c_str(), F_OK) != 0 && !queue.result(id)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // status() sees the worker through its pid, without touching its lock
+        auto state = [&] {
+            for (const auto& s : queue.status()) {
+                if (s.id == id)
+                    return s.state;
+            }
+            return sweep_failed;
+        };
+        assert(state() == sweep_running || state() == sweep_done);
+        kill(pid, SIGKILL);
+        int status;
+        assert(waitpid(pid, &status, 0) == pid);
+        if (WIFSIGNALED(status)) {
+            assert(state() == sweep_pending);
+            uint64_t checkpointed = 0;
+            for (const auto& s : queue.status()) {
+                if (s.id == id)
+                    checkpointed = s.checkpointed;
+            }
+            size_t records = makeValueTraceFromBranches(longer.trace_path, longer.branches).size();
+            SweepRunReport report = queue.run();
+            assert(checkpointed > 0 && report.completed == 1 && report.resumed == 1);
+            assert(report.records == records - checkpointed);
+        }
+        assert(matches(queue.result(id), reference(longer)));
+    }
+    {
+        // An unusable checkpoint is ignored and the job restarts
+        SweepJob other{"trace_gcc.txt", 10000};
+        SweepQueue queue(dir);
+        std::string id = queue.submit(other);
+        std::ofstream(dir + "/checkpoints/" + id + ".ckpt") << "garbage";
+        SweepRunReport report = queue.run();
+        assert(report.completed == 1 && report.resumed == 0);
+        assert(matches(queue.result(id), reference(other)));
+    }
+    {
+        // A branch job checkpoints and resumes an EqualityPredictor run as a
+        // branch predictor, matching the suite's EqualityPredictor numbers
+        SweepJob branch{"trace_gcc.txt", 30000, {{2048, 0, 11, 0}, {512, 4, 9, 12}, {512, 16, 9, 12}},
+                        sweep_branch_job};
+        SweepQueue queue(dir);
+        std::string id = queue.submit(branch);
+        assert(id != SweepQueue::jobId(SweepJob{branch.trace_path, branch.branches, branch.configs}));
+        assert(queue.job(id).kind == sweep_branch_job);
+        SweepRunOptions options;
+        options.checkpoint_interval = 5000;
+        options.record_budget = 12000;
+        assert(queue.run(options).budget_exhausted);
+        SweepRunReport report = queue.run();
+        assert(report.completed == 1 && report.resumed == 1);
+
+        EqualityPredictor ep(branch.configs);
+        ReplayStats expected = replayValueTrace(ep, makeValueTraceFromBranches(branch.trace_path, branch.branches));
+        auto r = queue.result(id);
+        assert(r && r->stats == expected && r->state_hash == ep.stateHash());
+        assert(r->stats.values == 30000);
+    }
+    {
+        // A job over a recorded value trace, cut at its Nth branch like a
+        // derived one
+        std::string values_path = dir + "/values.txt";
+        {
+            std::ofstream out(values_path);
+            for (const auto& rec : makeValueTraceFromBranches("trace_gcc.txt", 12000)) {
+                out << std::hex << (rec.kind == value_record ? "v " : "b ") << rec.pc << " ";
+                if (rec.kind == value_record)
+                    out << rec.value << "\n";
+                else
+                    out << (rec.taken ? "t" : "n") << "\n";
+            }
+        }
+        SweepJob recorded{values_path, 10000};
+        recorded.value_trace = true;
+        SweepQueue queue(dir);
+        std::string id = queue.submit(recorded);
+        assert(queue.job(id).value_trace);
+        assert(id != SweepQueue::jobId(SweepJob{values_path, 10000}));
+        assert(loadValueTrace(values_path, 10000).size() == makeValueTraceFromBranches("trace_gcc.txt", 10000).size());
+        assert(queue.run().completed == 1);
+        assert(matches(queue.result(id), reference(SweepJob{"trace_gcc.txt", 10000})));
+    }
+    {
+        // A failing job is recorded and does not stop the others
+        SweepJob missing{dir + "/removed_trace.txt", 1000};
+        std::filesystem::copy_file("trace_gcc.txt", missing.trace_path);
+        auto mtime = std::filesystem::last_write_time(missing.trace_path);
+        SweepJob other{"trace_gcc.txt", 5000};
+        SweepQueue queue(dir);
+        bool threw = false;
+        try {
+            queue.submit(SweepJob{dir + "/no_such_trace.txt", 1000});
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+        std::string bad = queue.submit(missing);
+        std::filesystem::rename(missing.trace_path, missing.trace_path + ".moved");
+        std::string corrupt = queue.submit(SweepJob{"trace_gcc.txt", 6000});
+        std::ofstream(dir + "/jobs/" + corrupt + ".job") << "bvp-sweep-job 1\ntrace";
+        std::string id = queue.submit(other);
+        SweepRunReport report = queue.run();
+        assert(report.completed == 1 && report.failed == 2);
+        assert(matches(queue.result(id), reference(other)));
+        assert(queue.error(bad) && queue.error(corrupt) && !queue.error(id));
+        for (const auto& s : queue.status()) {
+            assert(s.state == (s.id == bad || s.id == corrupt ? sweep_failed : sweep_done));
+            assert((s.state == sweep_failed) == !s.error.empty());
+        }
+        report = queue.run();
+        assert(report.completed == 0 && report.failed == 0);
+
+        // Submitting it again retries it
+        std::filesystem::rename(missing.trace_path + ".moved", missing.trace_path);
+        assert(queue.submit(missing) == bad);
+        assert(!queue.error(bad));
+        report = queue.run();
+        assert(report.completed == 1 && report.failed == 0);
+
+        // A trace changed after submission fails its job rather than
+        // running on the new contents, and is a new job when submitted
+        std::ofstream(missing.trace_path, std::ios::app) << "";
+        std::filesystem::last_write_time(missing.trace_path, mtime + std::chrono::seconds(1));
+        std::string changed = queue.submit(missing);
+        assert(changed != bad && queue.result(bad));
+        std::filesystem::resize_file(missing.trace_path, std::filesystem::file_size(missing.trace_path) / 2);
+        report = queue.run();
+        assert(report.completed == 0 && report.failed == 1);
+        assert(queue.error(changed)->find("has changed") != std::string::npos);
+
+        // A lock file that cannot be opened fails only its own job
+        SweepJob unlockable{"trace_gcc.txt", 7000};
+        SweepJob after{"trace_gcc.txt", 8000};
+        std::string blocked = queue.submit(unlockable);
+        std::string next = queue.submit(after);
+        std::filesystem::create_directory(dir + "/locks/" + blocked + ".lock");
+        report = queue.run();
+        assert(report.completed == 1 && report.failed == 1);
+        assert(queue.error(blocked) && matches(queue.result(next), reference(after)));
+    }
+    std::filesystem::remove_all(dir);
+
+    std::cout << "Sweep queue test passed\n";
+}
 
 int main() {
     test_dual_counter();
@@ -437,11 +2266,36 @@ int main() {
     test_allocation_policy();
     test_path_folding();
     test_speculative_state();
+    test_ahead_pipelined_path();
 
     test_convergence_to_high_confidence();
     test_alternating_pattern();
     test_rapid_pattern_shift();
     test_decay_from_high_to_medium();
+    test_interleaved_replay();
+    test_mapped_lcvt();
+    test_lockstep_validation();
+    test_ipc_model();
+    test_lcvt_sizing_curve();
+    test_vtage_context_values();
+    test_hybrid_stride_predictor();
+    test_banked_prediction_groups();
+    test_overriding_prediction();
+    test_silent_write_filter();
+    test_energy_model();
+    test_hogwild_warmup();
+    test_ablation();
+    test_prediction_stream();
+    test_predictor_daemon();
+    test_shm_ring_transport();
+    test_latency_histogram();
+    test_memory_footprint();
+    test_lcvt_hierarchy();
+    test_lcvt_admission();
+    test_kernel_cache();
+    test_rv64_emulator();
+    test_live_stats();
+    test_sweep_queue();
     
     test_accuracy_on_trace();
 
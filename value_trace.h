@@ -0,0 +1,100 @@
+#ifndef VALUE_TRACE_HH
+#define VALUE_TRACE_HH
+
+#include "vp.h"
+#include <string>
+#include <fstream>
+#include <vector>
+
+enum RecordKind : uint8_t { value_record = 0, branch_record = 1 };
+
+// One record of a value trace: either a committed value-producing
+// instruction or a resolved conditional branch.
+struct ValueTraceRecord {
+    RecordKind kind;
+    bool taken;
+    PC pc;
+    Value value;
+};
+
+// Reads a text value trace. Each line is either
+//   v <pc> <value>
+//   b <pc> <t|n>
+// with pc and value in hex, as in trace_gcc.txt. With max_branches, stops
+// before the branch after the first max_branches, so the result covers the
+// same records as makeValueTraceFromBranches with that limit would.
+inline std::vector<ValueTraceRecord> loadValueTrace(const std::string& path, size_t max_branches = SIZE_MAX) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open value trace " + path);
+    }
+
+    std::vector<ValueTraceRecord> trace;
+    std::string kind_str, pc_str, arg_str;
+    size_t branches = 0;
+    while (file >> kind_str >> pc_str >> arg_str) {
+        PC pc = std::stoull(pc_str, nullptr, 16);
+        if (kind_str == "v") {
+            trace.push_back({value_record, false, pc, std::stoull(arg_str, nullptr, 16)});
+        } else if (kind_str == "b") {
+            if (branches++ == max_branches)
+                break;
+            trace.push_back({branch_record, arg_str == "t", pc, 0});
+        } else {
+            throw std::runtime_error("Malformed value trace record: " + kind_str);
+        }
+    }
+    return trace;
+}
+
+// Builds a value trace from a branch trace such as trace_gcc.txt. Every
+// branch is followed by one value-producing instruction at pc + 4 whose
+// value behaves, depending on the pc, like a constant, a stride, a function
+// of the recent branch outcomes, or noise. Fully deterministic.
+inline std::vector<ValueTraceRecord> makeValueTraceFromBranches(const std::string& branch_trace_path,
+                                                                size_t max_branches = SIZE_MAX) {
+    std::ifstream file(branch_trace_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open branch trace " + branch_trace_path);
+    }
+
+    std::vector<ValueTraceRecord> trace;
+    std::unordered_map<PC, Value> counters;
+    uint64_t history = 0;
+    uint64_t noise = 0x9e3779b97f4a7c15ull;
+
+    std::string address_str, outcome_str;
+    size_t branches = 0;
+    while (branches < max_branches && file >> address_str >> outcome_str) {
+        PC address = std::stoull(address_str, nullptr, 16);
+        bool taken = (outcome_str == "t");
+        branches++;
+
+        trace.push_back({branch_record, taken, address, 0});
+        history = (history << 1) | taken;
+
+        PC vpc = address + 4;
+        Value val;
+        switch ((vpc >> 2) % 4) {
+        case 0:
+            val = vpc * 31;
+            break;
+        case 1:
+            val = (counters[vpc] += 8);
+            break;
+        case 2:
+            val = vpc ^ (history & 0x7);
+            break;
+        default:
+            noise ^= noise << 13;
+            noise ^= noise >> 7;
+            noise ^= noise << 17;
+            val = noise;
+            break;
+        }
+        trace.push_back({value_record, false, vpc, val});
+    }
+    return trace;
+}
+
+#endif // VALUE_TRACE_HH
@@ -11,6 +11,9 @@
 #include <deque>
 #include <iostream>
 #include <functional>
+#include <map>
+#include <algorithm>
+#include <string>
 
 using PC = uint64_t;        // Program Counter type
 using Value = uint64_t;     // Value type
@@ -21,6 +24,53 @@ constexpr size_t MAX_BRANCH_SPEC_DISTANCE = 64;
 
 enum Confidence { low=0, medium=1, high=2 };
 
+// Mixes v into the running state hash h. Used by the stateHash() methods so
+// two engines can be compared cheaply during differential validation.
+inline uint64_t mixHash(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h * 0xff51afd7ed558ccdull;
+}
+
+// Binary predictor state, as written by the save() methods: native-endian
+// 64-bit words.
+inline void saveWord(std::ostream& os, uint64_t v) {
+    os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+inline uint64_t loadWord(std::istream& is) {
+    uint64_t v;
+    if (!is.read(reinterpret_cast<char*>(&v), sizeof(v))) {
+        throw std::runtime_error("truncated predictor state");
+    }
+    return v;
+}
+
+// Bytes held by each structure of a predictor instance, for packing sweeps.
+// Heap containers are estimated from their sizes and the libstdc++ layout.
+struct MemoryFootprint {
+    std::vector<std::pair<std::string, size_t>> items;
+
+    void add(const std::string& name, size_t bytes) {
+        items.push_back({name, bytes});
+    }
+    size_t total() const {
+        size_t sum = 0;
+        for (const auto& item : items)
+            sum += item.second;
+        return sum;
+    }
+};
+
+// Per node, a malloc chunk of 32 bytes: next pointer, key and value (the hash
+// of an integer key is not cached).
+constexpr size_t UNORDERED_MAP_NODE_BYTES = 32;
+
+// A deque allocates 512-byte blocks plus a map of block pointers.
+inline size_t dequeBytes(size_t elements, size_t element_size) {
+    size_t per_block = std::max<size_t>(1, 512 / element_size);
+    size_t blocks = elements / per_block + 1;
+    return blocks * 512 + std::max<size_t>(8, blocks + 2) * sizeof(void*);
+}
+
 class LastCommittedValueTable {
 public:
     bool hasValue(PC pc) const {
@@ -36,6 +86,55 @@ public:
         table[pc] = val;
     }
 
+    // Does nothing: std::unordered_map does not expose its bucket array, so
+    // reaching the node means doing the dependent bucket and node loads a
+    // prefetch is meant to hide. Interleaved replay pays off with tables that
+    // compute the slot address directly, e.g. MappedLastCommittedValueTable.
+    void prefetch(PC) const {}
+
+    size_t size() const {
+        return table.size();
+    }
+
+    // Independent of insertion order and backend, so any two LCVTs holding
+    // the same pc -> value pairs hash equal.
+    uint64_t stateHash() const {
+        uint64_t h = 0;
+        for (const auto& [pc, val] : table) {
+            h += mixHash(pc, val);
+        }
+        return mixHash(h, table.size());
+    }
+
+    void dumpState(std::ostream& os) const {
+        std::map<PC, Value> sorted(table.begin(), table.end());
+        os << "lcvt entries=" << sorted.size() << "\n";
+        for (const auto& [pc, val] : sorted) {
+            os << "  " << std::hex << pc << " " << val << std::dec << "\n";
+        }
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        fp.add(prefix + "buckets", table.bucket_count() * sizeof(void*));
+        fp.add(prefix + "nodes", table.size() * UNORDERED_MAP_NODE_BYTES);
+    }
+
+    void save(std::ostream& os) const {
+        saveWord(os, table.size());
+        for (const auto& [pc, val] : table) {
+            saveWord(os, pc);
+            saveWord(os, val);
+        }
+    }
+    void load(std::istream& is) {
+        table.clear();
+        uint64_t n = loadWord(is);
+        for (uint64_t i = 0; i < n; i++) {
+            PC pc = loadWord(is);
+            table[pc] = loadWord(is);
+        }
+    }
+
 private:
     std::unordered_map<PC, Value> table;
 };
@@ -65,7 +164,7 @@ public:
         }
     }
 
-    bool getDirection(){
+    bool getDirection() const {
         return taken_counter > not_taken_counter;
     }
 
@@ -74,7 +173,7 @@ public:
         if (not_taken_counter>taken_counter) not_taken_counter--;
     }
 
-    Confidence getConfidence(){
+    Confidence getConfidence() const {
         bool medium = (taken_counter==(2*not_taken_counter+1)) or (not_taken_counter==(2*taken_counter+1));
         bool low = (taken_counter<(2*not_taken_counter+1)) && (not_taken_counter<(2*taken_counter+1));
 
@@ -94,23 +193,40 @@ public:
     size_t not_taken_counter;
 };
 
+// With ahead > 0 the tracker models an ahead-pipelined lookup: the index and
+// tag are hashed from the history as it was `ahead` branches ago
+// (ahead_folded_path), and only the `select_bits` most recent outcomes are
+// used, to pick an entry within the fetched set.
 class PathTracker {
 public:
-    PathTracker(size_t ghist_bits, size_t index_size, size_t tag_size)
+    PathTracker(size_t ghist_bits, size_t index_size, size_t tag_size,
+                size_t ahead = 0, size_t select_bits = 0)
         : ghist_bits(ghist_bits)
         , index_size(index_size)
         , tag_size(tag_size)
+        , ahead(ahead)
+        , select_bits(select_bits)
         , folded_path(0)
+        , ahead_folded_path(0)
+        , recent_outcomes(0)
         , outcome_buffer()
     {
         if (index_size + tag_size > 31) {
             throw std::invalid_argument("index_size + tag_size must be <= 31");
         }
+        if (ghist_bits + ahead > MAX_HIST) {
+            throw std::invalid_argument("ghist_bits + ahead must be <= MAX_HIST");
+        }
+        if (select_bits > ahead || select_bits > index_size) {
+            throw std::invalid_argument("select_bits must be <= ahead and <= index_size");
+        }
     }
 
     void addBranch(bool outcome) {
         if (ghist_bits==0)
             return;
+        if (ahead)
+            addAheadBranch(outcome);
         // Get the msb of the outcome buffer (ghist_bits)
         bool old_outcome = outcome_buffer[ghist_bits - 1];
         // Shift outcome buffer left and set new outcome
@@ -129,6 +245,8 @@ public:
         if (ghist_bits==0)
             return;
         for (size_t i = 0; i < num; i++) {
+            if (ahead)
+                revertAheadBranch();
             // Get the most recent outcome
             bool outcome = outcome_buffer[0];
             outcome_buffer >>= 1;
@@ -147,30 +265,120 @@ public:
         }
     }
     unsigned getIndex(PC pc) const {
+        if (ahead)
+            return getAheadIndex(pc);
         unsigned combined = (pc ^ (pc >> 2) ^ (pc >> 5)) ^ folded_path;
 
         return combined & ((1u << index_size) - 1);
     }
     unsigned getTag(PC pc) const {
-        unsigned combined = (pc ^ (pc >> 2) ^ (pc >> 5)) ^ folded_path;
+        unsigned combined = (pc ^ (pc >> 2) ^ (pc >> 5)) ^ (ahead ? ahead_folded_path : folded_path);
         return (combined >> index_size) & ((1u << tag_size) - 1);
     }
 
+    uint64_t stateHash() const {
+        uint64_t h = mixHash(folded_path, ghist_bits);
+        h = mixHash(h, ahead_folded_path);
+        for (size_t i = 0; i < MAX_HIST; i += 64) {
+            uint64_t word = 0;
+            for (size_t b = i; b < std::min(i + 64, MAX_HIST); b++) {
+                word |= uint64_t(outcome_buffer[b]) << (b - i);
+            }
+            h = mixHash(h, word);
+        }
+        return h;
+    }
+
+    // History only; the geometry comes from the constructor.
+    void save(std::ostream& os) const {
+        saveWord(os, folded_path);
+        saveWord(os, ahead_folded_path);
+        saveWord(os, recent_outcomes);
+        for (size_t i = 0; i < MAX_HIST; i += 64) {
+            uint64_t word = 0;
+            for (size_t b = i; b < std::min(i + 64, MAX_HIST); b++) {
+                word |= uint64_t(outcome_buffer[b]) << (b - i);
+            }
+            saveWord(os, word);
+        }
+    }
+    void load(std::istream& is) {
+        folded_path = loadWord(is);
+        ahead_folded_path = loadWord(is);
+        recent_outcomes = loadWord(is);
+        for (size_t i = 0; i < MAX_HIST; i += 64) {
+            uint64_t word = loadWord(is);
+            for (size_t b = i; b < std::min(i + 64, MAX_HIST); b++) {
+                outcome_buffer[b] = (word >> (b - i)) & 1;
+            }
+        }
+    }
+
     size_t ghist_bits;
     size_t index_size;
     size_t tag_size;
+    size_t ahead;
+    size_t select_bits;
     unsigned int folded_path;
+    unsigned int ahead_folded_path;
+    uint64_t recent_outcomes;
     std::bitset<MAX_HIST> outcome_buffer;   
+
+private:
+    // Same fold as folded_path, over outcome_buffer[ahead, ahead + ghist_bits).
+    // Called before outcome_buffer is shifted.
+    void addAheadBranch(bool outcome) {
+        bool entering = outcome_buffer[ahead - 1];
+        bool leaving = outcome_buffer[ahead + ghist_bits - 1];
+        size_t width = index_size + tag_size;
+        unsigned int msb = (ahead_folded_path >> (width - 1)) & 1;
+        ahead_folded_path = ((ahead_folded_path << 1) & ((1u << width) - 1)) | msb;
+        ahead_folded_path ^= (leaving << (ghist_bits % width));
+        ahead_folded_path ^= entering;
+        recent_outcomes = (recent_outcomes << 1) | outcome;
+    }
+    // Called before outcome_buffer is shifted back.
+    void revertAheadBranch() {
+        bool entered = outcome_buffer[ahead];
+        bool left = (ahead + ghist_bits < MAX_HIST) && outcome_buffer[ahead + ghist_bits];
+        size_t width = index_size + tag_size;
+        ahead_folded_path ^= entered;
+        ahead_folded_path ^= (left << (ghist_bits % width));
+        unsigned int lsb = ahead_folded_path & 1;
+        ahead_folded_path >>= 1;
+        ahead_folded_path |= (lsb << (width - 1));
+        recent_outcomes = (recent_outcomes >> 1) | (uint64_t(outcome_buffer[64]) << 63);
+    }
+    unsigned getAheadIndex(PC pc) const {
+        unsigned hashed = pc ^ (pc >> 2) ^ (pc >> 5);
+        unsigned select_mask = (1u << select_bits) - 1;
+        unsigned set = (hashed ^ ahead_folded_path) & ((1u << index_size) - 1) & ~select_mask;
+        return set | ((hashed ^ unsigned(recent_outcomes)) & select_mask);
+    }
 };
 
 class EqualityPredictorComponent {
 public:
     EqualityPredictorComponent(size_t size, size_t ghist_bits, 
-                              size_t index_bits, size_t tag_bits)
-        : path(ghist_bits, index_bits, tag_bits)
+                              size_t index_bits, size_t tag_bits,
+                              size_t ahead = 0, size_t select_bits = 0)
+        : path(ghist_bits, index_bits, tag_bits, ahead, select_bits)
         , components(size)
     {}
 
+    unsigned getIndex(PC pc) const {
+        return path.getIndex(pc);
+    }
+
+    unsigned getTag(PC pc) const {
+        return path.getTag(pc);
+    }
+
+    EqualityPredictorEntry& entryAt(size_t index) {
+        assert(index<components.size());
+        return components[index];
+    }
+
     EqualityPredictorEntry& getEntryConflict(PC pc) {
         unsigned index = path.getIndex(pc);
 
@@ -180,8 +388,14 @@ public:
     }
 
     std::optional<std::reference_wrapper<EqualityPredictorEntry>> getEntry(PC pc) {
+        return getEntry(pc, path.getIndex(pc));
+    }
+
+    // For a caller that already has getIndex(pc).
+    std::optional<std::reference_wrapper<EqualityPredictorEntry>> getEntry(PC pc, unsigned index) {
         unsigned tag = path.getTag(pc);
-        EqualityPredictorEntry& entry = getEntryConflict(pc);
+        assert(index<components.size());
+        EqualityPredictorEntry& entry = components[index];
         
         if (entry.tag == tag) {
             return std::ref(entry);
@@ -217,25 +431,269 @@ public:
     void revertBranches(size_t num) {
         path.revertBranches(num);
     }
+
+    uint64_t stateHash() const {
+        uint64_t h = path.stateHash();
+        for (const auto& entry : components) {
+            h = mixHash(h, entry.tag);
+            h = mixHash(h, (entry.taken_counter << 8) | entry.not_taken_counter);
+        }
+        return h;
+    }
+
+    // Prints the history and every entry that differs from a reset entry.
+    void dumpState(std::ostream& os) const {
+        os << "ghist_bits=" << path.ghist_bits << " folded_path=" << path.folded_path
+           << " outcomes=" << path.outcome_buffer.to_string().substr(MAX_HIST - path.ghist_bits) << "\n";
+        for (size_t i = 0; i < components.size(); i++) {
+            const auto& entry = components[i];
+            if (entry.tag == 0 && entry.taken_counter == 0 && entry.not_taken_counter == 0)
+                continue;
+            os << "  [" << i << "] tag=" << entry.tag << " t=" << entry.taken_counter
+               << " nt=" << entry.not_taken_counter << "\n";
+        }
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        fp.add(prefix + "entries", components.capacity() * sizeof(EqualityPredictorEntry));
+        fp.add(prefix + "path", sizeof(PathTracker));
+    }
+
+    void save(std::ostream& os) const {
+        path.save(os);
+        for (const auto& entry : components) {
+            saveWord(os, entry.tag);
+            saveWord(os, (entry.taken_counter << 8) | entry.not_taken_counter);
+        }
+    }
+    void load(std::istream& is) {
+        path.load(is);
+        for (auto& entry : components) {
+            entry.tag = loadWord(is);
+            uint64_t counters = loadWord(is);
+            entry.taken_counter = counters >> 8;
+            entry.not_taken_counter = counters & 0xff;
+        }
+    }
 private:
     PathTracker path;
     std::vector<EqualityPredictorEntry> components;
 };
 
+// Read-port model for predictions made in the same cycle. Each component is
+// split into `banks` banks selected by the low index bits, and each bank
+// serves `read_ports` distinct entries per cycle. Requests beyond that lose:
+// they are counted, and with drop_losers the component is treated as a miss
+// for that prediction.
+struct BankModel {
+    size_t banks = 1;
+    size_t read_ports = 1;
+    bool drop_losers = false;
+};
+
+struct BankConflictStats {
+    uint64_t groups = 0;
+    uint64_t predictions = 0;
+    uint64_t predictions_with_conflict = 0;
+    std::vector<uint64_t> reads;      // per component
+    std::vector<uint64_t> conflicts;  // per component
+};
+
+// Overriding (fast/slow) prediction: the tagless base component answers
+// first and the full predictor later, overriding the fast answer when they
+// disagree.
+template <class T>
+struct OverridingPrediction {
+    std::pair<Confidence, T> fast;  // base component only
+    std::pair<Confidence, T> full;  // all components
+    bool has_provider;
+    size_t provider;                // component providing `full`
+
+    // A late override is a disagreement on what would be used: the value,
+    // or whether the prediction is confident enough to use at all.
+    bool overrides() const {
+        return fast.second != full.second || (fast.first == high) != (full.first == high);
+    }
+};
+
+struct OverrideStats {
+    uint64_t predictions = 0;
+    uint64_t overrides = 0;
+    uint64_t fixed = 0;   // overrides that turned a wrong fast prediction into a right one
+    uint64_t broken = 0;  // overrides that turned a right fast prediction into a wrong one
+    uint64_t fast_correct = 0;
+    uint64_t full_correct = 0;
+    std::vector<uint64_t> overrides_by_component;
+
+    template <class T>
+    void record(const OverridingPrediction<T>& p, T outcome) {
+        bool fast_ok = p.fast.second == outcome;
+        bool full_ok = p.full.second == outcome;
+        predictions++;
+        fast_correct += fast_ok;
+        full_correct += full_ok;
+        if (!p.overrides())
+            return;
+        overrides++;
+        fixed += (!fast_ok && full_ok);
+        broken += (fast_ok && !full_ok);
+        if (p.has_provider) {
+            if (overrides_by_component.size() <= p.provider)
+                overrides_by_component.resize(p.provider + 1, 0);
+            overrides_by_component[p.provider]++;
+        }
+    }
+};
+
+// Entry writes of one component. A silent write stores exactly the state the
+// entry already had, e.g. update(true) on a saturated taken counter.
+struct WriteStats {
+    uint64_t real = 0;
+    uint64_t silent = 0;       // silent writes that were performed
+    uint64_t suppressed = 0;   // silent writes dropped by the filter
+    uint64_t allocations = 0;
+
+    uint64_t physicalWrites() const { return real + silent + allocations; }
+};
+
+// Accesses to one predictor table, the input of the energy model in
+// energy_model.h. Writes are the stores actually performed.
+struct TableActivity {
+    uint64_t reads = 0;
+    uint64_t tag_compares = 0;
+    uint64_t writes = 0;
+    uint64_t allocations = 0;
+};
+
 struct ComponentConfig {
     size_t size;
     size_t ghist_bits;
     size_t index_bits;
     size_t tag_bits;
+    // Ahead pipelining, see PathTracker. 0 indexes with the latest history.
+    size_t ahead = 0;
+    size_t select_bits = 0;
+};
+
+// Identifies a predictor geometry, e.g. the one a prediction stream or a
+// kernel was produced for.
+inline uint64_t componentConfigHash(const std::vector<ComponentConfig>& configs) {
+    uint64_t h = mixHash(0, configs.size());
+    for (const auto& c : configs) {
+        h = mixHash(h, c.size);
+        h = mixHash(h, c.ghist_bits);
+        h = mixHash(h, c.index_bits);
+        h = mixHash(h, c.tag_bits);
+        h = mixHash(h, c.ahead);
+        h = mixHash(h, c.select_bits);
+    }
+    return h;
+}
+
+// The EqualityPredictor lookup and commit policy over copies of the n
+// entries one lookup reads. EqualityPredictor::onValueCommit applies it to
+// its own tables, and engines that keep their tables elsewhere use it
+// directly. hit[i] says whether entries[i] matched tags[i]. The lookup is
+// that of getPredictingEntries; random() supplies the allocation decay draws.
+struct EqualityLookup {
+    size_t primary;  // n if no component hits
+    size_t alt;      // n if fewer than two components hit
 };
 
+inline EqualityLookup findEqualityProviders(const EqualityPredictorEntry* entries, const bool* hit, size_t n) {
+    EqualityLookup l{n, n};
+    for (size_t i = 0; i < n; i++) {
+        if (hit[i] && (l.primary == n || entries[i].getConfidence() >= entries[l.primary].getConfidence())) {
+            l.alt = l.primary;
+            l.primary = i;
+        }
+    }
+    return l;
+}
+
+// Every write goes through store(i, entry, next, allocation) before
+// entries[i] becomes next, so a caller can count it or mirror it into its
+// own table.
+template <class Random, class Store>
+void commitEqualityEntries(EqualityPredictorEntry* entries, const bool* hit, const unsigned* tags, size_t n,
+                           const EqualityLookup& l, bool outcome, Random&& random, Store&& store) {
+    auto write = [&](size_t i, const EqualityPredictorEntry& next, bool allocation) {
+        store(i, entries[i], next, allocation);
+        entries[i] = next;
+    };
+    auto updated = [&](size_t i) {
+        EqualityPredictorEntry next = entries[i];
+        next.update(outcome);
+        return next;
+    };
+    auto decayed = [&](size_t i) {
+        EqualityPredictorEntry next = entries[i];
+        next.decay();
+        return next;
+    };
+    bool prediction = l.primary < n && entries[l.primary].getDirection();
+    bool has_alt = l.alt < n;
+    size_t longest_hitting_index = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!hit[i])
+            continue;
+        longest_hitting_index = i;
+        if (i > l.primary) {
+            write(i, updated(i), false);
+        } else if (i == l.primary) {
+            if (i == 0 || entries[i].getConfidence() != high
+                || (has_alt && entries[l.alt].getConfidence() < high)
+                || (has_alt && entries[l.alt].getDirection() != outcome)) {
+                write(i, updated(i), false);
+            } else {
+                write(i, decayed(i), false);
+            }
+        } else if (i == l.alt && entries[l.primary].getConfidence() != high) {
+            write(i, updated(i), false);
+        }
+    }
+
+    if (prediction != outcome) {
+        size_t s = longest_hitting_index + 1;
+        size_t r = n;
+        for (size_t i = s; i < n; i++) {
+            if (entries[i].getConfidence() != high) {
+                r = i;
+                EqualityPredictorEntry next(tags[i]);
+                next.update(outcome);
+                write(i, next, true);
+                break;
+            }
+        }
+        for (size_t i = s; i < r; i++) {
+            if ((random() & 3) == 0)
+                write(i, decayed(i), false);
+        }
+    }
+}
+
+template <class Random>
+void commitEqualityEntries(EqualityPredictorEntry* entries, const bool* hit, const unsigned* tags, size_t n,
+                           const EqualityLookup& l, bool outcome, Random&& random) {
+    commitEqualityEntries(entries, hit, tags, n, l, outcome, random,
+                          [](size_t, const EqualityPredictorEntry&, const EqualityPredictorEntry&, bool) {});
+}
+
 class EqualityPredictor {
 public:
-    EqualityPredictor(const std::vector<ComponentConfig>& configs) {
+    // Components are tracked in 64-bit masks, so there are at most 64.
+    EqualityPredictor(const std::vector<ComponentConfig>& configs, uint64_t seed = 1)
+        : component_configs(configs), write_stats(configs.size())
+    {
+        if (configs.size() > 64) {
+            throw std::invalid_argument("an EqualityPredictor has at most 64 components");
+        }
+        this->seed(seed);
         components.reserve(configs.size());
         for (const auto& config : configs) {
             components.emplace_back(config.size, config.ghist_bits, 
-                                    config.index_bits, config.tag_bits);
+                                    config.index_bits, config.tag_bits,
+                                    config.ahead, config.select_bits);
         }
     }
 
@@ -258,7 +716,9 @@ public:
         size_t alt_index;
     };
 
-    PredictionData getPredictingEntries(PC pc) {
+    // Components whose bit is set in `unavailable` are treated as missing.
+    // indices, if given, holds each component's getIndex(pc).
+    PredictionData getPredictingEntries(PC pc, uint64_t unavailable = 0, const unsigned* indices = nullptr) {
         PredictionData result{
             std::nullopt,
             0,
@@ -267,8 +727,14 @@ public:
         };
         
         for (size_t i = 0; i < components.size(); i++) {
+            if ((unavailable >> i) & 1)
+                continue;
+            if (activity) {
+                (*activity)[i].reads++;
+                (*activity)[i].tag_compares += component_configs[i].tag_bits != 0;
+            }
             auto& component = components[i];
-            auto entryOpt = component.getEntry(pc);
+            auto entryOpt = indices ? component.getEntry(pc, indices[i]) : component.getEntry(pc);
 
             if (entryOpt.has_value()) {
                 auto& entry = entryOpt.value().get();
@@ -298,74 +764,127 @@ public:
         return {Confidence::low, false};
     }
 
-    std::optional<std::reference_wrapper<EqualityPredictorEntry>> predictingEntry(PC pc) {
-        PredictionData pd = getPredictingEntries(pc);
-        return pd.primary;
-    }
+    OverridingPrediction<bool> predictOverriding(PC pc) {
+        OverridingPrediction<bool> result{{Confidence::low, false}, {Confidence::low, false}, false, 0};
 
-    void onValueCommit(PC pc, bool wasEqual, bool debug = false){
-        PredictionData pd = getPredictingEntries(pc);
-
-        bool prediction = pd.primary.has_value() && pd.primary.value().get().getDirection();
-        size_t longest_hitting_index = 0;
-
-        for(size_t i=0; i<components.size(); i++){
-            auto entryOpt = components[i].getEntry(pc);
-
-            if (entryOpt.has_value()) {
-                bool is_alt = (pd.alt.has_value() && i==pd.alt_index);
-                bool is_primary = (i==pd.primary_index);
-                bool is_longer_than_primary = (i>pd.primary_index);
-
-                longest_hitting_index = i;
+        auto base = components[0].getEntry(pc);
+        if (base.has_value()) {
+            auto& entry = base.value().get();
+            result.fast = {entry.getConfidence(), entry.getDirection()};
+        }
 
-                auto& entry = entryOpt.value().get();
+        PredictionData pd = getPredictingEntries(pc);
+        if (pd.primary.has_value()) {
+            auto& entry = pd.primary.value().get();
+            result.full = {entry.getConfidence(), entry.getDirection()};
+            result.has_provider = true;
+            result.provider = pd.primary_index;
+        }
+        return result;
+    }
 
-                if (is_longer_than_primary) {
-                    entry.update(wasEqual);
-                } else if (is_primary) {
-                    assert(i==0 || (pd.alt.has_value()));
-                    if (i==0 || entry.getConfidence()!=Confidence::high
-                             || (pd.alt.has_value() && pd.alt.value().get().getConfidence() < high)
-                             || (pd.alt.has_value() && pd.alt.value().get().getDirection() != wasEqual) ){
-                        entry.update(wasEqual);
-                    } else if (i>0 && entry.getConfidence()==Confidence::high && (pd.alt.value().get().getConfidence()==Confidence::high && pd.alt.value().get().getDirection() == wasEqual)){
-                        entry.decay();
-                    }
-                } else if (is_alt) {
-                    if (pd.primary.value().get().getConfidence()!=high){
-                        entry.update(wasEqual);
-                    }
+    // Predicts a fetch group of n PCs in one cycle under a bank/port model.
+    // All predictions see the same history.
+    void predictGroup(const PC* pcs, size_t n, const BankModel& model,
+                      std::pair<Confidence, bool>* out, BankConflictStats& stats) {
+        if (n > 64) {
+            throw std::invalid_argument("fetch group is limited to 64 predictions");
+        }
+        if (model.banks == 0 || (model.banks & (model.banks - 1)) != 0) {
+            throw std::invalid_argument("bank count must be a power of two");
+        }
+        if (model.read_ports == 0) {
+            throw std::invalid_argument("banks need at least one read port");
+        }
+        stats.reads.resize(components.size(), 0);
+        stats.conflicts.resize(components.size(), 0);
+        stats.groups++;
+        stats.predictions += n;
+
+        // Each index is hashed once, for the port model, and reused for the reads
+        uint64_t lost[64] = {};
+        size_t count = components.size();
+        group_indices.resize(n * count);
+        granted.resize(model.banks * model.read_ports);
+        granted_count.resize(model.banks);
+        for (size_t c = 0; c < count; c++) {
+            std::fill(granted_count.begin(), granted_count.end(), 0);
+            for (size_t i = 0; i < n; i++) {
+                unsigned index = components[c].getIndex(pcs[i]);
+                group_indices[i * count + c] = index;
+                size_t bank = index & (model.banks - 1);
+                unsigned* ports = &granted[bank * model.read_ports];
+                stats.reads[c]++;
+
+                // Requests for an entry already being read share the port
+                if (std::find(ports, ports + granted_count[bank], index) != ports + granted_count[bank])
+                    continue;
+                if (granted_count[bank] < model.read_ports) {
+                    ports[granted_count[bank]++] = index;
+                } else {
+                    stats.conflicts[c]++;
+                    lost[i] |= uint64_t(1) << c;
                 }
             }
         }
 
-        // Allocation
-        if (prediction!=wasEqual){
-            size_t s = longest_hitting_index + (1); // todo add small rand
-            
-            size_t r = components.size();
-
-            for (size_t i = s; i < components.size(); i++) {
-                auto& entry = components[i].getEntryConflict(pc);
-                if (entry.getConfidence() != high) {
-                    r = i;
-                    components[i].allocate(pc, wasEqual);
-                    break;
-                }
+        for (size_t i = 0; i < n; i++) {
+            if (lost[i])
+                stats.predictions_with_conflict++;
+            PredictionData pd = getPredictingEntries(pcs[i], model.drop_losers ? lost[i] : 0, &group_indices[i * count]);
+            if (pd.primary.has_value()) {
+                auto& entry = pd.primary.value().get();
+                out[i] = {entry.getConfidence(), entry.getDirection()};
+            } else {
+                out[i] = {Confidence::low, false};
             }
+        }
+    }
 
-            for (size_t i = s; i < r; i++) {
-                auto& entry = components[i].getEntryConflict(pc);
-
-                assert(entry.getConfidence() == high);
+    std::optional<std::reference_wrapper<EqualityPredictorEntry>> predictingEntry(PC pc) {
+        PredictionData pd = getPredictingEntries(pc);
+        return pd.primary;
+    }
 
-                if (rand() % 4 == 0)
-                    entry.decay();
+    // Applies commitEqualityEntries to the entries pc reads, storing each
+    // write through writeEntry so it is counted (and filtered).
+    void onValueCommit(PC pc, bool wasEqual, bool debug = false){
+        size_t n = components.size();
+        EqualityPredictorEntry entries[64];
+        bool hit[64];
+        unsigned tags[64], indices[64];
+        for (size_t i = 0; i < n; i++) {
+            if (activity) {
+                (*activity)[i].reads++;
+                (*activity)[i].tag_compares += component_configs[i].tag_bits != 0;
             }
+            indices[i] = components[i].getIndex(pc);
+            tags[i] = components[i].getTag(pc);
+            entries[i] = components[i].entryAt(indices[i]);
+            hit[i] = entries[i].tag == tags[i];
         }
+        EqualityLookup l = findEqualityProviders(entries, hit, n);
+        commitEqualityEntries(entries, hit, tags, n, l, wasEqual, [this] { return nextRandom(); },
+                              [&](size_t i, const EqualityPredictorEntry&, const EqualityPredictorEntry& next,
+                                  bool allocation) {
+            EqualityPredictorEntry& stored = components[i].entryAt(indices[i]);
+            if (!allocation) {
+                writeEntry(i, stored, next);
+                return;
+            }
+            stored = next;
+            write_stats[i].allocations++;
+            if (activity)
+                (*activity)[i].allocations++;
+        });
     }
 
+    // Whether seqNum is the oldest in-flight branch, i.e. may be committed next.
+    bool isOldestBranch(InstSeqNum seqNum) const {
+        return !branch_queue.empty() && branch_queue.front() == seqNum;
+    }
+    // Branches updated but not yet committed or squashed.
+    size_t inFlightBranches() const { return branch_queue.size(); }
     void onBranchCommit(InstSeqNum seqNum){
         assert(branch_queue.front() == seqNum);
         branch_queue.pop_front();
@@ -384,18 +903,158 @@ public:
         }
     }
 
+    // With the filter on, updates that would not change an entry are not
+    // stored. Predictions and state are the same either way.
+    void setSilentWriteFilter(bool enabled) {
+        filter_silent_writes = enabled;
+    }
+    const std::vector<WriteStats>& writeStats() const {
+        return write_stats;
+    }
+
+    // Counts table accesses into `counters`, one per component, which must
+    // outlive the predictor. Lookups are counted at prediction and at commit.
+    // nullptr (the default) turns counting off.
+    void setActivityCounters(std::vector<TableActivity>* counters) {
+        activity = counters;
+        if (activity)
+            activity->resize(components.size());
+    }
+    const std::vector<ComponentConfig>& configs() const {
+        return component_configs;
+    }
+
+    // Direct table access, e.g. to load a snapshot. Bypasses write accounting.
+    EqualityPredictorEntry& entryAt(size_t component, size_t index) {
+        return components[component].entryAt(index);
+    }
+
+    // Allocation decays are randomised from a per-predictor generator, so two
+    // predictors given the same seed and the same inputs stay identical.
+    void seed(uint64_t s) {
+        rng_state = s ? s : 1;
+    }
+
+    uint64_t stateHash() const {
+        uint64_t h = mixHash(rng_state, branch_queue.size());
+        for (InstSeqNum seq : branch_queue) {
+            h = mixHash(h, seq);
+        }
+        for (const auto& component : components) {
+            h = mixHash(h, component.stateHash());
+        }
+        return h;
+    }
+
+    void dumpState(std::ostream& os) const {
+        os << "rng_state=" << rng_state << " branch_queue=" << branch_queue.size() << "\n";
+        for (size_t i = 0; i < components.size(); i++) {
+            os << "component " << i << " ";
+            components[i].dumpState(os);
+        }
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix = "ep.") const {
+        for (size_t i = 0; i < components.size(); i++) {
+            components[i].accountMemory(fp, prefix + "component" + std::to_string(i) + ".");
+        }
+        fp.add(prefix + "branch_queue", dequeBytes(branch_queue.size(), sizeof(InstSeqNum)));
+        fp.add(prefix + "bookkeeping", sizeof(*this) + component_configs.capacity() * sizeof(ComponentConfig)
+                                       + write_stats.capacity() * sizeof(WriteStats)
+                                       + granted.capacity() * sizeof(unsigned)
+                                       + granted_count.capacity() * sizeof(size_t));
+    }
+
+    // Saves everything stateHash() covers. load() expects state saved by a
+    // predictor with the same configuration and throws otherwise.
+    void save(std::ostream& os) const {
+        saveWord(os, components.size());
+        for (const auto& c : component_configs) {
+            for (uint64_t field : {c.size, c.ghist_bits, c.index_bits, c.tag_bits, c.ahead, c.select_bits})
+                saveWord(os, field);
+        }
+        saveWord(os, rng_state);
+        saveWord(os, branch_queue.size());
+        for (InstSeqNum seq : branch_queue) {
+            saveWord(os, seq);
+        }
+        for (const auto& component : components) {
+            component.save(os);
+        }
+    }
+    void load(std::istream& is) {
+        if (loadWord(is) != components.size()) {
+            throw std::runtime_error("saved predictor has a different component count");
+        }
+        for (const auto& c : component_configs) {
+            for (uint64_t field : {c.size, c.ghist_bits, c.index_bits, c.tag_bits, c.ahead, c.select_bits}) {
+                if (loadWord(is) != field)
+                    throw std::runtime_error("saved predictor has a different configuration");
+            }
+        }
+        rng_state = loadWord(is);
+        uint64_t queued = loadWord(is);
+        if (queued > MAX_BRANCH_SPEC_DISTANCE) {
+            throw std::runtime_error("saved predictor has too many speculative branches");
+        }
+        branch_queue.resize(queued);
+        for (InstSeqNum& seq : branch_queue) {
+            seq = loadWord(is);
+        }
+        for (auto& component : components) {
+            component.load(is);
+        }
+    }
+
 private:
+    void updateEntry(size_t component, EqualityPredictorEntry& entry, bool outcome) {
+        EqualityPredictorEntry next = entry;
+        next.update(outcome);
+        writeEntry(component, entry, next);
+    }
+    void decayEntry(size_t component, EqualityPredictorEntry& entry) {
+        EqualityPredictorEntry next = entry;
+        next.decay();
+        writeEntry(component, entry, next);
+    }
+    void writeEntry(size_t component, EqualityPredictorEntry& entry, const EqualityPredictorEntry& next) {
+        if (next.taken_counter == entry.taken_counter && next.not_taken_counter == entry.not_taken_counter) {
+            if (filter_silent_writes) {
+                write_stats[component].suppressed++;
+                return;
+            }
+            write_stats[component].silent++;
+        } else {
+            write_stats[component].real++;
+        }
+        if (activity)
+            (*activity)[component].writes++;
+        entry = next;
+    }
+
+    uint64_t nextRandom() {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        return rng_state;
+    }
+
+    std::vector<ComponentConfig> component_configs;
     std::vector<EqualityPredictorComponent> components;
     std::deque<InstSeqNum> branch_queue;
+    uint64_t rng_state;
+    std::vector<WriteStats> write_stats;
+    std::vector<TableActivity>* activity = nullptr;
+    bool filter_silent_writes = false;
+    // Scratch space for predictGroup
+    std::vector<unsigned> granted;
+    std::vector<size_t> granted_count;
+    std::vector<unsigned> group_indices;    // [prediction * components + component]
 };
 
-struct ValuePredictorParams {
-    // Add configuration parameters here
-};
-
-class ValuePredictor {
-public:
-    ValuePredictor(const ValuePredictorParams& params) : params(params), ep({
+// Equality predictor geometry used by ValuePredictor.
+inline std::vector<ComponentConfig> defaultValuePredictorConfig() {
+    return {
         // Base tagless component
         {.size = 4096, .ghist_bits = 0, .index_bits = 12, .tag_bits = 0},
         {.size = 1024, .ghist_bits = 2, .index_bits = 9, .tag_bits = 12},
@@ -404,45 +1063,175 @@ public:
         {.size = 1024, .ghist_bits = 16, .index_bits = 9, .tag_bits = 12},
         {.size = 1024, .ghist_bits = 32, .index_bits = 9, .tag_bits = 12},
         {.size = 1024, .ghist_bits = 64, .index_bits = 9, .tag_bits = 12},
-    }) {}
+    };
+}
+
+struct ValuePredictorParams {
+    std::vector<ComponentConfig> components = defaultValuePredictorConfig();
+};
+
+// The read behind a delivered prediction. Tables that model access latency
+// overload it to tell predictions apart from commit-time reads.
+template <class Table>
+Value lcvtPredictLookup(Table& table, PC pc) {
+    return table.lookup(pc);
+}
+
+// The LCVT backend is a template parameter; any table with hasValue, lookup,
+// update and prefetch can be used. Extra constructor arguments are
+// forwarded to the table.
+template <class Table = LastCommittedValueTable>
+class BasicValuePredictor {
+public:
+    template <class... TableArgs>
+    BasicValuePredictor(const ValuePredictorParams& params, TableArgs&&... table_args)
+        : params(params), lcvt(std::forward<TableArgs>(table_args)...), ep(params.components) {}
 
-    ~ValuePredictor() = default;
+    ~BasicValuePredictor() = default;
 
     // Deleted copy/move operations to prevent accidental copies
-    ValuePredictor(const ValuePredictor&) = delete;
-    ValuePredictor& operator=(const ValuePredictor&) = delete;
-    ValuePredictor(ValuePredictor&&) = delete;
-    ValuePredictor& operator=(ValuePredictor&&) = delete;
+    BasicValuePredictor(const BasicValuePredictor&) = delete;
+    BasicValuePredictor& operator=(const BasicValuePredictor&) = delete;
+    BasicValuePredictor(BasicValuePredictor&&) = delete;
+    BasicValuePredictor& operator=(BasicValuePredictor&&) = delete;
 
     // Core functionality
     std::pair<Confidence,Value> predict(PC pc) {
         auto pred = ep.predict(pc);
+        if (lcvt_activity) {
+            lcvt_activity->reads++;
+            lcvt_activity->tag_compares++;
+        }
 
         if (!lcvt.hasValue(pc) || !pred.second){
             return {Confidence::low, 0};
         }
 
-        Value val = lcvt.lookup(pc);
+        Value val = lcvtPredictLookup(lcvt, pc);
         return {pred.first, val};
     }
     void updateOnBranch(InstSeqNum seqNum, bool taken){
         ep.updateOnBranch(seqNum, taken);
     }
     void onValueCommit(PC pc, Value val){
+        if (lcvt_activity) {
+            lcvt_activity->reads++;
+            lcvt_activity->tag_compares++;
+            // An allocation is not also counted as a write, as for the EqualityPredictor
+            if (lcvt.hasValue(pc))
+                lcvt_activity->writes++;
+            else
+                lcvt_activity->allocations++;
+        }
         ep.onValueCommit(pc, val == lcvt.lookup(pc));
         lcvt.update(pc, val);
     }
+    bool isOldestBranch(InstSeqNum seqNum) const {
+        return ep.isOldestBranch(seqNum);
+    }
+    size_t inFlightBranches() const {
+        return ep.inFlightBranches();
+    }
     void onBranchCommit(InstSeqNum seqNum){
         ep.onBranchCommit(seqNum);
     }
     void squash(InstSeqNum seqNum){
         ep.squash(seqNum);
     }
+    void prefetch(PC pc) const {
+        lcvt.prefetch(pc);
+    }
+    // Reads the LCVT as predict() does, so its full prediction is the one
+    // predict() would deliver and the activity counters see one prediction.
+    OverridingPrediction<Value> predictOverriding(PC pc) {
+        OverridingPrediction<bool> eq = ep.predictOverriding(pc);
+        if (lcvt_activity) {
+            lcvt_activity->reads++;
+            lcvt_activity->tag_compares++;
+        }
+        bool known = lcvt.hasValue(pc);
+        Value val = 0;
+        if (known && eq.full.second) {
+            val = lcvtPredictLookup(lcvt, pc);
+        } else if (known && eq.fast.second) {
+            val = lcvt.lookup(pc);
+        }
+
+        auto gate = [&](std::pair<Confidence, bool> p) -> std::pair<Confidence, Value> {
+            return (known && p.second) ? std::make_pair(p.first, val) : std::make_pair(Confidence::low, Value(0));
+        };
+        return {gate(eq.fast), gate(eq.full), eq.has_provider, eq.provider};
+    }
+    // Predicts a fetch group under a bank/port model, see EqualityPredictor::predictGroup.
+    void predictGroup(const PC* pcs, size_t n, const BankModel& model,
+                      std::pair<Confidence, Value>* out, BankConflictStats& stats) {
+        std::pair<Confidence, bool> eq[64];
+        ep.predictGroup(pcs, n, model, eq, stats);
+        for (size_t i = 0; i < n; i++) {
+            if (!lcvt.hasValue(pcs[i]) || !eq[i].second) {
+                out[i] = {Confidence::low, 0};
+            } else {
+                out[i] = {eq[i].first, lcvtPredictLookup(lcvt, pcs[i])};
+            }
+        }
+    }
+    void seed(uint64_t s) {
+        ep.seed(s);
+    }
+
+    void setSilentWriteFilter(bool enabled) {
+        ep.setSilentWriteFilter(enabled);
+    }
+    const std::vector<WriteStats>& writeStats() const {
+        return ep.writeStats();
+    }
+
+    // See EqualityPredictor::setActivityCounters. Either pointer may be nullptr.
+    void setActivityCounters(std::vector<TableActivity>* ep_counters, TableActivity* lcvt_counters) {
+        ep.setActivityCounters(ep_counters);
+        lcvt_activity = lcvt_counters;
+    }
+    const std::vector<ComponentConfig>& configs() const {
+        return ep.configs();
+    }
+    size_t lcvtSize() const {
+        return lcvt.size();
+    }
+    const Table& lcvtTable() const {
+        return lcvt;
+    }
+
+    uint64_t stateHash() const {
+        return mixHash(ep.stateHash(), lcvt.stateHash());
+    }
+    void dumpState(std::ostream& os) const {
+        ep.dumpState(os);
+        lcvt.dumpState(os);
+    }
+
+    // Requires a Table with accountMemory.
+    void accountMemory(MemoryFootprint& fp) const {
+        ep.accountMemory(fp, "ep.");
+        lcvt.accountMemory(fp, "lcvt.");
+    }
+
+    // Requires a Table with save/load.
+    void save(std::ostream& os) const {
+        ep.save(os);
+        lcvt.save(os);
+    }
+    void load(std::istream& is) {
+        ep.load(is);
+        lcvt.load(is);
+    }
 
 private:
     ValuePredictorParams params;
-    LastCommittedValueTable lcvt;
+    Table lcvt;
     EqualityPredictor ep;
+    TableActivity* lcvt_activity = nullptr;
 };
 
+using ValuePredictor = BasicValuePredictor<>;
+
 #endif // VALUE_PREDICTOR_HH
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef VP_ABLATION_HH
+#define VP_ABLATION_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <iomanip>
+#include <ostream>
+
+// Leave-one-component-out ablation of the value predictor's
+// EqualityPredictor in a single pass. Alongside the full predictor, one
+// variant per tagged component runs with that component removed, exactly as
+// a ValuePredictor configured without it would. The tagless base component
+// always hits and cannot be removed. All variants share the trace, the LCVT
+// (which does not depend on the EqualityPredictor), the path histories and
+// the index and tag of every component; only the table contents and the
+// allocation decay generator are per variant.
+struct AblationResult {
+    std::vector<ComponentConfig> configs;
+    ReplayStats full;
+    std::vector<ReplayStats> without;  // without[k]: component k + 1 removed
+};
+
+class ValuePredictorAblation {
+public:
+    ValuePredictorAblation(const std::vector<ComponentConfig>& configs = defaultValuePredictorConfig(),
+                           uint64_t seed = 1)
+        : configs(configs)
+    {
+        if (configs.empty() || configs[0].tag_bits != 0) {
+            throw std::invalid_argument("ablation needs a tagless base component first");
+        }
+        if (configs.size() > 64) {
+            throw std::invalid_argument("ablation is limited to 64 components");
+        }
+        for (const auto& config : configs) {
+            paths.emplace_back(config.ghist_bits, config.index_bits, config.tag_bits,
+                               config.ahead, config.select_bits);
+        }
+        // Variant 0 is the full predictor, variant k lacks component k
+        for (size_t v = 0; v < configs.size(); v++) {
+            Variant variant;
+            variant.rng_state = seed ? seed : 1;
+            for (size_t c = 0; c < configs.size(); c++) {
+                if (v != 0 && c == v)
+                    continue;
+                variant.active.push_back(c);
+                variant.tables.emplace_back(configs[c].size);
+            }
+            variants.push_back(std::move(variant));
+        }
+        index.resize(configs.size());
+        tags.resize(configs.size());
+    }
+
+    void step(const ValueTraceRecord& rec) {
+        if (rec.kind == branch_record) {
+            for (auto& path : paths) {
+                path.addBranch(rec.taken);
+            }
+            for (auto& variant : variants) {
+                variant.stats.branches++;
+            }
+            return;
+        }
+
+        for (size_t c = 0; c < paths.size(); c++) {
+            index[c] = paths[c].getIndex(rec.pc);
+            tags[c] = paths[c].getTag(rec.pc);
+        }
+        bool known = lcvt.hasValue(rec.pc);
+        Value last = lcvt.lookup(rec.pc);
+        bool equal = (rec.value == last);
+        for (auto& variant : variants) {
+            stepVariant(variant, known, last, rec.value, equal);
+        }
+        lcvt.update(rec.pc, rec.value);
+    }
+
+    AblationResult result() const {
+        AblationResult r;
+        r.configs = configs;
+        r.full = variants[0].stats;
+        for (size_t v = 1; v < variants.size(); v++) {
+            r.without.push_back(variants[v].stats);
+        }
+        return r;
+    }
+
+private:
+    struct Variant {
+        std::vector<size_t> active;  // component of each table, in order
+        std::vector<std::vector<EqualityPredictorEntry>> tables;
+        uint64_t rng_state;
+        ReplayStats stats;
+    };
+
+    // Same prediction and commit as BasicValuePredictor, on the variant's tables.
+    void stepVariant(Variant& variant, bool known, Value last, Value actual, bool equal) {
+        size_t n = variant.active.size();
+        EqualityPredictorEntry entries[64];
+        bool hit[64];
+        unsigned variant_tags[64];
+        for (size_t j = 0; j < n; j++) {
+            size_t c = variant.active[j];
+            entries[j] = variant.tables[j][index[c]];
+            variant_tags[j] = tags[c];
+            hit[j] = (entries[j].tag == tags[c]);
+        }
+
+        EqualityLookup l = findEqualityProviders(entries, hit, n);
+        Confidence conf = Confidence::low;
+        Value predicted = 0;
+        if (l.primary < n && known && entries[l.primary].getDirection()) {
+            conf = entries[l.primary].getConfidence();
+            predicted = last;
+        }
+        variant.stats.count(conf, predicted == actual, isNoPrediction(conf, predicted));
+
+        commitEqualityEntries(entries, hit, variant_tags, n, l, equal, [&variant] {
+            variant.rng_state ^= variant.rng_state << 13;
+            variant.rng_state ^= variant.rng_state >> 7;
+            variant.rng_state ^= variant.rng_state << 17;
+            return variant.rng_state;
+        });
+        for (size_t j = 0; j < n; j++) {
+            variant.tables[j][index[variant.active[j]]] = entries[j];
+        }
+    }
+
+    std::vector<ComponentConfig> configs;
+    std::vector<PathTracker> paths;
+    std::vector<Variant> variants;
+    LastCommittedValueTable lcvt;
+    std::vector<unsigned> index;
+    std::vector<unsigned> tags;
+};
+
+inline AblationResult runAblation(const std::vector<ValueTraceRecord>& trace,
+                                  const std::vector<ComponentConfig>& configs = defaultValuePredictorConfig(),
+                                  uint64_t seed = 1) {
+    ValuePredictorAblation ablation(configs, seed);
+    for (const auto& rec : trace) {
+        ablation.step(rec);
+    }
+    return ablation.result();
+}
+
+// Per component: its storage and how many high-confidence predictions are
+// gained or lost by removing it. A component earns its storage when removing
+// it costs correct predictions or adds wrong ones.
+inline void printAblation(std::ostream& os, const AblationResult& r) {
+    os << "  full predictor: high-confidence correct " << r.full.correct[high]
+       << ", wrong " << r.full.incorrect[high] << "\n";
+    os << "  removed  ghist  entries  storage bits  d correct  d wrong\n";
+    for (size_t k = 0; k < r.without.size(); k++) {
+        const ComponentConfig& c = r.configs[k + 1];
+        os << "  " << std::setw(7) << k + 1 << std::setw(7) << c.ghist_bits << std::setw(9) << c.size
+           << std::setw(14) << c.size * (c.tag_bits + 6)
+           << std::setw(11) << int64_t(r.without[k].correct[high]) - int64_t(r.full.correct[high])
+           << std::setw(9) << int64_t(r.without[k].incorrect[high]) - int64_t(r.full.incorrect[high]) << "\n";
+    }
+}
+
+#endif // VP_ABLATION_HH
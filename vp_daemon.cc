@@ -0,0 +1,84 @@
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include "vp_daemon.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+// Keeps a warmed ValuePredictor resident and serves it over a Unix socket,
+// see vp_daemon.h for the protocol.
+//
+//   vp_daemon SOCKET [--load STATE] [--warm BRANCH_TRACE [N] | --warm-values VALUE_TRACE [N]]
+//            [--snapshot STATE]
+//
+// --load restores a state saved by a snapshot, --warm replays the value trace
+// derived from the first N branches of BRANCH_TRACE (all if N is omitted),
+// --warm-values replays a recorded value trace up to its Nth branch, and
+// --snapshot names the file that snapshot requests write. Warming replays
+// from sequence number 0, so it is refused on top of a loaded state that
+// still has branches in flight; their sequence numbers belong to the client
+// that issued them.
+
+static void usage() {
+    std::cerr << "usage: vp_daemon SOCKET [--load STATE] [--warm BRANCH_TRACE [N] | --warm-values VALUE_TRACE [N]]\n"
+              << "                 [--snapshot STATE]\n";
+    std::exit(2);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2)
+        usage();
+    std::string socket_path = argv[1];
+    std::string load_path, warm_path, snapshot_path;
+    bool warm_values = false;
+    size_t warm_branches = SIZE_MAX;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--load" && i + 1 < argc) {
+            load_path = argv[++i];
+        } else if ((arg == "--warm" || arg == "--warm-values") && i + 1 < argc && warm_path.empty()) {
+            warm_values = (arg == "--warm-values");
+            warm_path = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                warm_branches = std::stoull(argv[++i]);
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else {
+            usage();
+        }
+    }
+
+    try {
+        ValuePredictor vp({});
+        auto start = std::chrono::steady_clock::now();
+        if (!load_path.empty()) {
+            std::ifstream in(load_path, std::ios::binary);
+            if (!in) {
+                throw std::runtime_error("cannot open " + load_path);
+            }
+            vp.load(in);
+        }
+        if (!warm_path.empty()) {
+            if (vp.inFlightBranches() != 0) {
+                throw std::runtime_error("cannot warm " + load_path + ": it has " + std::to_string(vp.inFlightBranches())
+                                         + " branches in flight");
+            }
+            auto trace = warm_values ? loadValueTrace(warm_path, warm_branches)
+                                     : makeValueTraceFromBranches(warm_path, warm_branches);
+            replayValueTrace(vp, trace);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        PredictorDaemon<ValuePredictor> daemon(vp, socket_path, snapshot_path);
+        std::cerr << "vp_daemon: ready on " << socket_path << " after " << seconds << "s of load/warmup\n";
+        daemon.serve();
+        std::cerr << "vp_daemon: shut down after " << daemon.batchesServed() << " batches\n";
+    } catch (const std::exception& e) {
+        std::cerr << "vp_daemon: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+#ifndef VP_DAEMON_HH
+#define VP_DAEMON_HH
+
+#include "vp.h"
+#include <string>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Resident predictor served over a Unix-domain socket, so tools can query a
+// warmed predictor without paying startup and warmup each time.
+//
+// Protocol: the client sends a batch as a 64-bit request count followed by
+// that many DaemonRequests, and receives one DaemonResponse per request, in
+// order. Requests of a batch are applied in order. A connection may carry
+// any number of batches; the server handles one connection at a time.
+enum DaemonOp : uint8_t {
+    daemon_predict = 0,        // pc -> confidence, value
+    daemon_commit = 1,         // pc, value
+    daemon_branch = 2,         // value = sequence number, taken
+    daemon_branch_commit = 3,  // value = sequence number
+    daemon_squash = 4,         // value = sequence number
+    daemon_snapshot = 5,       // save to the snapshot path -> state hash
+    daemon_state_hash = 6,     // -> state hash
+    daemon_shutdown = 7,       // stop serving after this batch
+};
+
+struct DaemonRequest {
+    uint8_t op;
+    uint8_t taken;
+    uint8_t reserved[6];
+    PC pc;
+    uint64_t value;
+};
+static_assert(sizeof(DaemonRequest) == 24, "daemon requests are 24 bytes");
+
+struct DaemonResponse {
+    enum Status : uint8_t { ok = 0, error = 1 };
+
+    uint8_t status;
+    uint8_t confidence;
+    uint8_t reserved[6];
+    uint64_t value;
+};
+static_assert(sizeof(DaemonResponse) == 16, "daemon responses are 16 bytes");
+
+constexpr size_t MAX_DAEMON_BATCH = 1 << 16;
+
+namespace daemon_io {
+inline void writeAll(int fd, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("socket write: ") + std::strerror(errno));
+        }
+        p += n;
+        bytes -= n;
+    }
+}
+
+// Returns false on a clean end of stream before any byte was read.
+inline bool readAll(int fd, void* data, size_t bytes) {
+    char* p = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = ::read(fd, p + done, bytes - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("socket read: ") + std::strerror(errno));
+        }
+        if (n == 0) {
+            if (done == 0)
+                return false;
+            throw std::runtime_error("socket closed mid-message");
+        }
+        done += n;
+    }
+    return true;
+}
+
+inline sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("socket path too long: " + path);
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+// Unlinks path if it is a socket nobody listens on any more. Throws if it is
+// something else or a live daemon still accepts on it.
+inline void removeStaleSocket(const std::string& path) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT)
+            return;
+        throw std::runtime_error("lstat " + path + ": " + std::strerror(errno));
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        throw std::runtime_error(path + " exists and is not a socket");
+    }
+    sockaddr_un addr = socketAddress(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+    int err = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 ? 0 : errno;
+    ::close(fd);
+    if (err == 0) {
+        throw std::runtime_error(path + " is in use by a running daemon");
+    }
+    if (err != ECONNREFUSED) {
+        throw std::runtime_error("connect " + path + ": " + std::strerror(err));
+    }
+    ::unlink(path.c_str());
+}
+}
+
+// Applies one predict, commit, branch, branch commit, squash or state hash
+// request. Returns false for other ops, which are up to the transport, and
+// for a branch commit that is out of order.
+template <class Predictor>
+bool applyPredictorRequest(Predictor& vp, const DaemonRequest& req, DaemonResponse& resp) {
+    switch (req.op) {
+    case daemon_predict: {
+        auto [conf, value] = vp.predict(req.pc);
+        resp.confidence = conf;
+        resp.value = value;
+        return true;
+    }
+    case daemon_commit:
+        vp.onValueCommit(req.pc, req.value);
+        return true;
+    case daemon_branch:
+        vp.updateOnBranch(req.value, req.taken);
+        return true;
+    case daemon_branch_commit:
+        // Committing anything but the oldest in-flight branch would trip an
+        // assert (or pop an empty queue), so it is refused instead.
+        if (!vp.isOldestBranch(req.value))
+            return false;
+        vp.onBranchCommit(req.value);
+        return true;
+    case daemon_squash:
+        vp.squash(req.value);
+        return true;
+    case daemon_state_hash:
+        resp.value = vp.stateHash();
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Serves any predictor with predict, onValueCommit, updateOnBranch,
+// isOldestBranch, onBranchCommit, squash, stateHash and save, e.g.
+// ValuePredictor.
+template <class Predictor>
+class PredictorDaemon {
+public:
+    // Binds and listens on socket_path, replacing a socket left by a daemon
+    // that is gone; throws if a live daemon or a non-socket is there.
+    // Snapshots are written to snapshot_path (empty = snapshots fail).
+    PredictorDaemon(Predictor& vp, const std::string& socket_path, const std::string& snapshot_path = "")
+        : vp(vp), socket_path(socket_path), snapshot_path(snapshot_path)
+    {
+        sockaddr_un addr = daemon_io::socketAddress(socket_path);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        try {
+            daemon_io::removeStaleSocket(socket_path);
+        } catch (...) {
+            ::close(listen_fd);
+            throw;
+        }
+        struct stat st;
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(listen_fd, 8) != 0 || ::lstat(socket_path.c_str(), &st) != 0) {
+            int err = errno;
+            ::close(listen_fd);
+            throw std::runtime_error("listen " + socket_path + ": " + std::strerror(err));
+        }
+        dev = st.st_dev;
+        ino = st.st_ino;
+    }
+
+    // Unlinks the socket only while the name still refers to this daemon's.
+    ~PredictorDaemon() {
+        ::close(listen_fd);
+        struct stat st;
+        if (::lstat(socket_path.c_str(), &st) == 0 && st.st_dev == dev && st.st_ino == ino)
+            ::unlink(socket_path.c_str());
+    }
+
+    PredictorDaemon(const PredictorDaemon&) = delete;
+    PredictorDaemon& operator=(const PredictorDaemon&) = delete;
+
+    // Accepts connections until a client sends daemon_shutdown.
+    void serve() {
+        bool running = true;
+        while (running) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("accept: ") + std::strerror(errno));
+            }
+            try {
+                running = serveConnection(fd);
+            } catch (const std::runtime_error&) {
+                // A broken client only ends its own connection
+            }
+            ::close(fd);
+        }
+    }
+
+    uint64_t batchesServed() const { return batches; }
+
+private:
+    bool serveConnection(int fd) {
+        uint64_t count;
+        while (daemon_io::readAll(fd, &count, sizeof(count))) {
+            if (count > MAX_DAEMON_BATCH) {
+                throw std::runtime_error("daemon batch too large");
+            }
+            requests.resize(count);
+            responses.resize(count);
+            if (count && !daemon_io::readAll(fd, requests.data(), count * sizeof(DaemonRequest))) {
+                throw std::runtime_error("socket closed mid-message");
+            }
+            bool shutdown = false;
+            for (size_t i = 0; i < count; i++) {
+                responses[i] = handle(requests[i]);
+                shutdown |= (requests[i].op == daemon_shutdown);
+            }
+            daemon_io::writeAll(fd, responses.data(), count * sizeof(DaemonResponse));
+            batches++;
+            if (shutdown)
+                return false;
+        }
+        return true;
+    }
+
+    DaemonResponse handle(const DaemonRequest& req) {
+        DaemonResponse resp{};
+        try {
+            if (applyPredictorRequest(vp, req, resp))
+                return resp;
+            if (req.op == daemon_snapshot) {
+                snapshot();
+                resp.value = vp.stateHash();
+            } else if (req.op != daemon_shutdown) {
+                resp.status = DaemonResponse::error;
+            }
+        } catch (const std::exception&) {
+            resp.status = DaemonResponse::error;
+        }
+        return resp;
+    }
+
+    // Written next to the target and renamed over it, so a snapshot file is
+    // always complete.
+    void snapshot() {
+        if (snapshot_path.empty()) {
+            throw std::runtime_error("no snapshot path");
+        }
+        std::string tmp = snapshot_path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            vp.save(out);
+            if (!out.flush()) {
+                throw std::runtime_error("write " + tmp);
+            }
+        }
+        if (::rename(tmp.c_str(), snapshot_path.c_str()) != 0) {
+            throw std::runtime_error("rename " + tmp + ": " + std::strerror(errno));
+        }
+    }
+
+    Predictor& vp;
+    std::string socket_path;
+    std::string snapshot_path;
+    int listen_fd = -1;
+    dev_t dev = 0;             // identity of the socket file, see the destructor
+    ino_t ino = 0;
+    uint64_t batches = 0;
+    std::vector<DaemonRequest> requests;
+    std::vector<DaemonResponse> responses;
+};
+
+class DaemonClient {
+public:
+    explicit DaemonClient(const std::string& socket_path) {
+        sockaddr_un addr = daemon_io::socketAddress(socket_path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error("connect " + socket_path + ": " + std::strerror(err));
+        }
+    }
+
+    ~DaemonClient() {
+        ::close(fd);
+    }
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // Sends n requests as one batch and waits for the n responses.
+    void call(const DaemonRequest* requests, size_t n, DaemonResponse* responses) {
+        if (n > MAX_DAEMON_BATCH) {
+            throw std::invalid_argument("daemon batch too large");
+        }
+        uint64_t count = n;
+        daemon_io::writeAll(fd, &count, sizeof(count));
+        daemon_io::writeAll(fd, requests, n * sizeof(DaemonRequest));
+        if (n && !daemon_io::readAll(fd, responses, n * sizeof(DaemonResponse))) {
+            throw std::runtime_error("daemon closed the connection");
+        }
+    }
+
+    DaemonResponse call(const DaemonRequest& request) {
+        DaemonResponse response;
+        call(&request, 1, &response);
+        return response;
+    }
+
+private:
+    int fd = -1;
+};
+
+#endif // VP_DAEMON_HH
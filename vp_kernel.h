@@ -0,0 +1,233 @@
+#ifndef VP_KERNEL_HH
+#define VP_KERNEL_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <array>
+#include <utility>
+
+// Value predictor engines behind one virtual interface, so a sweep can pick
+// either the generic ValuePredictor or one compiled for its exact geometry
+// at run time (see kernel_cache.h). Per-record calls are virtual; replay()
+// runs a whole trace inside the engine.
+class ValueKernel {
+public:
+    virtual ~ValueKernel() = default;
+
+    virtual std::pair<Confidence, Value> predict(PC pc) = 0;
+    virtual void onValueCommit(PC pc, Value val) = 0;
+    virtual void updateOnBranch(InstSeqNum seqNum, bool taken) = 0;
+    virtual void onBranchCommit(InstSeqNum seqNum) = 0;
+    virtual void squash(InstSeqNum seqNum) = 0;
+    virtual void seed(uint64_t s) = 0;
+    virtual uint64_t stateHash() const = 0;
+    virtual void dumpState(std::ostream& os) const = 0;
+    virtual ReplayStats replay(const std::vector<ValueTraceRecord>& trace) = 0;
+    virtual bool specialized() const = 0;
+};
+
+// Version of the extern "C" entry points of a kernel object, checked when it
+// is loaded. Header changes need no bump: the kernel cache key covers the
+// headers' contents.
+constexpr uint64_t VP_KERNEL_ABI = 1;
+
+// ValuePredictor for one geometry known at compile time. Geometry provides
+// `static constexpr ComponentConfig configs[]`; every component loop is
+// unrolled and every mask and fold position is a constant. Predictions and
+// stateHash() are those of a ValuePredictor with the same configs. Ahead
+// pipelining is not supported (ahead and select_bits must be 0).
+template <class Geometry>
+class SpecializedValuePredictor {
+public:
+    static constexpr size_t N = std::size(Geometry::configs);
+
+    SpecializedValuePredictor() {
+        forEachComponent([&](auto c) {
+            constexpr ComponentConfig cfg = Geometry::configs[c];
+            static_assert(cfg.ahead == 0 && cfg.select_bits == 0, "ahead pipelining is not specialized");
+            static_assert(cfg.index_bits + cfg.tag_bits <= 31 && cfg.ghist_bits <= MAX_HIST, "invalid geometry");
+            static_assert((size_t(1) << cfg.index_bits) <= cfg.size, "index exceeds the table");
+            tables[c].resize(cfg.size);
+        });
+        static_assert(N <= 64 && Geometry::configs[0].tag_bits == 0, "needs a tagless base, at most 64 components");
+    }
+
+    SpecializedValuePredictor(const SpecializedValuePredictor&) = delete;
+    SpecializedValuePredictor& operator=(const SpecializedValuePredictor&) = delete;
+
+    std::pair<Confidence, Value> predict(PC pc) {
+        Lookup k = lookup(pc);
+        EqualityLookup l = findEqualityProviders(k.entries, k.hit, N);
+        if (!lcvt.hasValue(pc) || !k.entries[l.primary].getDirection())
+            return {Confidence::low, 0};
+        return {k.entries[l.primary].getConfidence(), lcvt.lookup(pc)};
+    }
+
+    void onValueCommit(PC pc, Value val) {
+        Lookup k = lookup(pc);
+        EqualityLookup l = findEqualityProviders(k.entries, k.hit, N);
+        commitEqualityEntries(k.entries, k.hit, k.tags, N, l, val == lcvt.lookup(pc), [this] {
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 7;
+            rng_state ^= rng_state << 17;
+            return rng_state;
+        });
+        forEachComponent([&](auto c) { tables[c][k.index[c]] = k.entries[c]; });
+        lcvt.update(pc, val);
+    }
+
+    void updateOnBranch(InstSeqNum seqNum, bool taken) {
+        if (branch_queue.size() >= MAX_BRANCH_SPEC_DISTANCE) {
+            throw std::runtime_error("Exceeded maximum speculative branch distance");
+        }
+        branch_queue.push_back(seqNum);
+        // Same fold as PathTracker::addBranch
+        forEachComponent([&](auto c) {
+            constexpr ComponentConfig cfg = Geometry::configs[c];
+            if constexpr (cfg.ghist_bits != 0) {
+                constexpr size_t width = cfg.index_bits + cfg.tag_bits;
+                unsigned f = folded[c];
+                unsigned msb = (f >> (width - 1)) & 1;
+                f = ((f << 1) & ((1u << width) - 1)) | msb;
+                f ^= unsigned(history[cfg.ghist_bits - 1]) << (cfg.ghist_bits % width);
+                folded[c] = f ^ unsigned(taken);
+            }
+        });
+        history <<= 1;
+        history[0] = taken;
+    }
+
+    void onBranchCommit(InstSeqNum seqNum) {
+        assert(branch_queue.front() == seqNum);
+        branch_queue.pop_front();
+    }
+
+    void squash(InstSeqNum seqNum) {
+        while (!branch_queue.empty() && branch_queue.back() >= seqNum) {
+            branch_queue.pop_back();
+            bool outcome = history[0];
+            history >>= 1;
+            forEachComponent([&](auto c) {
+                constexpr ComponentConfig cfg = Geometry::configs[c];
+                if constexpr (cfg.ghist_bits != 0) {
+                    constexpr size_t width = cfg.index_bits + cfg.tag_bits;
+                    unsigned f = folded[c] ^ unsigned(outcome);
+                    f ^= unsigned(history[cfg.ghist_bits - 1]) << (cfg.ghist_bits % width);
+                    folded[c] = (f >> 1) | ((f & 1) << (width - 1));
+                }
+            });
+        }
+    }
+
+    void seed(uint64_t s) {
+        rng_state = s ? s : 1;
+    }
+
+    // Same scheme as ValuePredictor::stateHash.
+    uint64_t stateHash() const {
+        uint64_t h = mixHash(rng_state, branch_queue.size());
+        for (InstSeqNum seq : branch_queue) {
+            h = mixHash(h, seq);
+        }
+        for (size_t c = 0; c < N; c++) {
+            const ComponentConfig& cfg = Geometry::configs[c];
+            uint64_t ch = mixHash(mixHash(folded[c], cfg.ghist_bits), 0);
+            for (size_t i = 0; i < MAX_HIST; i += 64) {
+                uint64_t word = 0;
+                for (size_t b = i; b < std::min(i + 64, MAX_HIST) && cfg.ghist_bits != 0; b++) {
+                    word |= uint64_t(history[b]) << (b - i);
+                }
+                ch = mixHash(ch, word);
+            }
+            for (const auto& entry : tables[c]) {
+                ch = mixHash(ch, entry.tag);
+                ch = mixHash(ch, (entry.taken_counter << 8) | entry.not_taken_counter);
+            }
+            h = mixHash(h, ch);
+        }
+        return mixHash(h, lcvt.stateHash());
+    }
+
+    void dumpState(std::ostream& os) const {
+        os << "rng_state=" << rng_state << " branch_queue=" << branch_queue.size() << "\n";
+        for (size_t c = 0; c < N; c++) {
+            os << "component " << c << " folded_path=" << folded[c] << "\n";
+            for (size_t i = 0; i < tables[c].size(); i++) {
+                const auto& entry = tables[c][i];
+                if (entry.tag == 0 && entry.taken_counter == 0 && entry.not_taken_counter == 0)
+                    continue;
+                os << "  [" << i << "] tag=" << entry.tag << " t=" << entry.taken_counter
+                   << " nt=" << entry.not_taken_counter << "\n";
+            }
+        }
+        lcvt.dumpState(os);
+    }
+
+private:
+    struct Lookup {
+        EqualityPredictorEntry entries[N];
+        bool hit[N];
+        unsigned index[N];
+        unsigned tags[N];
+    };
+
+    template <class F, size_t... C>
+    static void unroll(F&& f, std::index_sequence<C...>) {
+        (f(std::integral_constant<size_t, C>()), ...);
+    }
+    template <class F>
+    static void forEachComponent(F&& f) {
+        unroll(f, std::make_index_sequence<N>());
+    }
+
+    // Same index and tag hash as PathTracker.
+    Lookup lookup(PC pc) const {
+        Lookup k;
+        unsigned hashed = pc ^ (pc >> 2) ^ (pc >> 5);
+        forEachComponent([&](auto c) {
+            constexpr ComponentConfig cfg = Geometry::configs[c];
+            unsigned combined = hashed ^ folded[c];
+            k.index[c] = combined & ((1u << cfg.index_bits) - 1);
+            k.tags[c] = (combined >> cfg.index_bits) & ((1u << cfg.tag_bits) - 1);
+            k.entries[c] = tables[c][k.index[c]];
+            k.hit[c] = (k.entries[c].tag == k.tags[c]);
+        });
+        return k;
+    }
+
+    std::array<std::vector<EqualityPredictorEntry>, N> tables;
+    std::array<unsigned, N> folded{};
+    std::bitset<MAX_HIST> history;
+    std::deque<InstSeqNum> branch_queue;
+    uint64_t rng_state = 1;
+    LastCommittedValueTable lcvt;
+};
+
+// Wraps an engine with the ValuePredictor interface as a ValueKernel.
+template <class Predictor, bool Specialized>
+class ValueKernelAdapter final : public ValueKernel {
+public:
+    template <class... Args>
+    explicit ValueKernelAdapter(Args&&... args) : vp(std::forward<Args>(args)...) {}
+
+    std::pair<Confidence, Value> predict(PC pc) override { return vp.predict(pc); }
+    void onValueCommit(PC pc, Value val) override { vp.onValueCommit(pc, val); }
+    void updateOnBranch(InstSeqNum seqNum, bool taken) override { vp.updateOnBranch(seqNum, taken); }
+    void onBranchCommit(InstSeqNum seqNum) override { vp.onBranchCommit(seqNum); }
+    void squash(InstSeqNum seqNum) override { vp.squash(seqNum); }
+    void seed(uint64_t s) override { vp.seed(s); }
+    uint64_t stateHash() const override { return vp.stateHash(); }
+    void dumpState(std::ostream& os) const override { vp.dumpState(os); }
+    ReplayStats replay(const std::vector<ValueTraceRecord>& trace) override {
+        return replayValueTrace(vp, trace);
+    }
+    bool specialized() const override { return Specialized; }
+
+private:
+    Predictor vp;
+};
+
+using GenericValueKernel = ValueKernelAdapter<ValuePredictor, false>;
+
+#endif // VP_KERNEL_HH
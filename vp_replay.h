@@ -0,0 +1,266 @@
+#ifndef VP_REPLAY_HH
+#define VP_REPLAY_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include <coroutine>
+#include <exception>
+
+// Per-confidence outcome of the predictions made while replaying a trace.
+struct ReplayStats {
+    uint64_t values = 0;
+    uint64_t branches = 0;
+    uint64_t correct[3] = {0, 0, 0};
+    uint64_t incorrect[3] = {0, 0, 0};
+    // Value records the predictor made no prediction for, which the value
+    // predictors report as {low, 0}. They are also counted in
+    // correct/incorrect[low], as correct when the value happened to be 0.
+    uint64_t unpredicted_correct = 0;
+    uint64_t unpredicted_incorrect = 0;
+
+    void count(Confidence confidence, bool hit, bool unpredicted) {
+        (hit ? correct : incorrect)[confidence]++;
+        if (unpredicted)
+            (hit ? unpredicted_correct : unpredicted_incorrect)++;
+        values++;
+    }
+
+    bool operator==(const ReplayStats& other) const {
+        for (size_t c = 0; c < 3; c++) {
+            if (correct[c] != other.correct[c] || incorrect[c] != other.incorrect[c])
+                return false;
+        }
+        return values == other.values && branches == other.branches
+            && unpredicted_correct == other.unpredicted_correct && unpredicted_incorrect == other.unpredicted_incorrect;
+    }
+};
+
+// Whether a value predictor's result is its "no prediction" answer. A real
+// low-confidence prediction of 0 looks the same and is counted as none.
+inline bool isNoPrediction(Confidence confidence, Value value) {
+    return confidence == Confidence::low && value == 0;
+}
+
+using PredictionLog = std::vector<std::pair<Confidence, Value>>;
+
+// What an engine predicted for one trace record. Records an engine does not
+// predict (e.g. branches for a value predictor) have valid == false.
+struct RecordPrediction {
+    bool valid;
+    Confidence confidence;
+    Value value;
+
+    bool operator==(const RecordPrediction& other) const {
+        return valid == other.valid && (!valid || (confidence == other.confidence && value == other.value));
+    }
+};
+
+// The commit side of stepRecord: everything it does after the prediction.
+// For a value predictor, commit the value, or speculatively update and
+// commit a branch. The record number doubles as the branch sequence number.
+template <class Predictor>
+void commitRecord(Predictor& vp, const ValueTraceRecord& rec, InstSeqNum seq) {
+    if (rec.kind == branch_record) {
+        vp.updateOnBranch(seq, rec.taken);
+        vp.onBranchCommit(seq);
+    } else {
+        vp.onValueCommit(rec.pc, rec.value);
+    }
+}
+
+// An EqualityPredictor used as a branch predictor commits the direction of
+// branches, exactly as the trace_gcc.txt accuracy run does. Value records
+// are ignored.
+inline void commitRecord(EqualityPredictor& ep, const ValueTraceRecord& rec, InstSeqNum seq) {
+    if (rec.kind != branch_record)
+        return;
+    ep.onValueCommit(rec.pc, rec.taken);
+    ep.updateOnBranch(seq, rec.taken);
+    ep.onBranchCommit(seq);
+}
+
+// Steps a value predictor over one record: predict then commit for values,
+// speculative update then commit for branches.
+template <class Predictor>
+RecordPrediction stepRecord(Predictor& vp, const ValueTraceRecord& rec, InstSeqNum seq) {
+    if (rec.kind == branch_record) {
+        commitRecord(vp, rec, seq);
+        return {false, Confidence::low, 0};
+    }
+
+    auto pred = vp.predict(rec.pc);
+    commitRecord(vp, rec, seq);
+    return {true, pred.first, pred.second};
+}
+
+// Steps an EqualityPredictor used as a branch predictor over one record.
+inline RecordPrediction stepRecord(EqualityPredictor& ep, const ValueTraceRecord& rec, InstSeqNum seq) {
+    if (rec.kind != branch_record) {
+        return {false, Confidence::low, 0};
+    }
+
+    auto [conf, direction] = ep.predict(rec.pc);
+    commitRecord(ep, rec, seq);
+    return {true, conf, direction};
+}
+
+// Counts pred, the prediction for rec, in stats.
+inline void scoreRecord(const RecordPrediction& pred, const ValueTraceRecord& rec, ReplayStats& stats,
+                        PredictionLog* log) {
+    if (!pred.valid) {
+        stats.branches++;
+        return;
+    }
+
+    // An EqualityPredictor used as a branch predictor predicts the direction
+    Value actual = (rec.kind == branch_record) ? Value(rec.taken) : rec.value;
+    stats.count(pred.confidence, pred.value == actual,
+                rec.kind == value_record && isNoPrediction(pred.confidence, pred.value));
+    if (log) {
+        log->push_back({pred.confidence, pred.value});
+    }
+}
+
+template <class Predictor>
+void replayRecord(Predictor& vp, const ValueTraceRecord& rec, InstSeqNum seq,
+                  ReplayStats& stats, PredictionLog* log) {
+    scoreRecord(stepRecord(vp, rec, seq), rec, stats, log);
+}
+
+// Commits the record and scores pred, a prediction the caller already made
+// for it with the predictor in its current state.
+template <class Predictor>
+void replayRecord(Predictor& vp, const ValueTraceRecord& rec, InstSeqNum seq, const RecordPrediction& pred,
+                  ReplayStats& stats, PredictionLog* log) {
+    commitRecord(vp, rec, seq);
+    scoreRecord(pred, rec, stats, log);
+}
+
+template <class Predictor>
+ReplayStats replayValueTrace(Predictor& vp, const std::vector<ValueTraceRecord>& trace,
+                             PredictionLog* log = nullptr) {
+    ReplayStats stats;
+    for (size_t i = 0; i < trace.size(); i++) {
+        replayRecord(vp, trace[i], i, stats, log);
+    }
+    return stats;
+}
+
+// Replays in fetch groups of up to `width` value records, a group ending
+// early after a taken branch. The whole group is predicted at once with
+// predictGroup() under the bank/port model, using the history at the start
+// of the group, and then committed record by record.
+template <class Predictor>
+ReplayStats replayValueTraceGrouped(Predictor& vp, const std::vector<ValueTraceRecord>& trace,
+                                    size_t width, const BankModel& model,
+                                    BankConflictStats& bank_stats) {
+    if (width == 0 || width > 64) {
+        throw std::invalid_argument("width must be in [1, 64]");
+    }
+
+    ReplayStats stats;
+    PC pcs[64];
+    std::pair<Confidence, Value> preds[64];
+    size_t i = 0;
+    while (i < trace.size()) {
+        size_t end = i;
+        size_t count = 0;
+        while (end < trace.size() && count < width) {
+            const ValueTraceRecord& rec = trace[end++];
+            if (rec.kind == value_record) {
+                pcs[count++] = rec.pc;
+            } else if (rec.taken) {
+                break;
+            }
+        }
+
+        vp.predictGroup(pcs, count, model, preds, bank_stats);
+
+        size_t k = 0;
+        for (; i < end; i++) {
+            const ValueTraceRecord& rec = trace[i];
+            if (rec.kind == branch_record) {
+                vp.updateOnBranch(i, rec.taken);
+                vp.onBranchCommit(i);
+                stats.branches++;
+                continue;
+            }
+            auto pred = preds[k++];
+            stats.count(pred.first, pred.second == rec.value, isNoPrediction(pred.first, pred.second));
+            vp.onValueCommit(rec.pc, rec.value);
+        }
+    }
+    return stats;
+}
+
+// Minimal coroutine handle for the replay lanes below. Lanes start
+// suspended and are driven by hand.
+struct ReplayLane {
+    struct promise_type {
+        ReplayLane get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// A lane claims the next record, prefetches its LCVT bucket and yields.
+// When resumed it replays the record, so records are processed in claim
+// order and the prefetches of the other lanes overlap with the work.
+template <class Predictor>
+ReplayLane replayLane(Predictor& vp, const std::vector<ValueTraceRecord>& trace, size_t& cursor,
+                      ReplayStats& stats, PredictionLog* log) {
+    while (cursor < trace.size()) {
+        size_t seq = cursor++;
+        const ValueTraceRecord& rec = trace[seq];
+        if (rec.kind == value_record) {
+            vp.prefetch(rec.pc);
+        }
+        co_await std::suspend_always{};
+        replayRecord(vp, rec, seq, stats, log);
+    }
+}
+
+// AMAC-style replay: group_size lanes are resumed round-robin. Predictions,
+// commit order and final state are identical to replayValueTrace. Only the
+// LCVT read is prefetched, and only tables whose prefetch() issues the slot
+// address without loading anything first (not the default
+// LastCommittedValueTable) gain from it.
+template <class Predictor>
+ReplayStats replayValueTraceInterleaved(Predictor& vp, const std::vector<ValueTraceRecord>& trace,
+                                        size_t group_size = 8, PredictionLog* log = nullptr) {
+    if (group_size == 0) {
+        throw std::invalid_argument("group_size must be > 0");
+    }
+
+    ReplayStats stats;
+    size_t cursor = 0;
+    std::vector<ReplayLane> lanes;
+    lanes.reserve(group_size);
+    for (size_t i = 0; i < group_size; i++) {
+        lanes.push_back(replayLane(vp, trace, cursor, stats, log));
+    }
+
+    size_t live = group_size;
+    while (live > 0) {
+        for (auto& lane : lanes) {
+            if (lane.handle.done())
+                continue;
+            lane.handle.resume();
+            if (lane.handle.done())
+                live--;
+        }
+    }
+
+    for (auto& lane : lanes) {
+        lane.handle.destroy();
+    }
+    return stats;
+}
+
+#endif // VP_REPLAY_HH
@@ -0,0 +1,126 @@
+#include "sweep_queue.h"
+#include <cstdlib>
+#include <iostream>
+
+// Command-line front end of the sweep job queue, see sweep_queue.h.
+//
+//   vp_sweep DIR submit TRACE [N] [--kind value|branch] [--value-trace]
+//                 [--components SIZE:GHIST:INDEX:TAG[:AHEAD:SELECT],...]
+//   vp_sweep DIR run [--checkpoint RECORDS] [--budget RECORDS]
+//   vp_sweep DIR status
+//
+// submit queues a job over the first N branches of TRACE (all if N is
+// omitted) with the default geometry or the given components. TRACE is a
+// branch trace to derive a value trace from, or with --value-trace a
+// recorded value trace (see loadValueTrace); a branch job
+// runs an EqualityPredictor as a branch predictor instead of a
+// ValuePredictor over the value trace. run drains the
+// queue, resuming checkpointed jobs; several workers may run on one queue at
+// once; a job that fails is reported by status and skipped until it is
+// submitted again. status lists the jobs, with the results of finished ones.
+
+static void usage() {
+    std::cerr << "usage: vp_sweep DIR submit TRACE [N] [--kind value|branch] [--value-trace]\n"
+              << "                [--components SIZE:GHIST:INDEX:TAG[:AHEAD:SELECT],...]\n"
+              << "       vp_sweep DIR run [--checkpoint RECORDS] [--budget RECORDS]\n"
+              << "       vp_sweep DIR status\n";
+    std::exit(2);
+}
+
+static std::vector<ComponentConfig> parseComponents(const std::string& text) {
+    std::vector<ComponentConfig> configs;
+    std::istringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        std::vector<size_t> fields;
+        std::istringstream parts(item);
+        std::string field;
+        while (std::getline(parts, field, ':')) {
+            fields.push_back(std::stoull(field));
+        }
+        if (fields.size() != 4 && fields.size() != 6) {
+            throw std::invalid_argument("bad component '" + item + "'");
+        }
+        fields.resize(6, 0);
+        configs.push_back({fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]});
+    }
+    return configs;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3)
+        usage();
+    std::string command = argv[2];
+
+    try {
+        SweepQueue queue(argv[1]);
+        if (command == "submit") {
+            if (argc < 4)
+                usage();
+            SweepJob job;
+            job.trace_path = argv[3];
+            for (int i = 4; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--components" && i + 1 < argc) {
+                    job.configs = parseComponents(argv[++i]);
+                } else if (arg == "--kind" && i + 1 < argc) {
+                    std::string kind = argv[++i];
+                    if (kind != "value" && kind != "branch")
+                        usage();
+                    job.kind = (kind == "branch") ? sweep_branch_job : sweep_value_job;
+                } else if (arg == "--value-trace") {
+                    job.value_trace = true;
+                } else if (i == 4 && arg[0] != '-') {
+                    job.branches = std::stoull(arg);
+                } else {
+                    usage();
+                }
+            }
+            std::cout << queue.submit(job) << "\n";
+        } else if (command == "run") {
+            SweepRunOptions options;
+            for (int i = 3; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--checkpoint" && i + 1 < argc) {
+                    options.checkpoint_interval = std::stoull(argv[++i]);
+                } else if (arg == "--budget" && i + 1 < argc) {
+                    options.record_budget = std::stoull(argv[++i]);
+                } else {
+                    usage();
+                }
+            }
+            SweepRunReport report = queue.run(options);
+            std::cerr << "vp_sweep: " << report.completed << " jobs completed (" << report.resumed
+                      << " resumed), " << report.failed << " failed, " << report.records << " records, " << report.checkpoints << " checkpoints"
+                      << (report.budget_exhausted ? ", budget exhausted" : "") << "\n";
+        } else if (command == "status") {
+            if (argc != 3)
+                usage();
+            auto jobs = queue.status();
+            printSweepStatus(std::cout, jobs);
+            for (const auto& s : jobs) {
+                if (s.state != sweep_done)
+                    continue;
+                auto r = queue.result(s.id);
+                if (r && s.job.kind == sweep_branch_job) {
+                    // Branches are the predicted records of a branch job
+                    uint64_t wrong = r->stats.incorrect[low] + r->stats.incorrect[medium] + r->stats.incorrect[high];
+                    std::cout << s.id << "  branches " << r->stats.values << ", accuracy "
+                              << (r->stats.values ? 1.0 - double(wrong) / r->stats.values : 0.0) << ", MPKI "
+                              << (r->stats.values ? 1000.0 * wrong / r->stats.values : 0.0) << "\n";
+                } else if (r) {
+                    uint64_t predicted = r->stats.correct[high] + r->stats.incorrect[high];
+                    std::cout << s.id << "  values " << r->stats.values << ", coverage "
+                              << (r->stats.values ? double(predicted) / r->stats.values : 0.0) << ", accuracy "
+                              << (predicted ? double(r->stats.correct[high]) / predicted : 0.0) << "\n";
+                }
+            }
+        } else {
+            usage();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "vp_sweep: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef VP_VALIDATE_HH
+#define VP_VALIDATE_HH
+
+#include "vp.h"
+#include "value_trace.h"
+#include "vp_replay.h"
+#include <ostream>
+#include <string>
+
+struct ValidationOptions {
+    // Compare full state hashes every hash_interval records (0 = predictions only).
+    size_t hash_interval = 0;
+    // Where both engine states are written at the first divergence (nullptr = nowhere).
+    std::ostream* dump = nullptr;
+};
+
+struct ValidationReport {
+    bool identical = true;
+    size_t records = 0;          // records replayed, including the divergent one
+    size_t first_divergence = 0; // index of the first divergent record
+    std::string reason;
+};
+
+// Runs a reference and a candidate engine side by side over a trace. Both
+// are stepped with stepRecord(), so any engine with a stepRecord overload
+// and stateHash()/dumpState() can be validated. Predictions are compared on
+// every record; the engines should be seeded identically beforehand.
+template <class Reference, class Candidate>
+ValidationReport validateLockstep(Reference& ref, Candidate& cand,
+                                  const std::vector<ValueTraceRecord>& trace,
+                                  const ValidationOptions& options = {}) {
+    ValidationReport report;
+
+    auto diverge = [&](size_t i, const std::string& reason) {
+        report.identical = false;
+        report.first_divergence = i;
+        report.reason = reason;
+        if (!options.dump)
+            return;
+        *options.dump << "first divergence at record " << i;
+        if (i < trace.size()) {
+            const ValueTraceRecord& rec = trace[i];
+            *options.dump << " (" << (rec.kind == branch_record ? "b " : "v ") << std::hex << rec.pc << " "
+                          << (rec.kind == branch_record ? Value(rec.taken) : rec.value) << std::dec << ")";
+        }
+        *options.dump << ": " << reason << "\n";
+        *options.dump << "--- reference state ---\n";
+        ref.dumpState(*options.dump);
+        *options.dump << "--- candidate state ---\n";
+        cand.dumpState(*options.dump);
+    };
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        RecordPrediction ref_pred = stepRecord(ref, trace[i], i);
+        RecordPrediction cand_pred = stepRecord(cand, trace[i], i);
+        report.records = i + 1;
+
+        if (!(ref_pred == cand_pred)) {
+            diverge(i, "prediction: reference (" + std::to_string(ref_pred.confidence) + ", "
+                    + std::to_string(ref_pred.value) + ") candidate (" + std::to_string(cand_pred.confidence)
+                    + ", " + std::to_string(cand_pred.value) + ")");
+            return report;
+        }
+        // A state mismatch is only known to lie within the last hash_interval records
+        if (options.hash_interval != 0 && (i + 1) % options.hash_interval == 0
+            && ref.stateHash() != cand.stateHash()) {
+            diverge(i, "state hash (within the last " + std::to_string(options.hash_interval) + " records)");
+            return report;
+        }
+    }
+
+    if (options.hash_interval != 0 && ref.stateHash() != cand.stateHash()) {
+        diverge(trace.size(), "state hash at end of trace");
+    }
+    return report;
+}
+
+#endif // VP_VALIDATE_HH
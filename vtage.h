@@ -0,0 +1,242 @@
+#ifndef VTAGE_HH
+#define VTAGE_HH
+
+#include "vp.h"
+#include <ostream>
+
+// VTAGE-style context value predictor (Perais & Seznec, HPCA 2014). Like the
+// EqualityPredictor it is a tagless base component plus tagged components
+// indexed with increasing global history lengths, but each entry holds a
+// full value, so values that vary with control flow can be predicted.
+
+class VTageEntry {
+public:
+    VTageEntry() : tag(0), value(0), confidence(0), useful(false) {}
+    VTageEntry(uint64_t tag, Value value) : tag(tag), value(value), confidence(0), useful(false) {}
+
+    // Correct values build confidence; a wrong value resets it and is only
+    // replaced once confidence has already dropped to zero.
+    void update(Value actual) {
+        if (value == actual) {
+            if (confidence < MAX_CONFIDENCE)
+                confidence++;
+        } else {
+            if (confidence == 0)
+                value = actual;
+            confidence = 0;
+        }
+    }
+
+    Confidence getConfidence() const {
+        if (confidence >= MAX_CONFIDENCE)
+            return Confidence::high;
+        if (confidence >= MAX_CONFIDENCE / 2)
+            return Confidence::medium;
+        return Confidence::low;
+    }
+
+    static constexpr uint8_t MAX_CONFIDENCE = 7;
+
+    uint64_t tag;
+    Value value;
+    uint8_t confidence;
+    bool useful;
+};
+
+class VTageComponent {
+public:
+    VTageComponent(const ComponentConfig& config)
+        : path(config.ghist_bits, config.index_bits, config.tag_bits, config.ahead, config.select_bits)
+        , entries(config.size)
+    {}
+
+    VTageEntry& getEntryConflict(PC pc) {
+        unsigned index = path.getIndex(pc);
+        assert(index < entries.size());
+        return entries[index];
+    }
+
+    VTageEntry* getEntry(PC pc) {
+        VTageEntry& entry = getEntryConflict(pc);
+        return (entry.tag == path.getTag(pc)) ? &entry : nullptr;
+    }
+
+    void allocate(PC pc, Value value) {
+        getEntryConflict(pc) = VTageEntry(path.getTag(pc), value);
+    }
+
+    void addBranch(bool outcome) {
+        path.addBranch(outcome);
+    }
+    void revertBranches(size_t num) {
+        path.revertBranches(num);
+    }
+
+    uint64_t stateHash() const {
+        uint64_t h = path.stateHash();
+        for (const auto& entry : entries) {
+            h = mixHash(h, entry.tag);
+            h = mixHash(h, entry.value);
+            h = mixHash(h, (entry.confidence << 1) | entry.useful);
+        }
+        return h;
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix) const {
+        fp.add(prefix + "entries", entries.capacity() * sizeof(VTageEntry));
+        fp.add(prefix + "path", sizeof(PathTracker));
+    }
+
+    void dumpState(std::ostream& os) const {
+        os << "ghist_bits=" << path.ghist_bits << " folded_path=" << path.folded_path << "\n";
+        for (size_t i = 0; i < entries.size(); i++) {
+            const auto& e = entries[i];
+            if (e.tag == 0 && e.value == 0 && e.confidence == 0 && !e.useful)
+                continue;
+            os << "  [" << i << "] tag=" << e.tag << " value=" << std::hex << e.value << std::dec
+               << " conf=" << int(e.confidence) << " u=" << e.useful << "\n";
+        }
+    }
+
+private:
+    PathTracker path;
+    std::vector<VTageEntry> entries;
+};
+
+class VTagePredictor {
+public:
+    VTagePredictor(const std::vector<ComponentConfig>& configs = defaultValuePredictorConfig()) {
+        if (configs.empty() || configs[0].tag_bits != 0) {
+            throw std::invalid_argument("VTAGE needs a tagless base component first");
+        }
+        components.reserve(configs.size());
+        for (const auto& config : configs) {
+            components.emplace_back(config);
+        }
+    }
+
+    // Deleted copy/move operations to prevent accidental copies
+    VTagePredictor(const VTagePredictor&) = delete;
+    VTagePredictor& operator=(const VTagePredictor&) = delete;
+
+    std::pair<Confidence, Value> predict(PC pc) {
+        Lookup l = lookup(pc);
+        return {l.provider->getConfidence(), l.provider->value};
+    }
+
+    void updateOnBranch(InstSeqNum seqNum, bool taken) {
+        if (branch_queue.size() >= MAX_BRANCH_SPEC_DISTANCE) {
+            throw std::runtime_error("Exceeded maximum speculative branch distance");
+        }
+        branch_queue.push_back(seqNum);
+        for (auto& component : components) {
+            component.addBranch(taken);
+        }
+    }
+
+    void onValueCommit(PC pc, Value val) {
+        Lookup l = lookup(pc);
+        bool correct = (l.provider->value == val);
+
+        if (l.alt && l.provider_index > 0) {
+            bool alt_correct = (l.alt->value == val);
+            if (correct != alt_correct)
+                l.provider->useful = correct;
+        }
+        l.provider->update(val);
+
+        // Allocate one longer-history entry on a misprediction, taking the
+        // first one that is not useful; otherwise age the candidates
+        if (!correct) {
+            bool allocated = false;
+            for (size_t i = l.provider_index + 1; i < components.size() && !allocated; i++) {
+                if (!components[i].getEntryConflict(pc).useful) {
+                    components[i].allocate(pc, val);
+                    allocated = true;
+                }
+            }
+            if (!allocated) {
+                for (size_t i = l.provider_index + 1; i < components.size(); i++) {
+                    components[i].getEntryConflict(pc).useful = false;
+                }
+            }
+        }
+    }
+
+    bool isOldestBranch(InstSeqNum seqNum) const {
+        return !branch_queue.empty() && branch_queue.front() == seqNum;
+    }
+
+    void onBranchCommit(InstSeqNum seqNum) {
+        assert(branch_queue.front() == seqNum);
+        branch_queue.pop_front();
+    }
+
+    void squash(InstSeqNum seqNum) {
+        size_t num_to_revert = 0;
+        while (!branch_queue.empty() && branch_queue.back() >= seqNum) {
+            num_to_revert++;
+            branch_queue.pop_back();
+        }
+        for (auto& component : components) {
+            component.revertBranches(num_to_revert);
+        }
+    }
+
+    uint64_t stateHash() const {
+        uint64_t h = mixHash(0, branch_queue.size());
+        for (InstSeqNum seq : branch_queue) {
+            h = mixHash(h, seq);
+        }
+        for (const auto& component : components) {
+            h = mixHash(h, component.stateHash());
+        }
+        return h;
+    }
+
+    void accountMemory(MemoryFootprint& fp, const std::string& prefix = "vtage.") const {
+        for (size_t i = 0; i < components.size(); i++) {
+            components[i].accountMemory(fp, prefix + "component" + std::to_string(i) + ".");
+        }
+        fp.add(prefix + "branch_queue", dequeBytes(branch_queue.size(), sizeof(InstSeqNum)));
+    }
+
+    void dumpState(std::ostream& os) const {
+        os << "branch_queue=" << branch_queue.size() << "\n";
+        for (size_t i = 0; i < components.size(); i++) {
+            os << "component " << i << " ";
+            components[i].dumpState(os);
+        }
+    }
+
+private:
+    // The provider is the hitting component with the longest history, the
+    // alternate the next longest. The tagless base always hits.
+    struct Lookup {
+        VTageEntry* provider;
+        size_t provider_index;
+        VTageEntry* alt;
+    };
+
+    Lookup lookup(PC pc) {
+        Lookup l{nullptr, 0, nullptr};
+        for (size_t i = components.size(); i-- > 0;) {
+            VTageEntry* entry = components[i].getEntry(pc);
+            if (!entry)
+                continue;
+            if (!l.provider) {
+                l.provider = entry;
+                l.provider_index = i;
+            } else {
+                l.alt = entry;
+                break;
+            }
+        }
+        return l;
+    }
+
+    std::vector<VTageComponent> components;
+    std::deque<InstSeqNum> branch_queue;
+};
+
+#endif // VTAGE_HH